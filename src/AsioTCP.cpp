@@ -6,6 +6,8 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/asio/buffer.hpp>
 #include <boost/asio/placeholders.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/write.hpp>
 #include <string.h>
 #include "AsioTCP.h"
 #include "GLog.h"
@@ -15,17 +17,54 @@ using namespace boost::system;
 using namespace boost::placeholders;
 using namespace boost::asio;
 
+/*!
+ * @brief 在data中查找标识串flag第一次出现的位置
+ * @param data 数据
+ * @param size 数据长度
+ * @param flag 标识串
+ * @param n    标识串长度
+ * @param from 从from开始查找
+ * @return
+ * 标识串第一次出现位置. 若flag不存在则返回-1
+ * @note
+ * 以memchr定位标识串首字符. glibc的memchr采用SSE2/AVX2实现, 每次比较16/32字节
+ */
+static int find_flag(const char* data, int size, const char* flag, int n, int from) {
+	const char* ptr = data + from;
+	const char* last = data + size - n; // 标识串可能出现的最后位置
+	while (ptr <= last) {
+		if (!(ptr = (const char*) memchr(ptr, flag[0], last - ptr + 1))) break;
+		if (n == 1 || !memcmp(ptr + 1, flag + 1, n - 1)) return int(ptr - data);
+		++ptr;
+	}
+	return -1;
+}
+
 /////////////////////////////////////////////////////////////////////
 /*--------------------- 客户端 ---------------------*/
-TcpClient::TcpClient()
-	: sock_(keep_.GetIOService()) {
-	pckRead_.reset(new char[TCP_PACK_SIZE]);
-	crcbuf_read_.set_capacity (TCP_PACK_SIZE * 50);
-	crcbuf_write_.set_capacity(TCP_PACK_SIZE * 50);
+TcpClient::TcpClient(io_service& ios)
+	: sock_(ios) {
+	capRead_ = TCP_PACK_SIZE * 50;
+	rdPos_ = wrPos_ = scanPos_ = 0;
+	maxFrame_ = TCP_PACK_SIZE;
+	rdPaused_ = false;
+	draining_ = false;
+	bufRead_.reset(new char[capRead_ + 1]);	// 预留结束符
+	bufRead_[capRead_] = '\0';
+	capWrite_ = TCP_PACK_SIZE * 50;
+	wrBytes_ = 0;
+	wrPending_ = false;
+	wrHigh_ = wrLow_ = capWrite_;
+	wrPolicy_ = WRPOL_NONE;
+	wrCongested_ = false;
+	wrDropped_ = wrCoalesced_ = 0;
+	capConn_ = 0;
+	capPeer_ = 0;
 }
 
 TcpClient::~TcpClient() {
-	Close();
+	error_code ec;
+	sock_.close(ec);
 }
 
 BoostTcpSock& TcpClient::Socket() {
@@ -34,13 +73,12 @@ BoostTcpSock& TcpClient::Socket() {
 
 bool TcpClient::Connect(const std::string& host, const uint16_t port, bool async) {
 	try {
-		BoostTcp::resolver rslv(keep_.GetIOService());
+		BoostTcp::resolver rslv(sock_.get_executor());
 		BoostTcp::resolver::query query(host, boost::lexical_cast<string>(port));
 		BoostTcp::resolver::iterator itertor = rslv.resolve(query);
 
-		if (!keep_.IsKeeping()) keep_.Reset();
 		if (async) {
-			sock_.async_connect(*itertor, boost::bind(&TcpClient::handle_connect, this, placeholders::error));
+			sock_.async_connect(*itertor, boost::bind(&TcpClient::handle_connect, shared_from_this(), placeholders::error));
 		}
 		else {
 			sock_.connect(*itertor);
@@ -72,6 +110,12 @@ bool TcpClient::Close() {
 	try {
 		ShutDown(2);
 		sock_.close();
+		MtxLck lck(mtx_read_);
+		if (rdPaused_) {// 无进行中的接收: 直接通知连接关闭
+			rdPaused_ = false;
+			post(sock_.get_executor(), boost::bind(&TcpClient::handle_read, shared_from_this(),
+				error_code(error::operation_aborted), 0));
+		}
 		return true;
 	}
 	catch (system_error &ex) {
@@ -88,35 +132,167 @@ int TcpClient::Read(char* data, const int n, const int from) {
 	if (!data || n <= 0 || from < 0) return 0;
 
 	MtxLck lck(mtx_read_);
-	int end(from + n), to_read;
+	reclaim_read();
+	int size(wrPos_ - rdPos_), to_read;
 
-	to_read = crcbuf_read_.size() > end ? n : crcbuf_read_.size() - from;
+	to_read = size > from + n ? n : size - from;
 	if (to_read > 0) {
-		int i(0), j(from);
-		for (; i < to_read; ++i, ++j) data[i] = crcbuf_read_[j];
-		crcbuf_read_.erase_begin(j);
+		memcpy(data, bufRead_.get() + rdPos_ + from, to_read);
+		rdPos_ += from + to_read;
+		scanPos_ = 0;
 	}
 	return to_read;
 }
 
+int TcpClient::ReadFrame(const char* flag, const int n, std::string_view& frame) {
+	if (!flag || n <= 0) return 0;
+
+	char* head;
+	int size, pos;
+	{// 网络线程只在wrPos_之后写入, 因此[rdPos_, wrPos_)可在锁外访问
+		MtxLck lck(mtx_read_);
+		head = bufRead_.get() + rdPos_;
+		size = wrPos_ - rdPos_;
+	}
+
+	// 从上次扫描结束处继续查找, 已接收数据只扫描一次
+	if ((pos = find_flag(head, size, flag, n, scanPos_)) < 0) {
+		if ((scanPos_ = size - n + 1) < 0) scanPos_ = 0;
+		return size > maxFrame_ ? -1 : 0;
+	}
+	if (pos + n > maxFrame_) return -1;
+
+	head[pos] = '\0';
+	frame = std::string_view(head, pos);
+	MtxLck lck(mtx_read_);
+	rdPos_ += pos + n;
+	scanPos_ = 0;
+	return pos + n;
+}
+int TcpClient::DrainFrames(const char* flag, const int n, const FrameHandler& handler) {
+	if (!flag || n <= 0) return 0;
+
+	TcpCPtr self = shared_from_this(); // 回调函数可能释放连接
+	char* head;
+	int size, pos, from(0), count(0), rslt(0);
+	{// 网络线程只在wrPos_之后写入, 因此[rdPos_, wrPos_)可在锁外访问
+		MtxLck lck(mtx_read_);
+		if (draining_) return 0; // 拒绝第二个读出方
+		draining_ = true;
+		head = bufRead_.get() + rdPos_;
+		size = wrPos_ - rdPos_;
+	}
+
+	while (1) {
+		if ((pos = find_flag(head, size, flag, n, from + scanPos_)) < 0) {
+			if ((scanPos_ = size - from - n + 1) < 0) scanPos_ = 0;
+			if (size - from > maxFrame_) rslt = -1;
+			break;
+		}
+		if (pos - from + n > maxFrame_) {
+			rslt = -1;
+			break;
+		}
+		head[pos] = '\0';
+		++count;
+		scanPos_ = 0;
+		bool goon = handler(std::string_view(head + from, pos - from));
+		from = pos + n;
+		if (!goon) break;
+	}
+
+	MtxLck lck(mtx_read_);
+	rdPos_ += from;
+	draining_ = false;
+	reclaim_read(); // 已读出数据后整理缓冲区, 恢复暂停的接收
+	return rslt < 0 ? rslt : count;
+}
+
+void TcpClient::SetMaxFrame(int n) {
+	MtxLck lck(mtx_read_);
+	if (n < TCP_PACK_SIZE) n = TCP_PACK_SIZE;
+	else if (n > capRead_ - TCP_PACK_SIZE) n = capRead_ - TCP_PACK_SIZE;
+	maxFrame_ = n;
+}
+
+void TcpClient::NotifyRead() {
+	cbread_(this, error_code());
+}
+
 int TcpClient::Write(const char* data, const int n) {
 	if (!data || n <= 0) return 0;
+	return Write(boost::make_shared<const string>(data, n));
+}
+
+int TcpClient::Write(const TcpBufPtr& buf, size_t key) {
+	int n = buf.use_count() ? int(buf->size()) : 0;
+	if (!n) return 0;
 
+	{
+		MtxLck lck(mtx_write_);
+		if (wrBytes_ + n > wrHigh_) wrCongested_ = true;
+		if (wrCongested_ && wrPolicy_ == WRPOL_COALESCE && key) {// 替换队列中同一键值的信息
+			for (auto it = wrQue_.begin(); it != wrQue_.end(); ++it) {
+				if (it->key == key) {
+					wrBytes_ += n - int(it->buf->size());
+					it->buf = buf;
+					++wrCoalesced_;
+					return n;
+				}
+			}
+		}
+		else if (wrCongested_ && wrPolicy_ == WRPOL_DROP_OLDEST) {// 丢弃最早的状态信息
+			for (auto it = wrQue_.begin(); it != wrQue_.end() && wrBytes_ + n > wrLow_;) {
+				if (!it->key) ++it;
+				else {
+					wrBytes_ -= int(it->buf->size());
+					it = wrQue_.erase(it);
+					++wrDropped_;
+				}
+			}
+		}
+
+		if (!(wrCongested_ && wrPolicy_ == WRPOL_DISCONNECT)) {
+			if (wrBytes_ + n > capWrite_) {// 不截断信息
+				++wrDropped_;
+				return 0;
+			}
+			wrQue_.push_back(WriteItem(buf, key));
+			wrBytes_ += n;
+			if (!wrPending_) {
+				wrPending_ = true;
+				post(sock_.get_executor(), boost::bind(&TcpClient::start_write, shared_from_this()));
+			}
+			return n;
+		}
+		++wrDropped_;
+	}
+	if (IsOpen()) {
+		_gLog.Write(LOG_WARN, "close slow TCP connection, send queue is over than %d bytes", wrHigh_);
+		Close();
+	}
+	return 0;
+}
+
+void TcpClient::SetWriteLimit(int high, int low, int policy) {
 	MtxLck lck(mtx_write_);
-	int had_write(n);
-	int wait_write(crcbuf_write_.size());
-	int capacity(crcbuf_write_.capacity() - wait_write);
+	if (high <= 0 || high > capWrite_) high = capWrite_;
+	if (low < 0 || low > high) low = high;
+	wrHigh_   = high;
+	wrLow_    = low;
+	wrPolicy_ = policy;
+}
 
-	if (had_write > capacity) had_write = capacity;
-	for (int i = 0; i < had_write; ++i) crcbuf_write_.push_back(data[i]);
-	if (!wait_write) start_write();
-	return had_write;
+void TcpClient::GetWriteStat(uint64_t& dropped, uint64_t& coalesced) {
+	MtxLck lck(mtx_write_);
+	dropped   = wrDropped_;
+	coalesced = wrCoalesced_;
 }
 
 int TcpClient::Lookup(char* first) {
 	MtxLck lck(mtx_read_);
-	int n = crcbuf_read_.size();
-	if (first && n) *first = crcbuf_read_[0];
+	int n = wrPos_ - rdPos_;
+	if (first && n) *first = bufRead_[rdPos_];
 	return n;
 }
 
@@ -124,41 +300,43 @@ int TcpClient::Lookup(const char* flag, const int n, const int from) {
 	if (!flag || n <= 0 || from < 0) return -1;
 
 	MtxLck lck(mtx_read_);
-	int end =crcbuf_read_.size() - n;
-	int pos, i(0), j(0);
-
-	for (pos = from; pos <= end; ++pos) {
-		for (i = 0, j = pos; i < n && flag[i] == crcbuf_read_[j]; ++i, ++j);
-		if (i == n) break;
-	}
-	return (i == n ? pos : -1);
+	return find_flag(bufRead_.get() + rdPos_, wrPos_ - rdPos_, flag, n, from);
 }
 
 int TcpClient::Lookup(const char chBegin, const char chEnd, int &posBegin, int &posEnd)
 {
 	MtxLck lck(mtx_read_);
 
-	int end = crcbuf_read_.size();
+	const char* head = bufRead_.get() + rdPos_;
+	int end = wrPos_ - rdPos_;
 	int pos, n1(0), n2(0);
 
 	posBegin = 1;
 	posEnd   = 0;
 
 	for (pos = 0; pos < end && (!n2 || n2 != n1); ++pos) {
-		if (crcbuf_read_[pos] == chBegin) {
+		if (head[pos] == chBegin) {
 			if (++n1 == 1) posBegin = pos;
 		}
-		else if (crcbuf_read_[pos] == chEnd) {
+		else if (head[pos] == chEnd) {
 			if (++n2 == n1) posEnd = pos;
 		}
 	}
 	return posEnd > posBegin ? (posEnd - posBegin + 1) : 0;
 }
 
+void TcpClient::SetCapture(const ProtoCapPtr& capture, int peer) {
+	MtxLck lck(mtx_read_);
+	capture_ = capture;
+	capPeer_ = peer;
+	if (capture_) capConn_ = capture_->Open(peer);
+}
+
 void TcpClient::Start()
 {
-	sock_.set_option(BoostTcpSock::keep_alive(true));
-	start_read();
+	error_code ec;
+	sock_.set_option(BoostTcpSock::keep_alive(true), ec);
+	if (!ec) start_read(); // 停止服务时, 连接可能已被关闭
 }
 
 void TcpClient::RegisterConnect(const CBSlot& slot) {
@@ -177,18 +355,43 @@ void TcpClient::RegisterWrite(const CBSlot& slot) {
 }
 
 void TcpClient::start_read() {
-	sock_.async_read_some(buffer(pckRead_.get(), TCP_PACK_SIZE),
-			boost::bind(&TcpClient::handle_read, this,
-				placeholders::error, placeholders::bytes_transferred));
+	MtxLck lck(mtx_read_);
+	int free = capRead_ - wrPos_;
+	if (free < TCP_PACK_SIZE) rdPaused_ = true; // 等待读出方整理缓冲区
+	else {
+		sock_.async_read_some(buffer(bufRead_.get() + wrPos_, free),
+				boost::bind(&TcpClient::handle_read, shared_from_this(),
+					placeholders::error, placeholders::bytes_transferred));
+	}
+}
+
+void TcpClient::reclaim_read() {
+	if (!rdPaused_) return; // 接收进行中, 不得移动数据
+	int size = wrPos_ - rdPos_;
+	if (size && rdPos_) memmove(bufRead_.get(), bufRead_.get() + rdPos_, size);
+	rdPos_ = 0;
+	wrPos_ = size;
+	if (capRead_ - wrPos_ >= TCP_PACK_SIZE) {
+		rdPaused_ = false;
+		post(sock_.get_executor(), boost::bind(&TcpClient::start_read, shared_from_this()));
+	}
 }
 
 void TcpClient::start_write() {
-	int towrite(crcbuf_write_.size());
-	if (towrite) {
-		sock_.async_write_some(buffer(crcbuf_write_.linearize(), towrite),
-				boost::bind(&TcpClient::handle_write, this,
-					placeholders::error, placeholders::bytes_transferred));
+	std::vector<const_buffer> bufs;
+	MtxLck lck(mtx_write_);
+	if (wrQue_.empty()) {
+		wrPending_ = false;
+		return;
 	}
+	for (int i = 0; i < TCP_WRITE_BATCH && !wrQue_.empty(); ++i) {
+		wrSending_.push_back(wrQue_.front().buf);
+		wrQue_.pop_front();
+		bufs.push_back(buffer(*wrSending_.back()));
+	}
+	async_write(sock_, bufs,
+			boost::bind(&TcpClient::handle_write, shared_from_this(),
+				placeholders::error, placeholders::bytes_transferred));
 }
 
 /* 响应async_函数的回调函数 */
@@ -202,33 +405,49 @@ void TcpClient::handle_connect(const error_code& ec) {
 
 void TcpClient::handle_read(const error_code& ec, int n) {
 	if (!ec) {
+		{
+			MtxLck lck(mtx_read_);
+			if (capture_) capture_->Data(capConn_, capPeer_, bufRead_.get() + wrPos_, n);
+			wrPos_ += n;
+		}
+		start_read(); // 先确定是否暂停接收, 再通知读出方
+	}
+	else {
 		MtxLck lck(mtx_read_);
-		for (int i = 0; i < n; ++i) crcbuf_read_.push_back(pckRead_[i]);
+		if (capture_) {// 只记录一次断开
+			capture_->Close(capConn_, capPeer_);
+			capture_.reset();
+		}
 	}
 	cbread_(this, ec);
-	if (!ec) start_read();
 }
 
 void TcpClient::handle_write(const error_code& ec, int n) {
-	if (!ec) {
+	{
 		MtxLck lck(mtx_write_);
-		crcbuf_write_.erase_begin(n);
-		start_write();
+		wrSending_.clear();
+		if (!ec) {
+			wrBytes_ -= n;
+			if (wrCongested_ && wrBytes_ <= wrLow_) wrCongested_ = false;
+		}
+		else {// 连接已失效, 丢弃待发送信息
+			wrQue_.clear();
+			wrBytes_ = 0;
+			wrPending_ = false;
+		}
 	}
+	if (!ec) start_write();
 	cbwrite_(this, ec);
 }
 
 /////////////////////////////////////////////////////////////////////
 /*--------------------- 服务器 ---------------------*/
 TcpServer::TcpServer()
-	: accept_(keep_.GetIOService()) {
+	: accept_(BoostAsioPool::Instance().GetIOService()) {
 }
 
 TcpServer::~TcpServer() {
-	if (accept_.is_open()) {
-		error_code ec;
-		accept_.close(ec);
-	}
+	Stop();
 }
 
 void TcpServer::RegisterAccept(const CBSlot &slot) {
@@ -250,15 +469,22 @@ bool TcpServer::Start(uint16_t port, bool v6) {
 	}
 }
 
+void TcpServer::Stop() {
+	if (accept_.is_open()) {
+		error_code ec;
+		accept_.close(ec);
+	}
+}
+
 void TcpServer::start_accept() {
 	if (accept_.is_open()) {
-		TcpClient* client = new TcpClient;
+		TcpCPtr client = TcpClient::Create(); // 新连接轮询分配至线程池
 		accept_.async_accept(client->Socket(),
-				boost::bind(&TcpServer::handle_accept, this, client, placeholders::error));
+				boost::bind(&TcpServer::handle_accept, shared_from_this(), client, placeholders::error));
 	}
 }
 
-void TcpServer::handle_accept(TcpClient* client, const error_code& ec) {
+void TcpServer::handle_accept(TcpCPtr client, const error_code& ec) {
 	if (!ec) {
 		cbfunc_(client, this);
 		client->Start();
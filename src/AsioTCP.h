@@ -23,6 +23,16 @@
  * @note
  * - 删除全局异步模式
  * - 可选的同步模式仅用于Connect(), 读写操作一律采用异步模式
+ *
+ * @date 2024-04-02
+ * @version 1.3
+ * @note
+ * - 套接字由共享线程池BoostAsioPool提供io_service, 不再为每个连接创建线程
+ * - 异步操作持有shared_from_this(), 保证回调执行期间实例有效
+ * - 接收缓冲区采用连续存储, 套接口直接写入空闲区, ReadFrame()返回信息视图而不复制数据
+ * - 发送队列存储共享只读缓冲区, 同一轮事件中写入的信息以async_write(writev)一次发送
+ * - 发送队列高/低水位及拥塞策略: 丢弃最早的状态信息, 合并同一键值的状态信息, 或断开连接.
+ *   始终以完整信息为单位丢弃, 不截断信息
  */
 
 #ifndef SRC_ASIOTCP_H_
@@ -31,17 +41,25 @@
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/system/error_code.hpp>
 #include <boost/signals2/signal.hpp>
+#include <boost/smart_ptr/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
 #include <string>
+#include <string_view>
+#include <deque>
+#include <vector>
 #include "BoostAsioKeep.h"
 #include "BoostInclude.h"
+#include "ProtoCapture.h"
 
 /////////////////////////////////////////////////////////////////////
 typedef boost::asio::ip::tcp	BoostTcp;		// boost::ip::tcp
 typedef BoostTcp::socket		BoostTcpSock;	// boost::ip::tcp::socket
 #define TCP_PACK_SIZE		1500
+#define TCP_WRITE_BATCH		64		// 单次async_write合并的最大缓冲区数量
+typedef boost::shared_ptr<const std::string> TcpBufPtr;	// 共享只读发送缓冲区
 /////////////////////////////////////////////////////////////////////
 /*--------------------- 客户端 ---------------------*/
-class TcpClient {
+class TcpClient : public boost::enable_shared_from_this<TcpClient> {
 public:
 	typedef boost::shared_ptr<TcpClient> Pointer;
 	/*!
@@ -51,34 +69,99 @@ public:
 	 */
 	typedef boost::signals2::signal<void (TcpClient*, boost::system::error_code)> CBF;
 	typedef CBF::slot_type CBSlot;
+	/*!
+	 * @brief 声明完整信息处理函数
+	 * @param 1 信息视图, 不含结束符, 以'\0'结尾
+	 * @return
+	 * 是否继续处理后续信息
+	 */
+	typedef boost::function<bool (std::string_view)> FrameHandler;
+	/*!
+	 * @brief 发送队列拥塞策略
+	 * @note
+	 * 待发送数据超过高水位后进入拥塞状态, 回落至低水位后恢复
+	 */
+	enum {
+		WRPOL_NONE,			///< 丢弃超出队列容量的新信息
+		WRPOL_DROP_OLDEST,	///< 丢弃最早的状态信息, 直至低于低水位
+		WRPOL_COALESCE,		///< 同一键值的状态信息只保留最新一条
+		WRPOL_DISCONNECT	///< 断开连接
+	};
+
+protected:
+	/*!
+	 * @brief 待发送信息
+	 */
+	struct WriteItem {
+		TcpBufPtr buf;	///< 数据
+		size_t key;		///< 状态信息键值. 0: 不可丢弃或合并
+
+	public:
+		WriteItem(const TcpBufPtr& _buf, size_t _key)
+			: buf(_buf), key(_key) {
+		}
+	};
 
 protected:
 	/* socket资源 */
-	BoostAsioKeep keep_;	//< 提供boost::asio::io_contexts对象, 并在实例存在期间保持其运行
-	BoostTcpSock sock_;		//< 套接口
+	BoostTcpSock sock_;		//< 套接口. io_service由BoostAsioPool分配
 
 	/* 读写缓冲区 */
-	ArrayChar pckRead_;			//< 缓冲区: 单次接收
-	ArrayCharCrc crcbuf_read_;	//< 缓冲区: 所有接收
-	ArrayCharCrc crcbuf_write_;	//< 缓冲区: 所有待写入
+	/*
+	 * 接收缓冲区[0, capRead_):
+	 * - [rdPos_, wrPos_)为未读出数据, [wrPos_, capRead_)为套接口写入区
+	 * - 网络线程只写入wrPos_之后的空闲区, 不移动已接收数据
+	 * - 空闲区不足TCP_PACK_SIZE时暂停接收, 由读出方整理缓冲区后恢复
+	 */
+	ArrayChar bufRead_;		//< 缓冲区: 所有接收
+	int capRead_;			//< 接收缓冲区容量
+	int rdPos_;				//< 接收缓冲区读出位置
+	int wrPos_;				//< 接收缓冲区写入位置
+	int scanPos_;			//< ReadFrame已扫描且未找到结束符的长度, 相对于rdPos_
+	int maxFrame_;			//< 单条信息最大长度, 含结束符
+	bool rdPaused_;			//< 因空闲区不足暂停接收
+	bool draining_;			//< DrainFrames()处理中. 同一时刻只允许一个读出方
+	/*
+	 * 发送队列:
+	 * - 待发送信息以共享只读缓冲区排队, 不逐字节复制
+	 * - 首次写入时向io_service投递start_write, 同一轮事件中的写入合并发送
+	 */
+	std::deque<WriteItem> wrQue_;		//< 待发送队列
+	std::vector<TcpBufPtr> wrSending_;	//< 发送中缓冲区, async_write完成前保持有效
+	int capWrite_;			//< 发送队列容量, 量纲: 字节
+	int wrBytes_;			//< 发送队列及发送中数据长度, 量纲: 字节
+	bool wrPending_;		//< 已投递或正在执行async_write
+	int wrHigh_;			//< 发送队列高水位, 量纲: 字节
+	int wrLow_;				//< 发送队列低水位, 量纲: 字节
+	int wrPolicy_;			//< 拥塞策略
+	bool wrCongested_;		//< 发送队列拥塞
+	uint64_t wrDropped_;	//< 统计: 丢弃的信息数量
+	uint64_t wrCoalesced_;	//< 统计: 被合并的信息数量
 	boost::mutex mtx_read_;		//< 互斥锁: 从套接口读取
 	boost::mutex mtx_write_;	//< 互斥锁: 向套接口写入
 
+	/* 接收数据捕获. 在mtx_read_保护下访问 */
+	ProtoCapPtr capture_;	//< 捕获文件. 空: 不捕获
+	uint32_t capConn_;		//< 捕获连接序号
+	int capPeer_;			//< 终端类型
+
 	/* 回调接口 */
 	CBF  cbconn_;	//< connect回调函数
 	CBF  cbread_;	//< read回调函数
 	CBF  cbwrite_;	//< write回调函数
 
 public:
-	TcpClient();
+	TcpClient(io_service& ios);
 	virtual ~TcpClient();
 	/*!
 	 * @brief 创建TcpClient::Pointer实例
 	 * @return
 	 * shared_ptr<TcpClient>类型实例指针
+	 * @note
+	 * 以轮询方式从BoostAsioPool中分配io_service
 	 */
 	static Pointer Create() {
-		return Pointer(new TcpClient);
+		return Pointer(new TcpClient(BoostAsioPool::Instance().GetIOService()));
 	}
 	/*!
 	 * @brief 查看套接字
@@ -122,14 +205,72 @@ public:
 	 * 实际读取数据长度
 	 */
 	int Read(char* data, const int n, const int from = 0);
+	/*!
+	 * @brief 从已接收信息中取出以flag结束的第一条完整信息, 不复制数据
+	 * @param flag  结束符
+	 * @param n     结束符长度
+	 * @param frame 信息视图, 不含结束符. 结束符首字节被置为'\0', 因此frame.data()可作为C字符串使用.
+	 *              视图在下一次调用Read()/ReadFrame()之前有效
+	 * @return
+	 * 信息长度, 含结束符. 0: 无完整信息; -1: 信息长度超过单条信息最大长度
+	 */
+	int ReadFrame(const char* flag, const int n, std::string_view& frame);
+	/*!
+	 * @brief 依次处理已接收信息中所有以flag结束的完整信息, 不复制数据
+	 * @param flag    结束符
+	 * @param n       结束符长度
+	 * @param handler 信息处理函数. 返回false时停止处理, 其后信息保留在缓冲区
+	 * @return
+	 * 已处理信息数量. -1: 信息长度超过单条信息最大长度
+	 * @note
+	 * - 单次调用只在开始和结束时各锁定一次接收缓冲区
+	 * - 已有读出方处理中时直接返回0. 连接移交后, 原持有者的过时通知不能与新持有者同时读出
+	 */
+	int DrainFrames(const char* flag, const int n, const FrameHandler& handler);
+	/*!
+	 * @brief 设置单条信息最大长度. 缺省为TCP_PACK_SIZE
+	 * @param n  最大长度, 含结束符. 不超过接收缓冲区容量减去TCP_PACK_SIZE
+	 * @note
+	 * 用于批量协议等长信息
+	 */
+	void SetMaxFrame(int n);
+	/*!
+	 * @brief 以当前已接收信息触发read回调函数
+	 * @note
+	 * 用于连接移交处理方后, 通知新处理方读出缓冲区中的剩余信息
+	 */
+	void NotifyRead();
 	/*!
 	 * @brief 发送指定数据
 	 * @param data 待发送数据存储区指针
 	 * @param n    待发送数据长度
 	 * @return
-	 * 实际发送数据长度
+	 * 实际发送数据长度. 0: 发送队列已满, 信息被丢弃
+	 * @note
+	 * 复制一次数据后调用Write(TcpBufPtr)
 	 */
 	int Write(const char* data, const int n);
+	/*!
+	 * @brief 发送共享缓冲区, 只排队引用而不复制数据
+	 * @param buf 待发送数据
+	 * @param key 状态信息键值, 例如由类型/gid/uid/cid计算的哈希值. 0: 不可丢弃或合并
+	 * @return
+	 * 实际发送数据长度. 0: 信息被丢弃
+	 */
+	int Write(const TcpBufPtr& buf, size_t key = 0);
+	/*!
+	 * @brief 设置发送队列水位及拥塞策略
+	 * @param high   高水位, 量纲: 字节. 不超过队列容量
+	 * @param low    低水位, 量纲: 字节
+	 * @param policy 拥塞策略, WRPOL_*
+	 */
+	void SetWriteLimit(int high, int low, int policy);
+	/*!
+	 * @brief 查看发送队列统计
+	 * @param dropped   丢弃的信息数量
+	 * @param coalesced 被合并的信息数量
+	 */
+	void GetWriteStat(uint64_t& dropped, uint64_t& coalesced);
 	/*!
 	 * @brief 查找已接收信息中第一个字符
 	 * @param flag 标识符
@@ -156,6 +297,12 @@ public:
 	 * 匹配字符串长度
 	 */
 	int Lookup(const char chBegin, const char chEnd, int& posBegin, int& posEnd);
+	/*!
+	 * @brief 启用接收数据捕获. 应在Start()之前调用
+	 * @param capture 捕获文件
+	 * @param peer    终端类型
+	 */
+	void SetCapture(const ProtoCapPtr& capture, int peer);
 	/*!
 	 * @brief 服务器端建立网络连接后调用, 启动接收流程
 	 */
@@ -188,7 +335,12 @@ protected:
 	 */
 	void start_read();
 	/*!
-	 * @brief 尝试发送缓冲区数据
+	 * @brief 读出方整理接收缓冲区: 将未读出数据移至缓冲区首部, 并恢复暂停的接收
+	 * @note 调用前须锁定mtx_read_
+	 */
+	void reclaim_read();
+	/*!
+	 * @brief 以async_write发送队列中的缓冲区, 单次最多合并TCP_WRITE_BATCH个
 	 */
 	void start_write();
 	/* 响应async_函数的回调函数 */
@@ -214,7 +366,7 @@ typedef TcpClient::Pointer TcpCPtr;
 
 /////////////////////////////////////////////////////////////////////
 /*--------------------- 服务器 ---------------------*/
-class TcpServer {
+class TcpServer : public boost::enable_shared_from_this<TcpServer> {
 public:
 	typedef boost::shared_ptr<TcpServer> Pointer;
 	/*!
@@ -222,12 +374,11 @@ public:
 	 * @param 1 客户端对象
 	 * @param 2 实例指针
 	 */
-	typedef boost::signals2::signal<void (TcpClient*, TcpServer*)> CallbackFunc;
+	typedef boost::signals2::signal<void (const TcpCPtr&, TcpServer*)> CallbackFunc;
 	typedef CallbackFunc::slot_type CBSlot;
 
 protected:
-	BoostAsioKeep keep_;		//< 提供boost::asio::io_service对象, 并在实例存在期间保持其运行
-	BoostTcp::acceptor accept_;	//< 网络服务
+	BoostTcp::acceptor accept_;	//< 网络服务. io_service由BoostAsioPool分配
 	CallbackFunc cbfunc_;		//< 回调函数
 
 public:
@@ -255,6 +406,10 @@ public:
 	 * TCP网络服务创建结果
 	 */
 	bool Start(uint16_t port, bool v6 = false);
+	/*!
+	 * @brief 停止网络服务
+	 */
+	void Stop();
 
 protected:
 	/*!
@@ -266,7 +421,7 @@ protected:
 	 * @param client 建立套接字
 	 * @param ec     错误代码
 	 */
-	void handle_accept(TcpClient* client, const boost::system::error_code& ec);
+	void handle_accept(TcpCPtr client, const boost::system::error_code& ec);
 };
 typedef TcpServer::Pointer TcpSPtr;
 
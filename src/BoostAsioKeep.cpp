@@ -5,7 +5,12 @@
  * @author Xiaomeng Lu
  */
 #include <boost/bind/bind.hpp>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include "BoostAsioKeep.h"
+#include "GLog.h"
 
 using namespace boost::asio;
 
@@ -15,8 +20,7 @@ BoostAsioKeep::BoostAsioKeep()
 }
 
 BoostAsioKeep::~BoostAsioKeep() {
-	ios_.stop();
-	thrdKeep_.join();
+	Stop();
 }
 
 io_service& BoostAsioKeep::GetIOService() {
@@ -29,9 +33,78 @@ bool BoostAsioKeep::IsKeeping() {
 
 void BoostAsioKeep::Stop() {
 	ios_.stop();
-	thrdKeep_.join();
+	if (thrdKeep_.joinable()) thrdKeep_.join();
 }
 
 void BoostAsioKeep::Reset() {
 	if (!thrdKeep_.joinable()) thrdKeep_ = boost::thread(boost::bind(&io_service::run, boost::ref(ios_)));
 }
+
+bool BoostAsioKeep::BindCPU(int cpu) {
+#ifdef __linux__
+	if (!thrdKeep_.joinable()) return false;
+	cpu_set_t cpuset;
+	CPU_ZERO(&cpuset);
+	CPU_SET(cpu, &cpuset);
+	return !pthread_setaffinity_np(thrdKeep_.native_handle(), sizeof(cpu_set_t), &cpuset);
+#else
+	return false;
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////
+/*!
+ * @brief 查看进程可用的CPU核
+ * @note
+ * taskset或cgroup限定cpuset时, 可用核少于且不同于hardware_concurrency()
+ */
+static std::vector<int> process_cpus() {
+	std::vector<int> cpus;
+#ifdef __linux__
+	cpu_set_t cpuset;
+	CPU_ZERO(&cpuset);
+	if (!sched_getaffinity(0, sizeof(cpu_set_t), &cpuset)) {
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+			if (CPU_ISSET(cpu, &cpuset)) cpus.push_back(cpu);
+		}
+	}
+#endif
+	return cpus;
+}
+
+BoostAsioPool::BoostAsioPool(int n)
+	: next_(0) {
+	std::vector<int> cpus = process_cpus();
+	int cores = cpus.size() ? int(cpus.size()) : int(boost::thread::hardware_concurrency());
+	if (cores <= 0) cores = 1;
+	if (n <= 0) n = cores;
+	bool bind = cpus.size() && n <= cores; // 线程多于可用核时由系统调度, 避免多个线程固定在同一核
+	for (int i = 0; i < n; ++i) {
+		KeepPtr keep(new BoostAsioKeep);
+		if (bind && !keep->BindCPU(cpus[i])) {
+			_gLog.Write(LOG_WARN, "failed to bind I/O thread %d to CPU %d", i, cpus[i]);
+		}
+		keeps_.push_back(keep);
+	}
+}
+
+BoostAsioPool::~BoostAsioPool() {
+	keeps_.clear();
+}
+
+BoostAsioPool& BoostAsioPool::Instance(int n) {
+	static BoostAsioPool pool(n);
+	return pool;
+}
+
+io_service& BoostAsioPool::GetIOService() {
+	return keeps_[next_++ % keeps_.size()]->GetIOService();
+}
+
+void BoostAsioPool::Stop() {
+	for (KeepPtr& keep : keeps_) keep->Stop();
+}
+
+size_t BoostAsioPool::Size() {
+	return keeps_.size();
+}
@@ -8,13 +8,19 @@
  * 建立ioservice_keep维护其长期有效性
  * @date  2021-11-21
  * @note io_service ==> io_context
+ * @date  2024-04-02
+ * @note
+ * - 增加BoostAsioPool: 由固定数量的io_service组成线程池, 以轮询方式分配给网络连接
  */
 
 #ifndef SRC_ASIOIOSERVICEKEEP_H_
 #define SRC_ASIOIOSERVICEKEEP_H_
 
+#include <vector>
+#include <boost/atomic.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/thread/thread.hpp>
+#include <boost/smart_ptr/shared_ptr.hpp>
 
 using boost::asio::io_service;//	BoostAsioService;
 
@@ -44,6 +50,53 @@ public:
 	 * @brief 重启服务
 	 */
 	void Reset();
+	/**
+	 * @brief 将工作线程绑定至指定CPU核
+	 * @param cpu  CPU核序号
+	 * @return 绑定结果
+	 */
+	bool BindCPU(int cpu);
+};
+
+/**
+ * @brief 共享io_service线程池
+ * @note
+ * - 每个io_service对应一个工作线程, 工作线程按序号绑定进程可用的CPU核. 线程多于可用核时不绑定
+ * - 网络连接以轮询方式分配至各io_service, 线程数量不随连接数量增长
+ */
+class BoostAsioPool {
+protected:
+	typedef boost::shared_ptr<BoostAsioKeep> KeepPtr;
+	/* 成员变量 */
+	std::vector<KeepPtr> keeps_;	///< io_service集合
+	boost::atomic<unsigned> next_;	///< 下一个分配的io_service序号
+
+protected:
+	BoostAsioPool(int n);
+
+public:
+	virtual ~BoostAsioPool();
+	/**
+	 * @brief 访问进程唯一的线程池
+	 * @param n  io_service数量. 仅在首次调用时有效; <=0时采用进程可用的CPU核数
+	 * @return 线程池
+	 */
+	static BoostAsioPool& Instance(int n = 0);
+	/**
+	 * @brief 以轮询方式分配io_service
+	 * @return io_service
+	 */
+	io_service& GetIOService();
+	/**
+	 * @brief 停止所有io_service线程
+	 * @note
+	 * 进程退出前调用, 避免网络回调访问已释放的对象
+	 */
+	void Stop();
+	/**
+	 * @brief 查看io_service数量
+	 */
+	size_t Size();
 };
 
 #endif /* SRC_ASIOIOSERVICEKEEP_H_ */
@@ -7,7 +7,9 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include "GeneralControl.h"
 #include "AstroDeviceDef.h"
+#include "ADefine.h"
 #include "GLog.h"
+#include "ProtoNumber.h"
 
 #define MSGQUE_NAME "msgque_gtoaes"
 
@@ -15,8 +17,32 @@ using namespace boost;
 using namespace boost::placeholders;
 using namespace boost::posix_time;
 
+/*!
+ * @brief 计算状态信息键值, 用于客户端发送队列拥塞时合并同一设备的状态
+ * @return
+ * 非0键值
+ */
+static size_t status_key(const char* type, const string& gid, const string& uid, const string& cid = "") {
+	size_t key(0);
+	hash_combine(key, string(type));
+	hash_combine(key, gid);
+	hash_combine(key, uid);
+	hash_combine(key, cid);
+	return key ? key : 1;
+}
+
+/*!
+ * @brief 解析客户端发送队列拥塞策略
+ */
+static int queue_policy(const string& name) {
+	if (iequals(name, "drop_oldest")) return TcpClient::WRPOL_DROP_OLDEST;
+	if (iequals(name, "coalesce"))    return TcpClient::WRPOL_COALESCE;
+	if (iequals(name, "disconnect"))  return TcpClient::WRPOL_DISCONNECT;
+	return TcpClient::WRPOL_NONE;
+}
+
 GeneralControl::GeneralControl(Parameter *param)
-	: param_(param) {
+	: param_(param), tcpConns_(PEER_LAST) {
 }
 
 GeneralControl::~GeneralControl() {
@@ -24,10 +50,21 @@ GeneralControl::~GeneralControl() {
 
 // 启动服务
 bool GeneralControl::Start() {
+	BoostAsioPool::Instance(param_->ioThreads); // 网络I/O线程池
+	if (!param_->capturePath.empty()) {
+		if (!(capture_ = ProtoCapture::Create(param_->capturePath))) {
+			_gLog.Write(LOG_FAULT, "failed to create capture file <%s>", param_->capturePath.c_str());
+			return false;
+		}
+		_gLog.Write("capture received data into <%s>", param_->capturePath.c_str());
+	}
+	if (!param_->planJournal.empty()) journal_.Start(param_->planJournal);
+	ats_.SetSite(param_->siteLon, param_->siteLat, param_->siteAlt, int(param_->siteLon / 15.0 + 0.5));
 	if (!MessageQueue::Start(MSGQUE_NAME)) return false;
 	if (!start_tcp_server()) return false;
 	thrdCycleUpdClient_ = Thread(boost::bind(&GeneralControl::cycle_upload_client, this));
 	thrdDumpObss_ = Thread(boost::bind(&GeneralControl::cycle_dump_obss, this));
+	thrdCycleUpdPlan_ = Thread(boost::bind(&GeneralControl::cycle_upload_plan, this));
 
 	return true;
 }
@@ -38,10 +75,19 @@ void GeneralControl::Stop() {
 	MessageQueue::Stop();
 	interrupt_thread(thrdCycleUpdClient_);
 	interrupt_thread(thrdDumpObss_);
+	interrupt_thread(thrdCycleUpdPlan_);
+	// 终止: 网络线程. 此后不再触发网络回调
+	BoostAsioPool::Instance().Stop();
 	// 终止: 观测系统
 	for (auto it = obssVec_.begin(); it != obssVec_.end(); ++it) (*it)->Stop();
 	obssVec_.clear();
+	journal_.Stop();
 	// 终止: 网络服务
+	TcpSPtr servers[] = {tcpSvrClient_, tcpSvrMountGWAC_, tcpSvrCameraGWAC_,
+		tcpSvrFocus_, tcpSvrMountGFT_, tcpSvrCameraGFT_};
+	for (TcpSPtr& server : servers) {
+		if (server.use_count()) server->Stop();
+	}
 	tcpSvrClient_.reset();
 	tcpSvrMountGWAC_.reset();
 	tcpSvrCameraGWAC_.reset();
@@ -49,23 +95,33 @@ void GeneralControl::Stop() {
 	tcpSvrMountGFT_.reset();
 	tcpSvrCameraGFT_.reset();
 	// 终止: 网络连接
-	tcpCliClient_.Reset();
-	tcpCliDevice_.Reset();
+	tcpConns_.Reset();
+	if (capture_.use_count()) capture_->Flush();
 }
 
 // 注册消息响应函数
 void GeneralControl::register_messages() {
-	const CBSlot& slot1 = boost::bind(&GeneralControl::on_tcp_close,   this, _1, _2);
-	const CBSlot& slot2 = boost::bind(&GeneralControl::on_tcp_receive, this, _1, _2);
+	const CBSlotPayload& slot1 = boost::bind(&GeneralControl::on_tcp_close,   this, _1, _2, _3);
+	const CBSlotPayload& slot2 = boost::bind(&GeneralControl::on_tcp_receive, this, _1, _2, _3);
 
 	RegisterMessage(MSG_TCP_CLOSE,   slot1);
 	RegisterMessage(MSG_TCP_RECEIVE, slot2);
 }
 
 // 关闭TCP连接
-void GeneralControl::on_tcp_close(const long connptr, const long peer_type) {
-	TcpCPtr sp = peer_type == PEER_CLIENT ?
-		tcpCliClient_.Pop ((TcpClient*) connptr) : tcpCliDevice_.Pop ((TcpClient*) connptr);
+void GeneralControl::on_tcp_close(MsgPayloadPtr& payload, const long peer_type, const long) {
+	TcpCPtr* conn = MessageData<TcpCPtr>::Get(payload);
+	if (!conn) return;
+	TcpCPtr sp = *conn;
+	tcpConns_.Pop(sp.get());
+	if (peer_type == PEER_CLIENT) {
+		uint64_t dropped, coalesced;
+		sp->GetWriteStat(dropped, coalesced);
+		if (dropped || coalesced) {
+			_gLog.Write(LOG_WARN, "client closed, %llu frames were dropped and %llu were coalesced",
+				(unsigned long long) dropped, (unsigned long long) coalesced);
+		}
+	}
 	// GWAC系统
 	if (peer_type == PEER_MOUNT_GWAC) {// 转台
 		MtxLck lck(mtxObss_);
@@ -82,47 +138,55 @@ void GeneralControl::on_tcp_close(const long connptr, const long peer_type) {
 }
 
 // 接收到TCP信息
-void GeneralControl::on_tcp_receive(const long connptr, const long peer_type) {
+void GeneralControl::on_tcp_receive(MsgPayloadPtr& payload, const long peer_type, const long) {
 	const char term[] = "\n"; // 结束符
 	const int len = strlen(term); // 结束符长度
-	char buff[TCP_PACK_SIZE];
-	int pos, to_read;
-	TcpClient* ptrTcp = (TcpClient*) connptr;
-
-	while (ptrTcp->IsOpen() && (pos = ptrTcp->Lookup(term, len)) >= 0) {
-		if ((to_read = pos + len) > TCP_PACK_SIZE) {// 信息长度超过预设最大值
-			_gLog.Write(LOG_FAULT, "protocol length from %s is over than threshold",
-				peer_type == PEER_CLIENT ? "client" :
-					((peer_type == PEER_CAMERA_GWAC || peer_type == PEER_CAMERA_GFT)? "camera" :
-						(peer_type == PEER_FOCUS ? "focus" : "mount")));
-			ptrTcp->Close();
-		}
-		else {
-			// 读取一条通信协议
-			ptrTcp->Read(buff, pos + len);
-			buff[pos] = '\0';
-			// 解析-->
-			if (peer_type == PEER_MOUNT_GWAC || peer_type == PEER_FOCUS) {// GWAC: 转台/调焦
-				NonKVBasePtr proto = nonkvproto_.Resolve(buff);
-				if (proto.unique()) {
-					if (peer_type == PEER_MOUNT_GWAC) process_protocol_mount_gwac(ptrTcp, proto);
-					else process_protocol_focus(ptrTcp, proto);
-				}
+	TcpCPtr* conn = MessageData<TcpCPtr>::Get(payload);
+	if (!conn) return;
+	const TcpCPtr& ptrTcp = *conn;
+	// 连接已移交观测系统或已关闭: 过时消息不再读出
+	if (!tcpConns_.Find(ptrTcp.get()).use_count()) return;
+	ObssPtr obss;	// 接收连接的观测系统
+	string cid;		// 相机标志
+
+	// 一次处理所有完整信息. 信息以'\0'结尾, 直接解析接收缓冲区
+	auto handler = [&](std::string_view frame) -> bool {
+		const char* buff = frame.data();
+		if (peer_type == PEER_MOUNT_GWAC || peer_type == PEER_FOCUS) {// GWAC: 转台/调焦
+			NonKVBasePtr proto = nonkvproto_.Resolve(buff);
+			if (proto.unique()) {
+				if (peer_type == PEER_MOUNT_GWAC) process_protocol_mount_gwac(ptrTcp, proto);
+				else process_protocol_focus(ptrTcp, proto);
 			}
-			else {// 远程: 客户端或后随望远镜/相机
-				KVBasePtr proto = kvproto_.Resolve(buff);
-				if (!proto.unique()) {
-					_gLog.Write(LOG_FAULT, "undefined protocol from %s: <%s>",
-						peer_type == PEER_CLIENT ? "client" :
-							(peer_type == PEER_CAMERA_GWAC || peer_type == PEER_CAMERA_GFT) ? "camera" : "mount",
-							buff);
-					ptrTcp->Close();
-				}
-				else if (peer_type == PEER_CLIENT)    process_protocol_client(proto);
-				else if (peer_type == PEER_MOUNT_GFT) process_protocol_mount_gft(ptrTcp, proto);
-				else process_protocol_camera(ptrTcp, proto, peer_type);
+		}
+		else {// 远程: 客户端或后随望远镜/相机
+			KVBasePtr proto = kvproto_.Resolve(buff);
+			if (!proto.unique()) {
+				_gLog.Write(LOG_FAULT, "undefined protocol from %s: <%s>",
+					peer_type == PEER_CLIENT ? "client" :
+						(peer_type == PEER_CAMERA_GWAC || peer_type == PEER_CAMERA_GFT) ? "camera" : "mount",
+						buff);
+				ptrTcp->Close();
 			}
+			else if (peer_type == PEER_CLIENT)    process_protocol_client(proto);
+			else if (peer_type == PEER_MOUNT_GFT) obss = process_protocol_mount_gft(proto);
+			else if ((obss = process_protocol_camera(proto, peer_type)).use_count()) cid = proto->cid;
 		}
+		return !obss.use_count() && ptrTcp->IsOpen();
+	};
+
+	if (ptrTcp->IsOpen() && ptrTcp->DrainFrames(term, len, handler) < 0) {// 信息长度超过预设最大值
+		_gLog.Write(LOG_FAULT, "protocol length from %s is over than threshold",
+			peer_type == PEER_CLIENT ? "client" :
+				((peer_type == PEER_CAMERA_GWAC || peer_type == PEER_CAMERA_GFT)? "camera" :
+					(peer_type == PEER_FOCUS ? "focus" : "mount")));
+		ptrTcp->Close();
+	}
+	else if (obss.use_count()) {// 本方不再读出后移交连接, 剩余信息交由观测系统处理
+		tcpConns_.Pop(ptrTcp.get());
+		if (peer_type == PEER_MOUNT_GFT) obss->CoupleMount(ptrTcp);
+		else obss->CoupleCamera(ptrTcp, cid);
+		if (ptrTcp->Lookup()) ptrTcp->NotifyRead();
 	}
 }
 
@@ -154,114 +218,112 @@ bool GeneralControl::start_tcp_server() {
 }
 
 // 网络;服务;接收: 处理收到的连接请求
-void GeneralControl::tcp_accept(TcpClient* cliptr, TcpServer* svrptr, int peer_type) {
-	TcpCPtr client(cliptr);
+void GeneralControl::tcp_accept(const TcpCPtr& client, TcpServer* svrptr, int peer_type) {
 	const TcpClient::CBSlot& slot = boost::bind(&GeneralControl::tcp_receive, this, _1, _2, peer_type);
+	if (peer_type == PEER_CLIENT) {
+		client->SetWriteLimit(param_->clientQueueHigh, param_->clientQueueLow, queue_policy(param_->clientQueuePolicy));
+		client->SetMaxFrame(TCP_PACK_SIZE * 40); // 批量观测计划
+	}
+	if (capture_.use_count()) client->SetCapture(capture_, peer_type);
+	tcpConns_.Push(client, peer_type); // 先登记连接: 处理接收信息时据此确认连接未移交
 	client->RegisterRead(slot);
-	if (peer_type == PEER_CLIENT) tcpCliClient_.Push(client);
-	else tcpCliDevice_.Push(client);
 }
 
 // 网络;接收;回调: 触发消息
 void GeneralControl::tcp_receive(TcpClient* cliptr, boost::system::error_code ec, int peer_type) {
-	PostMessage(!ec ? MSG_TCP_RECEIVE : MSG_TCP_CLOSE, (const long) cliptr, peer_type);
+	// 回调期间连接有效. 消息持有连接, 响应时无需查找
+	PostMessage(!ec ? MSG_TCP_RECEIVE : MSG_TCP_CLOSE,
+		MessageData<TcpCPtr>::Create(cliptr->shared_from_this()), peer_type);
 }
 
 // 网络;响应;客户端: 分类处理
 void GeneralControl::process_protocol_client(KVBasePtr proto) {
 	string gid = proto->gid;
 	string uid = proto->uid;
-	char first = tolower(proto->type[0]); // 协议;指令字首字符,小写: 加速
 
 	MtxLck lck(mtxObss_);
+	if (proto->typeId == KVID_APPBATCH) {
+		dispatch_batch(boost::static_pointer_cast<KVAppBatch>(proto));
+		return;
+	}
+	if (uid.empty() && (proto->typeId == KVID_APPGWAC || proto->typeId == KVID_APPPLAN)) {// 未指定单元
+		dispatch_plan(boost::static_pointer_cast<KVAppPlan>(proto));
+		return;
+	}
 	for (auto it = obssVec_.begin(); it != obssVec_.end(); ++it) {
 		if (!(*it)->IsMatched(gid, uid)) continue;
 
-		if (first == 'a') {
-			if (iequals(proto->type, KVTYPE_APPGWAC)  // 观测计划: GWAC
-				|| iequals(proto->type, KVTYPE_APPPLAN)) {// 观测计划: GFT
-				(*it)->NotifyPlan(proto);
-			}
-			else if (iequals(proto->type, KVTYPE_ABORT)) {// 中断当前操作和过程
-				(*it)->Abort();
-			}
-		}
-		else if (first == 'c') {
-			if (iequals(proto->type, KVTYPE_CHKPLAN)) {// 检查计划状态
-				string plan_sn = (boost::static_pointer_cast<KVCheckPlan>(proto))->plan_sn;
-				KVPlanPtr plan = (*it)->CheckPlan(plan_sn);
-				if (plan.use_count()) {
-					string msg = plan->ToString();
-					tcpCliClient_.Write(msg.c_str(), msg.size());
-					break;
-				}
-			}
-			else if (iequals(proto->type, KVTYPE_CAMSET)) {// 检查/修改相机参数
-			}
-		}
-		else if (first == 'd') {
-			if (iequals(proto->type, KVTYPE_DEROT)) {// 单独设备指令: 消旋器
-			}
-			else if (iequals(proto->type, KVTYPE_DOME)) {// 单独设备指令: 圆顶
-			}
-		}
-		else if (first == 'f') {
-			if (iequals(proto->type, KVTYPE_FOCUS)) {// 调焦
-				(*it)->Focus(boost::static_pointer_cast<KVFocus>(proto));
-			}
-			else if (iequals(proto->type, KVTYPE_FOCUS_SYNC)) {// 调焦清零
-				(*it)->FocusSync(boost::static_pointer_cast<KVFocusSync>(proto));
-			}
-			else if (iequals(proto->type, KVTYPE_FWHM)) {// 自动调焦
-				(*it)->NotifyFWHM(boost::static_pointer_cast<KVFWHM>(proto));
-			}
-			else if (iequals(proto->type, KVTYPE_FILTER)) {// 变更滤光片
-			}
-		}
-		else if (first == 'g') {
-			if (iequals(proto->type, KVTYPE_GUIDE)) {// 导星
-				(*it)->Guide(boost::static_pointer_cast<KVGuide>(proto));
-			}
-			else if (iequals(proto->type, KVTYPE_GEOSITE)) {// 设置或修改测站位置?
-			}
-		}
-		else if (first == 's') {
-			if (iequals(proto->type, KVTYPE_SLEWTO)) {// 转台指向
-				(*it)->Slewto(boost::static_pointer_cast<KVSlewto>(proto));
-			}
-			else if (iequals(proto->type, KVTYPE_SYNC)) {// 转台同步零点
-				(*it)->HomeSync(boost::static_pointer_cast<KVSync>(proto));
-			}
-		}
-		else if (first == 't') {
-			if (iequals(proto->type, KVTYPE_TRACK)) {// 转台转入跟踪模式
-				(*it)->Track();
-			}
-			else if (iequals(proto->type, KVTYPE_TRACKVEL)) {// 设置转台跟踪速度, GWAC
-				(*it)->TrackVel(boost::static_pointer_cast<KVTrackVel>(proto));
-			}
-			else if (iequals(proto->type, KVTYPE_TKIMG)) {// 手动曝光
-				(*it)->TakeImage(boost::static_pointer_cast<KVTakeImage>(proto));
+		switch (proto->typeId) {
+		case KVID_APPGWAC:	// 观测计划: GWAC
+		case KVID_APPPLAN:	// 观测计划: GFT
+			(*it)->NotifyPlan(proto);
+			break;
+		case KVID_ABORT:	// 中断当前操作和过程
+			(*it)->Abort();
+			break;
+		case KVID_CHKPLAN: {// 检查计划状态
+			string plan_sn = (boost::static_pointer_cast<KVCheckPlan>(proto))->plan_sn;
+			KVPlanPtr plan = (*it)->CheckPlan(plan_sn);
+			if (plan.use_count()) {
+				OutBuffer& out = OutBuffer::Local();
+				plan->AppendTo(out);
+				tcpConns_.Write(PEER_CLIENT, out.Data(), out.Size());
+				return;
 			}
+			break;
 		}
-		else if (iequals(proto->type, KVTYPE_RMVPLAN)) {// 中断观测并删除观测计划
+		case KVID_RMVPLAN: {// 中断观测并删除观测计划
 			string plan_sn = (boost::static_pointer_cast<KVRemovePlan>(proto))->plan_sn;
-			if ((*it)->RemovePlan(plan_sn)) break;
+			if ((*it)->RemovePlan(plan_sn)) return;
+			break;
 		}
-		else if (iequals(proto->type, KVTYPE_PARK)) {// 转台复位
+		case KVID_FOCUS:	// 调焦
+			(*it)->Focus(boost::static_pointer_cast<KVFocus>(proto));
+			break;
+		case KVID_FOCUS_SYNC:// 调焦清零
+			(*it)->FocusSync(boost::static_pointer_cast<KVFocusSync>(proto));
+			break;
+		case KVID_FWHM:		// 自动调焦
+			(*it)->NotifyFWHM(boost::static_pointer_cast<KVFWHM>(proto));
+			break;
+		case KVID_GUIDE:	// 导星
+			(*it)->Guide(boost::static_pointer_cast<KVGuide>(proto));
+			break;
+		case KVID_SLEWTO:	// 转台指向
+			(*it)->Slewto(boost::static_pointer_cast<KVSlewto>(proto));
+			break;
+		case KVID_SYNC:		// 转台同步零点
+			(*it)->HomeSync(boost::static_pointer_cast<KVSync>(proto));
+			break;
+		case KVID_TRACK:	// 转台转入跟踪模式
+			(*it)->Track();
+			break;
+		case KVID_TRACKVEL:	// 设置转台跟踪速度, GWAC
+			(*it)->TrackVel(boost::static_pointer_cast<KVTrackVel>(proto));
+			break;
+		case KVID_TKIMG:	// 手动曝光
+			(*it)->TakeImage(boost::static_pointer_cast<KVTakeImage>(proto));
+			break;
+		case KVID_PARK:		// 转台复位
 			(*it)->Park();
-		}
-		else if (iequals(proto->type, KVTYPE_HOME)) {// 转台搜索零点
+			break;
+		case KVID_HOME:		// 转台搜索零点
 			(*it)->FindHome();
-		}
-		else if (iequals(proto->type, KVTYPE_MCOVER)) {// 控制镜盖
+			break;
+		case KVID_CAMSET:	// 检查/修改相机参数
+		case KVID_DEROT:	// 单独设备指令: 消旋器
+		case KVID_DOME:		// 单独设备指令: 圆顶
+		case KVID_FILTER:	// 变更滤光片
+		case KVID_GEOSITE:	// 设置或修改测站位置?
+		case KVID_MCOVER:	// 控制镜盖
+		default:
+			break;
 		}
 	}
 }
 
 // 处理通信协议: 转台
-void GeneralControl::process_protocol_mount_gwac(TcpClient* cliptr, NonKVBasePtr proto) {
-	TcpCPtr sp = tcpCliDevice_.Find(cliptr);
+void GeneralControl::process_protocol_mount_gwac(const TcpCPtr& client, NonKVBasePtr proto) {
 	string gid = proto->gid;
 	int imin = boost::iequals(gid, "001") ? 1 : 5;
 	int imax = imin == 0 ? 4 : 10;
@@ -272,7 +334,7 @@ void GeneralControl::process_protocol_mount_gwac(TcpClient* cliptr, NonKVBasePtr
 		for (int i = imin; i < status->n && i <= imax; ++i) {
 			ObssPtr obss = find_obss(gid, (fmt % i).str());
 			if (obss.use_count()) {
-				obss->CoupleMount(sp);
+				obss->CoupleMount(client);
 				obss->NotifyMountState(status->state[i]);
 			}
 		}
@@ -290,49 +352,41 @@ void GeneralControl::process_protocol_mount_gwac(TcpClient* cliptr, NonKVBasePtr
 }
 
 // 处理通信协议: GFT转台
-void GeneralControl::process_protocol_mount_gft(TcpClient* cliptr, KVBasePtr proto) {
-	if (iequals(proto->type, KVTYPE_MOUNT)) {
-		ObssPtr obss = find_obss(proto->gid, proto->uid, 1);
-		if (obss.use_count()) {
-			TcpCPtr ptrTcp = tcpCliDevice_.Pop(cliptr);
-			obss->CoupleMount(ptrTcp);
-		}
-	}
+ObssPtr GeneralControl::process_protocol_mount_gft(KVBasePtr proto) {
+	if (proto->typeId == KVID_MOUNT) return find_obss(proto->gid, proto->uid, 1);
+	return ObssPtr();
 }
 
 // 处理通信协议: 相机
-void GeneralControl::process_protocol_camera(TcpClient* cliptr, KVBasePtr proto, int peer_type) {
-	if (iequals(proto->type, KVTYPE_CAMERA)) {
-		ObssPtr obss = find_obss(proto->gid, proto->uid, peer_type == PEER_CAMERA_GWAC ? 0 : 1);
-		if (obss.use_count()) {
-			TcpCPtr ptrTcp = tcpCliDevice_.Pop(cliptr);
-			obss->CoupleCamera(ptrTcp, proto->cid);
-		}
-	}
+ObssPtr GeneralControl::process_protocol_camera(KVBasePtr proto, int peer_type) {
+	if (proto->typeId == KVID_CAMERA) return find_obss(proto->gid, proto->uid, peer_type == PEER_CAMERA_GWAC ? 0 : 1);
+	return ObssPtr();
 }
 
 // 处理通信协议: 转台
-void GeneralControl::process_protocol_focus(TcpClient* cliptr, NonKVBasePtr proto) {
-	TcpCPtr sp = tcpCliDevice_.Find(cliptr);
+void GeneralControl::process_protocol_focus(const TcpCPtr& client, NonKVBasePtr proto) {
 	string gid = proto->gid;
 	ObssPtr obss = find_obss(gid, proto->uid);
+	if (!obss.use_count()) return;
 
-	if (obss.use_count()) {
-		if (iequals(proto->type, NONKVTYPE_FOCUS)) {
-			boost::shared_ptr<NonKVFocus> focus = boost::static_pointer_cast<NonKVFocus>(proto);
-			boost::format fmt("%03d");
-			int uid = std::stoi(proto->uid) * 10 + 1;
-			obss->CoupleFocus(sp);
-			for (int i = 0; i < 5; ++i) {
-				obss->NotifyFocus((fmt % (uid + i)).str(), focus->pos[i]);
-			}
+	if (iequals(proto->type, NONKVTYPE_FOCUS)) {
+		boost::shared_ptr<NonKVFocus> focus = boost::static_pointer_cast<NonKVFocus>(proto);
+		boost::format fmt("%03d");
+		int uid;
+		if (parse_number(proto->uid, uid) != NUMERR_OK) {
+			_gLog.Write(LOG_WARN, "focus from <%s:%s>: invalid unit id", gid.c_str(), proto->uid.c_str());
+			return;
 		}
-		else if (iequals(proto->type, NONKVTYPE_RESPONSE)) {
-			boost::shared_ptr<NonKVResponse> rsp = boost::static_pointer_cast<NonKVResponse>(proto);
-			ObssPtr obss = find_obss(gid, proto->uid);
-			obss->NotifyResponse(*rsp);
+		uid = uid * 10 + 1; // 相机标志: 单元标志 * 10 + 序号
+		obss->CoupleFocus(client);
+		for (int i = 0; i < 5; ++i) {
+			obss->NotifyFocus((fmt % (uid + i)).str(), focus->pos[i]);
 		}
 	}
+	else if (iequals(proto->type, NONKVTYPE_RESPONSE)) {
+		boost::shared_ptr<NonKVResponse> rsp = boost::static_pointer_cast<NonKVResponse>(proto);
+		obss->NotifyResponse(*rsp);
+	}
 }
 
 /*!
@@ -358,73 +412,248 @@ ObssPtr GeneralControl::find_obss(const string& gid, const string& uid, int type
 		obss = ObservationSystem::Create(gid, uid);
 		if (!obss->Start(type)) obss.reset();
 		else {
-			const ObservationSystem::PlanCBSlot& slot = boost::bind(&GeneralControl::plan_state, this, _1);
+			const ObservationSystem::PlanCBSlot& slot = boost::bind(&GeneralControl::plan_state, this, _1, _2);
 			obss->RegisterPlanCallback(slot);
 			obssVec_.push_back(obss);
+			std::vector<KVAppPlanPtr> plans;
+			journal_.Restore(gid, uid, plans);
+			if (plans.size()) {
+				_gLog.Write("%d plans of OBSS<%s:%s> are restored from journal", int(plans.size()), gid.c_str(), uid.c_str());
+				obss->NotifyPlan(plans);
+			}
 		}
 	}
 	return obss;
 }
 
+// 调度: 为未指定单元的观测计划选择观测系统
+int GeneralControl::select_obss(const KVAppPlan& plan, const std::vector<int>& extra, double& slew, double& alt) {
+	double dist, cost, cost_min(0.0);
+	int best(-1);
+
+	if ((alt = target_altitude(plan)) < param_->minEle) {
+		_gLog.Write(LOG_WARN, "plan<%s> is rejected for altitude %.1f below %.1f",
+			plan.plan_sn.c_str(), alt, param_->minEle);
+		return -1;
+	}
+	for (int i = 0; i < int(obssVec_.size()); ++i) {
+		const ObssPtr& obss = obssVec_[i];
+		if (!obss->IsMatched(plan.gid, "") || !obss->EvaluatePlan(plan, dist)) continue;
+		int load = obss->PlanLoad() + (extra.empty() ? 0 : extra[i]);
+		cost = load * 360.0 + dist; // 负载优先: 指向距离不超过180度
+		if (best < 0 || cost < cost_min) {
+			best     = i;
+			cost_min = cost;
+			slew     = dist;
+		}
+	}
+	if (best < 0) _gLog.Write(LOG_WARN, "plan<%s> is rejected for no available OBSS", plan.plan_sn.c_str());
+	return best;
+}
+
+// 调度: 拒绝观测计划
+void GeneralControl::reject_plan(const KVAppPlan& plan) {
+	KVPlanPtr state = boost::make_shared<KVPlan>();
+	state->UpdateUTC();
+	state->gid = plan.gid;
+	state->uid = plan.uid;
+	state->plan_sn = plan.plan_sn;
+	state->state = OBSPLAN_ABANDONED;
+	plan_state(state, KVAppPlanPtr());
+}
+
+// 调度: 单个观测计划
+void GeneralControl::dispatch_plan(KVAppPlanPtr plan) {
+	double slew, alt;
+	int i = select_obss(*plan, std::vector<int>(), slew, alt);
+	if (i < 0) {
+		reject_plan(*plan);
+		return;
+	}
+	plan->gid = obssVec_[i]->GetGid();
+	plan->uid = obssVec_[i]->GetUid();
+	_gLog.Write("plan<%s> is dispatched to OBSS<%s:%s>: slew = %.1f, altitude = %.1f",
+		plan->plan_sn.c_str(), plan->gid.c_str(), plan->uid.c_str(), slew, alt);
+	obssVec_[i]->NotifyPlan(plan);
+}
+
+// 调度: 批量观测计划. 按观测系统分组后一次入队
+void GeneralControl::dispatch_batch(KVAppBatchPtr batch) {
+	int n(obssVec_.size()), rejected(0), i;
+	std::vector<int> extra(n, 0);
+	std::vector<std::vector<KVAppPlanPtr> > groups(n);
+	double slew, alt;
+
+	for (auto it = batch->plans.begin(); it != batch->plans.end(); ++it) {
+		KVAppPlanPtr plan = *it;
+		if (plan->uid.empty()) {// 未指定单元
+			if ((i = select_obss(*plan, extra, slew, alt)) >= 0) {
+				plan->gid = obssVec_[i]->GetGid();
+				plan->uid = obssVec_[i]->GetUid();
+			}
+		}
+		else {
+			for (i = 0; i < n && !obssVec_[i]->IsMatched(plan->gid, plan->uid); ++i);
+			if (i == n) {
+				_gLog.Write(LOG_WARN, "plan<%s> is rejected for no OBSS<%s:%s>",
+					plan->plan_sn.c_str(), plan->gid.c_str(), plan->uid.c_str());
+				i = -1;
+			}
+			else if (!obssVec_[i]->AcceptPlan(*plan)) {
+				_gLog.Write(LOG_WARN, "plan<%s> is rejected for type mismatch with OBSS<%s:%s>",
+					plan->plan_sn.c_str(), plan->gid.c_str(), plan->uid.c_str());
+				i = -1;
+			}
+		}
+		if (i < 0) {
+			reject_plan(*plan);
+			++rejected;
+		}
+		else {
+			groups[i].push_back(plan);
+			++extra[i];
+		}
+	}
+	_gLog.Write("batch of %d plans is dispatched, %d rejected", int(batch->plans.size()), rejected);
+	for (i = 0; i < n; ++i) {
+		if (groups[i].size()) obssVec_[i]->NotifyPlan(groups[i]);
+	}
+}
+
+// 调度: 计算目标高度角
+double GeneralControl::target_altitude(const KVAppPlan& plan) {
+	if (iequals(plan.imgtype, "bias") || iequals(plan.imgtype, "dark")) return 90.0;
+	if (plan.typeId != KVID_APPGWAC) {// GWAC只采用赤道坐标
+		if (plan.HorizonCoord()) return plan.ele;
+		if (plan.OrbitCoord()) return 90.0;
+	}
+
+	ptime utc = microsec_clock::universal_time();
+	ptime::date_type day = utc.date();
+	ats_.SetUTC(day.year(), day.month(), day.day(), utc.time_of_day().total_microseconds() * 1E-6 / 86400.0);
+	double azi, alt;
+	ats_.Eq2Horizon(ats_.LocalMeanSiderealTime() - plan.ra * AU_D2R, plan.dec * AU_D2R, azi, alt);
+	return alt * AU_R2D;
+}
+
 // 定时;客户端;上传: 设备状态
 void GeneralControl::cycle_upload_client() {
+	typedef std::pair<TcpBufPtr, size_t> StatusBuf; // 状态信息及其键值
 	boost::chrono::seconds period(2); // 周期2秒
+	std::vector<StatusBuf> status; // 各观测系统状态, 每周期序列化一次
+	OutBuffer out(4096); // 编码缓冲区, 各周期重复使用
+	auto encode = [&out](const KVBase& proto) {
+		out.Clear();
+		proto.AppendTo(out);
+		return boost::make_shared<const string>(out.Data(), out.Size());
+	};
 
 	while (1) {
 		boost::this_thread::sleep_for(period);
-		if (!tcpCliClient_.Size()) continue;
-
-		MtxLck lck(mtxObss_);
-		for (auto it = obssVec_.begin(); it != obssVec_.end(); ++it) {// 遍历观测系统
-			// 状态: 转台
-			string mount = (*it)->GetInfoMount().ToString();
-			tcpCliClient_.Write(mount.c_str(), mount.size());
-			// 状态: 相机/调焦/消旋
-			KVFocus focus;
-			KVDerot derot;
-
-			focus.gid = (*it)->GetInfoMount().gid;
-			focus.uid = (*it)->GetInfoMount().uid;
-			focus.opType = 0;
-
-			derot.gid = (*it)->GetInfoMount().gid;
-			derot.uid = (*it)->GetInfoMount().uid;
-			derot.opType = 0;
-
-			const ObservationSystem::CameraInfoVector& camera = (*it)->GetInfoCamera();
-			for (auto it1 = camera.begin(); it1 != camera.end(); ++it1) {// 遍历相机
-				// 相机
-				string info = (*it1).info.ToString();
-				tcpCliClient_.Write(info.c_str(), info.size());
-				// 调焦
-				if ((*it1).focPos != INT_MAX) {
-					focus.utc    = it1->focUtc;
-					focus.cid    = it1->info.cid;
-					focus.state  = it1->focState;
-					focus.pos    = it1->focPos;
-					focus.posTar = it1->focTar;
-					info = focus.ToString();
-					tcpCliClient_.Write(info.c_str(), info.size());
-				}
-				// 消旋
-				if ((*it1).derotEnabled) {
-					derot.utc   = it1->derotUtc;
-					derot.state = it1->derotState;
-					derot.pos   = it1->derotPos;
-					derot.posTar= it1->derotTar;
-					info = derot.ToString();
-					tcpCliClient_.Write(info.c_str(), info.size());
+		if (!tcpConns_.Size(PEER_CLIENT)) continue;
+
+		status.clear();
+		{
+			MtxLck lck(mtxObss_);
+			for (auto it = obssVec_.begin(); it != obssVec_.end(); ++it) {// 遍历观测系统
+				const string& gid = (*it)->GetInfoMount().gid;
+				const string& uid = (*it)->GetInfoMount().uid;
+				// 状态: 转台
+				status.push_back(StatusBuf(encode((*it)->GetInfoMount()),
+					status_key(KVTYPE_MOUNT, gid, uid)));
+				// 状态: 相机/调焦/消旋
+				KVFocus focus;
+				KVDerot derot;
+
+				focus.gid = gid;
+				focus.uid = uid;
+				focus.opType = 0;
+
+				derot.gid = gid;
+				derot.uid = uid;
+				derot.opType = 0;
+
+				const ObservationSystem::CameraInfoVector& camera = (*it)->GetInfoCamera();
+				for (auto it1 = camera.begin(); it1 != camera.end(); ++it1) {// 遍历相机
+					const string& cid = it1->info.cid;
+					// 相机
+					status.push_back(StatusBuf(encode((*it1).info),
+						status_key(KVTYPE_CAMERA, gid, uid, cid)));
+					// 调焦
+					if ((*it1).focPos != INT_MAX) {
+						focus.utc    = it1->focUtc;
+						focus.cid    = cid;
+						focus.state  = it1->focState;
+						focus.pos    = it1->focPos;
+						focus.posTar = it1->focTar;
+						status.push_back(StatusBuf(encode(focus),
+							status_key(KVTYPE_FOCUS, gid, uid, cid)));
+					}
+					// 消旋
+					if ((*it1).derotEnabled) {
+						derot.utc   = it1->derotUtc;
+						derot.state = it1->derotState;
+						derot.pos   = it1->derotPos;
+						derot.posTar= it1->derotTar;
+						status.push_back(StatusBuf(encode(derot),
+							status_key(KVTYPE_DEROT, gid, uid, cid)));
+					}
 				}
 			}
 		}
+		// 释放观测系统锁后分发: 各客户端只排队共享缓冲区的引用
+		TcpCMap::ConnVecPtr clients = tcpConns_.Snapshot(PEER_CLIENT);
+		for (auto it = clients->begin(); it != clients->end(); ++it) {
+			for (auto it1 = status.begin(); it1 != status.end(); ++it1) (*it)->Write(it1->first, it1->second);
+		}
+	}
+}
+
+// 回调: 计划状态. 记录日志; 编码后合并至待发送状态, 由cycle_upload_plan()发送
+void GeneralControl::plan_state(KVPlanPtr state, KVAppPlanPtr plan) {
+	if (plan) journal_.Catalog(plan);
+	else journal_.Update(*state);
+	if (!tcpConns_.Size(PEER_CLIENT)) return;
+
+	OutBuffer& out = OutBuffer::Local();
+	state->AppendTo(out);
+	string key = state->gid + ":" + state->uid + ":" + to_lower_copy(state->plan_sn);
+	MtxLck lck(mtxPlanState_);
+	PlanStateMap::iterator it = planStates_.find(key);
+	if (it != planStates_.end()) it->second.assign(out.Data(), out.Size());
+	else {
+		planStates_.emplace(key, string(out.Data(), out.Size()));
+		planOrder_.push_back(key);
+		if (planOrder_.size() == 1) cvPlanState_.notify_one();
 	}
 }
 
 // 定时;客户端;上传: 计划状态
-void GeneralControl::plan_state(KVPlanPtr plan) {
-	if (tcpCliClient_.Size()) {
-		string msg = plan->ToString();
-		tcpCliClient_.Write(msg.c_str(), msg.size());
+void GeneralControl::cycle_upload_plan() {
+	boost::chrono::milliseconds period(20); // 合并周期20毫秒
+	boost::chrono::milliseconds drain(1);   // 积压时的发送间隔, 等待发送队列排空
+	const size_t limit = TCP_PACK_SIZE * 20; // 单次发送上限, 小于发送队列高水位
+	bool backlog(false);
+	string buf;
+
+	while (1) {
+		{
+			MtxLck lck(mtxPlanState_);
+			while (planOrder_.empty()) cvPlanState_.wait(lck);
+		}
+		boost::this_thread::sleep_for(backlog ? drain : period);
+		{
+			MtxLck lck(mtxPlanState_);
+			while (!planOrder_.empty() && buf.size() < limit) {
+				PlanStateMap::iterator it = planStates_.find(planOrder_.front());
+				buf += it->second;
+				planStates_.erase(it);
+				planOrder_.pop_front();
+			}
+			backlog = !planOrder_.empty();
+		}
+		tcpConns_.Broadcast(PEER_CLIENT, boost::make_shared<const string>(std::move(buf)));
+		buf.clear();
 	}
 }
 
@@ -1,13 +1,16 @@
 #ifndef GENERALCONTROL_H
 #define GENERALCONTROL_H
 
+#include <deque>
 #include <vector>
+#include <boost/unordered_map.hpp>
 #include "MessageQueue.h"
 #include "Parameter.h"
 #include "AsioTCP.h"
 #include "KVProtocol.h"
 #include "NonKVProtocol.h"
 #include "ObservationSystem.h"
+#include "PlanJournal.h"
 
 class GeneralControl : public MessageQueue
 {
@@ -17,56 +20,120 @@ public:
 
 // 数据类型
 private:
-	struct TcpCVec {
-		boost::mutex mtx;				///< 互斥锁
-		std::vector<TcpCPtr> connBuff;	///< 连接池
+	/*!
+	 * @brief 网络连接注册表
+	 * - 以连接指针为键值分片存储, 各分片独立加锁, 查找和删除为O(1)
+	 * - 按终端类型维护只读连接列表. 增删连接时复制列表并原子替换,
+	 *   广播等遍历操作以原子方式取得列表后不再加锁
+	 */
+	struct TcpCMap {
+		typedef std::vector<TcpCPtr> ConnVec;
+		typedef boost::shared_ptr<const ConnVec> ConnVecPtr;
+
+		struct Entry {
+			TcpCPtr conn;	///< 连接
+			int role;		///< 终端类型
+		};
+
+		struct Shard {
+			boost::mutex mtx;	///< 互斥锁
+			boost::unordered_map<TcpClient*, Entry> conns;	///< 连接
+		};
+
+		enum {
+			SHARD_COUNT = 16	///< 分片数量
+		};
+
+		Shard shards[SHARD_COUNT];	///< 连接分片
+		boost::mutex mtxRole;		///< 互斥锁: 更新终端类型列表
+		std::vector<ConnVecPtr> roles;	///< 终端类型列表. 以atomic_load/atomic_store访问
 
 	public:
-		size_t Size() { return connBuff.size(); }
+		TcpCMap(int nrole)
+			: roles(nrole, boost::make_shared<const ConnVec>()) {
+		}
+
+		Shard& GetShard(TcpClient* client) {
+			return shards[(size_t(client) >> 4) % SHARD_COUNT]; // 低位因对齐恒为0
+		}
+
+		ConnVecPtr Snapshot(int role) {
+			return boost::atomic_load(&roles[role]);
+		}
+
+		size_t Size(int role) {
+			return Snapshot(role)->size();
+		}
+
 		void Reset() {
-			MtxLck lck(mtx);
-			connBuff.clear();
+			for (int i = 0; i < SHARD_COUNT; ++i) {
+				MtxLck lck(shards[i].mtx);
+				for (auto it = shards[i].conns.begin(); it != shards[i].conns.end(); ++it) it->second.conn->Close();
+				shards[i].conns.clear();
+			}
+			MtxLck lck(mtxRole);
+			for (auto it = roles.begin(); it != roles.end(); ++it) boost::atomic_store(&*it, boost::make_shared<const ConnVec>());
 		}
 
-		void Push(TcpCPtr conn) {
-			MtxLck lck(mtx);
-			connBuff.push_back(conn);
+		void Push(const TcpCPtr& conn, int role) {
+			Shard& shard = GetShard(conn.get());
+			{
+				MtxLck lck(shard.mtx);
+				Entry& entry = shard.conns[conn.get()];
+				entry.conn = conn;
+				entry.role = role;
+			}
+			MtxLck lck(mtxRole);
+			boost::shared_ptr<ConnVec> vec = boost::make_shared<ConnVec>(*roles[role]);
+			vec->push_back(conn);
+			boost::atomic_store(&roles[role], ConnVecPtr(vec));
 		}
 
 		TcpCPtr Pop(TcpClient* client) {
-			TcpCPtr ptr;
-			MtxLck lck(mtx);
-			for (auto it = connBuff.begin(); it != connBuff.end(); ++it) {
-				if ((*it).get() == client) {
-					ptr = *it;
-					connBuff.erase(it);
-					break;
-				}
+			Entry entry;
+			Shard& shard = GetShard(client);
+			{
+				MtxLck lck(shard.mtx);
+				auto it = shard.conns.find(client);
+				if (it == shard.conns.end()) return TcpCPtr();
+				entry = it->second;
+				shard.conns.erase(it);
+			}
+			MtxLck lck(mtxRole);
+			boost::shared_ptr<ConnVec> vec = boost::make_shared<ConnVec>();
+			vec->reserve(roles[entry.role]->size());
+			for (auto it = roles[entry.role]->begin(); it != roles[entry.role]->end(); ++it) {
+				if (*it != entry.conn) vec->push_back(*it);
 			}
-			return ptr;
+			boost::atomic_store(&roles[entry.role], ConnVecPtr(vec));
+			return entry.conn;
 		}
 
 		TcpCPtr Find(TcpClient* client) {
-			MtxLck lck(mtx);
-			TcpCPtr ptr;
-			for (auto it = connBuff.begin(); it != connBuff.end(); ++it) {
-				if ((*it).get() == client) {
-					ptr = *it;
-					break;
-				}
-			}
-			return ptr;
+			Shard& shard = GetShard(client);
+			MtxLck lck(shard.mtx);
+			auto it = shard.conns.find(client);
+			return it != shard.conns.end() ? it->second.conn : TcpCPtr();
 		}
 
-		void Write(const char* data, int len) {
-			MtxLck lck(mtx);
-			for (auto it = connBuff.begin(); it != connBuff.end(); ++it) {
-				(*it)->Write(data, len);
-			}
+		void Write(int role, const char* data, int len) {
+			if (len > 0) Broadcast(role, boost::make_shared<const std::string>(data, len));
+		}
+
+		/*!
+		 * @brief 向指定类型的所有连接发送同一共享缓冲区
+		 * @param role 终端类型
+		 * @param buf  待发送数据
+		 * @param key  状态信息键值. 0: 不可丢弃或合并
+		 */
+		void Broadcast(int role, const TcpBufPtr& buf, size_t key = 0) {
+			ConnVecPtr conns = Snapshot(role);
+			for (auto it = conns->begin(); it != conns->end(); ++it) (*it)->Write(buf, key);
 		}
 	};
 
 	typedef std::vector<ObssPtr> ObssVec;
+	typedef boost::unordered_map<string, string> PlanStateMap;
 
 // 成员变量
 private:
@@ -78,18 +145,26 @@ private:
 	TcpSPtr tcpSvrMountGFT_;	///< TCP服务: 转台, GFT
 	TcpSPtr tcpSvrCameraGFT_;	///< TCP服务: 相机, GFT
 
-	TcpCVec tcpCliClient_;	///< TCP客户: 客户端
-	TcpCVec tcpCliDevice_;	///< TCP客户: 设备
+	TcpCMap tcpConns_;		///< TCP客户: 客户端及设备, 以终端类型区分
+	ProtoCapPtr capture_;	///< 接收数据捕获. 空: 不捕获
 
 	KVProtocol kvproto_;		///< 解析通信协议: 指令+键值对
 	NonKVProtocol nonkvproto_;	///< 解析通信协议: 转台
 
 	boost::mutex mtxObss_;	///< 互斥锁: 观测系统集合
 	ObssVec obssVec_;	///< 观测系统集合
+	AstroUtil::ATimeSpace ats_;	///< 天文时空计算: 调度观测计划
 
 	Thread thrdCycleUpdClient_;	///< 定时向客户端上传系统工作状态
 	Thread thrdDumpObss_;	///< 线程: 定时检查观测系统有效性
 
+	boost::mutex mtxPlanState_;	///< 互斥锁: 待发送计划状态
+	boost::condition_variable cvPlanState_;	///< 事件: 新的待发送计划状态
+	PlanStateMap planStates_;		///< 待发送计划状态: gid:uid:plan_sn-编码后信息. 同一计划只保留最新状态
+	std::deque<string> planOrder_;	///< 待发送计划状态的键值, 按首次变更排序
+	Thread thrdCycleUpdPlan_;	///< 线程: 定时向客户端合并发送计划状态
+	PlanJournal journal_;	///< 观测计划日志
+
 public:
 	// 启动服务
 	bool Start();
@@ -105,10 +180,10 @@ private:
 	};
 	// 注册消息响应函数
 	void register_messages();
-	// 关闭TCP连接
-	void on_tcp_close(const long connptr, const long peer_type);
-	// 接收到TCP信息
-	void on_tcp_receive(const long connptr, const long peer_type);
+	// 关闭TCP连接. 载荷: TcpCPtr
+	void on_tcp_close(MsgPayloadPtr& payload, const long peer_type, const long);
+	// 接收到TCP信息. 载荷: TcpCPtr
+	void on_tcp_receive(MsgPayloadPtr& payload, const long peer_type, const long);
 
 // 功能: 网络通信
 private:
@@ -126,20 +201,20 @@ private:
 	 */
 	bool start_tcp_server();
 	// 收到连接请求
-	void tcp_accept(TcpClient* cliptr, TcpServer* svrptr, int peer_type);
+	void tcp_accept(const TcpCPtr& client, TcpServer* svrptr, int peer_type);
 	// 收到网络信息
 	void tcp_receive(TcpClient* cliptr, boost::system::error_code ec, int peer_type);
 
 	// 处理通信协议: 客户端
 	void process_protocol_client(KVBasePtr proto);
 	// 处理通信协议: 转台, GWAC
-	void process_protocol_mount_gwac(TcpClient* cliptr, NonKVBasePtr proto);
-	// 处理通信协议: 转台, GFT
-	void process_protocol_mount_gft(TcpClient* cliptr, KVBasePtr proto);
-	// 处理通信协议: 相机
-	void process_protocol_camera(TcpClient* cliptr, KVBasePtr proto, int peer_type);
+	void process_protocol_mount_gwac(const TcpCPtr& client, NonKVBasePtr proto);
+	// 处理通信协议: 转台, GFT. 返回值: 接收连接的观测系统. 空: 不移交
+	ObssPtr process_protocol_mount_gft(KVBasePtr proto);
+	// 处理通信协议: 相机. 返回值: 接收连接的观测系统. 空: 不移交
+	ObssPtr process_protocol_camera(KVBasePtr proto, int peer_type);
 	// 处理通信协议: 调焦
-	void process_protocol_focus(TcpClient* cliptr, NonKVBasePtr proto);
+	void process_protocol_focus(const TcpCPtr& client, NonKVBasePtr proto);
 
 private:
 	/*!
@@ -150,16 +225,57 @@ private:
 	 * @return
 	 * 匹配的观测系统访问接口
 	 * @note
-	 * 若观测系统不存在, 则先创建该系统
+	 * 若观测系统不存在, 则先创建该系统, 并恢复计划日志中该系统的未结束计划
 	 */
 	ObssPtr find_obss(const string& gid, const string& uid, int type = 0);
+	/*!
+	 * @brief 为未指定单元的观测计划选择观测系统
+	 * @param plan   观测计划
+	 * @param extra  各观测系统本批次已分配的计划数量, 与obssVec_对应. 空: 无
+	 * @param slew   指向距离, 角度
+	 * @param alt    目标高度角, 角度
+	 * @return
+	 * 观测系统在obssVec_中的索引. -1: 无可用系统
+	 * @note
+	 * - 目标高度角低于最低高度角时拒绝计划
+	 * - 在转台和相机联机的观测系统中, 优先选择负载最低的系统, 其次选择指向距离最短的系统
+	 * - 调用前须锁定mtxObss_
+	 */
+	int select_obss(const KVAppPlan& plan, const std::vector<int>& extra, double& slew, double& alt);
+	/*!
+	 * @brief 通知客户端观测计划被拒绝
+	 */
+	void reject_plan(const KVAppPlan& plan);
+	/*!
+	 * @brief 调度未指定单元的观测计划
+	 * @note 调用前须锁定mtxObss_
+	 */
+	void dispatch_plan(KVAppPlanPtr plan);
+	/*!
+	 * @brief 调度批量观测计划. 已指定单元的计划直接分配
+	 * @note 调用前须锁定mtxObss_
+	 */
+	void dispatch_batch(KVAppBatchPtr batch);
+	/*!
+	 * @brief 计算观测计划的当前目标高度角
+	 * @return
+	 * 高度角, 角度. 无需指向或坐标无法计算时返回90
+	 */
+	double target_altitude(const KVAppPlan& plan);
 
 private:
 	/**
-	 * @brief 回调函数: 向客户端发送观测计划状态
-	 * @param plan  观测计划状态
+	 * @brief 回调函数: 记录观测计划日志, 合并观测计划状态, 等待发送
+	 * @param state  观测计划状态
+	 * @param plan   观测计划. 仅在计划入库时有效
+	 */
+	void plan_state(KVPlanPtr state, KVAppPlanPtr plan);
+	/**
+	 * @brief 线程: 定时向客户端发送变更的观测计划状态
+	 * @note
+	 * 同一合并周期内同一计划只发送最新状态
 	 */
-	void plan_state(KVPlanPtr plan);
+	void cycle_upload_plan();
 	/**
 	 * @brief 线程: 定时向客户端上传系统工作状态
 	 */
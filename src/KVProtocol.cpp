@@ -1,715 +1,335 @@
 
 #include <ctype.h>
 #include <math.h>
-#include <vector>
+#include <string.h>
 #include <boost/smart_ptr/make_shared.hpp>
 #include <boost/algorithm/string.hpp>
 #include <typeinfo>
 #include "KVProtocol.h"
+#include "ProtoPool.h"
 #include "GLog.h"
 
 using namespace boost;
 using namespace boost::algorithm;
 
-typedef std::vector<string> vecstr;    ///< 字符串列表
+/**
+ * @brief 去除首尾空白, 构建视图
+ */
+static std::string_view make_view(const char* first, const char* last) {
+    while (first < last && isspace((unsigned char) *first)) ++first;
+    while (last > first && isspace((unsigned char) last[-1])) --last;
+    return std::string_view(first, last - first);
+}
 
 KVProtocol::KVProtocol() {
+    badFrames_ = 0;
 }
 
 KVProtocol::~KVProtocol() {
 }
 
+/*
+ * 散列命中后再比较一次名称: 散列在已知类型间无冲突(case不重复),
+ * 比较只用于拒绝与已知类型散列相同的未知类型
+ */
+#define KVTYPE_CASE(name) \
+    case kv_hash(KVTYPE_##name): return iequals(type, KVTYPE_##name) ? KVID_##name : KVID_UNKNOWN;
+
+KVTypeId KVProtocol::TypeId(std::string_view type) {
+    switch (kv_hash(type)) {
+    KVTYPE_CASE(APPGWAC)
+    KVTYPE_CASE(APPPLAN)
+    KVTYPE_CASE(APPBATCH)
+    KVTYPE_CASE(CHKPLAN)
+    KVTYPE_CASE(RMVPLAN)
+    KVTYPE_CASE(PLAN)
+    KVTYPE_CASE(ABORT)
+    KVTYPE_CASE(OBSS)
+    KVTYPE_CASE(SLEWTO)
+    KVTYPE_CASE(PARK)
+    KVTYPE_CASE(GUIDE)
+    KVTYPE_CASE(HOME)
+    KVTYPE_CASE(SYNC)
+    KVTYPE_CASE(TRACK)
+    KVTYPE_CASE(TRACKVEL)
+    KVTYPE_CASE(MOUNT)
+    KVTYPE_CASE(TKIMG)
+    KVTYPE_CASE(EXPOSE)
+    KVTYPE_CASE(CAMSET)
+    KVTYPE_CASE(CAMERA)
+    KVTYPE_CASE(FOCUS)
+    KVTYPE_CASE(FOCUS_SYNC)
+    KVTYPE_CASE(FWHM)
+    KVTYPE_CASE(DEROT)
+    KVTYPE_CASE(DOME)
+    KVTYPE_CASE(MCOVER)
+    KVTYPE_CASE(FILTER)
+    KVTYPE_CASE(GEOSITE)
+    default: return KVID_UNKNOWN;
+    }
+}
+
+#undef KVTYPE_CASE
+
 KVBasePtr KVProtocol::Resolve(const char* rcvd) {
     const char* ptr = rcvd;
-    string type;
-    char ch;
+    const char* head;
 
     // 解析操作符
 	while (*ptr && *ptr == ' ') ++ptr; // 容错
-    ch = tolower(*ptr);
-	for (; *ptr && *ptr != ' '; ++ptr) type += *ptr;
+	for (head = ptr; *ptr && *ptr != ' '; ++ptr);
+    std::string_view type(head, ptr - head);
 	while (*ptr && *ptr == ' ') ++ptr; // 分隔符' '; 容错
-    // 解析键值对
-    KVBase basis;
-    KVVec kvs;
-    if (*ptr) resolve_kv(ptr, kvs, basis);
+    KVTypeId id = TypeId(type);
+    if (id == KVID_APPBATCH) return resolve_append_batch(ptr); // 各计划分别分词
+    // 解析键值对: 视图指向rcvd, 此前不申请堆内存
+    KVTokens kvs;
+    if (*ptr) tokenize(ptr, kvs);
     // 分类型赋值
     KVBasePtr proto;
-    if (ch == 'a') {
-        if      (iequals(type, KVTYPE_APPPLAN)) proto = resolve_append_plan(kvs);
-        if      (iequals(type, KVTYPE_APPGWAC)) proto = resolve_append_gwac(kvs);
-        else if (iequals(type, KVTYPE_ABORT))   proto = resolve_abort(kvs);
-    }
-    else if (ch == 'c') {
-        if      (iequals(type, KVTYPE_CHKPLAN)) proto = resolve_check_plan(kvs);
-        else if (iequals(type, KVTYPE_CAMERA))  proto = resolve_camera(kvs);
-        else if (iequals(type, KVTYPE_CAMSET))  proto = resolve_camset(kvs);
-    }
-    else if (ch == 'd') {
-        if      (iequals(type, KVTYPE_DEROT)) proto = resolve_derot(kvs);
-        else if (iequals(type, KVTYPE_DOME))  proto = resolve_dome(kvs);
+    switch (id) {
+    case KVID_APPGWAC:    proto = resolve_append_gwac(kvs);       break;
+    case KVID_APPPLAN:    proto = resolve_append_plan(kvs);       break;
+    case KVID_CHKPLAN:    proto = resolve<KVCheckPlan>(kvs);      break;
+    case KVID_RMVPLAN:    proto = resolve<KVRemovePlan>(kvs);     break;
+    case KVID_PLAN:       proto = resolve<KVPlan>(kvs);           break;
+    case KVID_ABORT:      proto = resolve<KVAbort>(kvs);          break;
+    case KVID_OBSS:       proto = resolve<KVOBSS>(kvs);           break;
+    case KVID_SLEWTO:     proto = resolve_slewto(kvs);            break;
+    case KVID_PARK:       proto = resolve<KVPark>(kvs);           break;
+    case KVID_GUIDE:      proto = resolve<KVGuide>(kvs);          break;
+    case KVID_HOME:       proto = resolve<KVHome>(kvs);           break;
+    case KVID_SYNC:       proto = resolve_sync(kvs);              break;
+    case KVID_TRACK:      proto = resolve<KVTrack>(kvs);          break;
+    case KVID_TRACKVEL:   proto = resolve<KVTrackVel>(kvs);       break;
+    case KVID_MOUNT:      proto = resolve<KVMount>(kvs);          break;
+    case KVID_TKIMG:      proto = resolve_take_image(kvs);        break;
+    case KVID_EXPOSE:     proto = resolve<KVExpose>(kvs);         break;
+    case KVID_CAMSET:     proto = resolve<KVCamSet>(kvs);         break;
+    case KVID_CAMERA:     proto = resolve<KVCamera>(kvs);         break;
+    case KVID_FOCUS:      proto = resolve<KVFocus>(kvs);          break;
+    case KVID_FOCUS_SYNC: proto = resolve<KVFocusSync>(kvs);      break;
+    case KVID_FWHM:       proto = resolve<KVFWHM>(kvs);           break;
+    case KVID_DEROT:      proto = resolve<KVDerot>(kvs);          break;
+    case KVID_DOME:       proto = resolve<KVDome>(kvs);           break;
+    case KVID_MCOVER:     proto = resolve<KVMirrCover>(kvs);      break;
+    case KVID_FILTER:     proto = resolve<KVFilter>(kvs);         break;
+    case KVID_GEOSITE:    proto = resolve<KVGeoSite>(kvs);        break;
+    default:
+        ++badFrames_;
+        _gLog.Write(LOG_FAULT, "%s:%s: %s", typeid(this).name(), __FUNCTION__, rcvd);
+        break;
+    }
+
+    if (proto.unique()) {
+        proto->utc = kvs.utc;
+        proto->gid = kvs.gid;
+        proto->uid = kvs.uid;
+        proto->cid = kvs.cid;
     }
-    else if (ch == 'f') {
-        if      (iequals(type, KVTYPE_FOCUS))       proto = resolve_focus(kvs);
-        else if (iequals(type, KVTYPE_FOCUS_SYNC))  proto = resolve_focus_sync(kvs);
-        else if (iequals(type, KVTYPE_FWHM))  proto = resolve_fwhm(kvs);
-        else if (iequals(type, KVTYPE_FILTER))proto = resolve_filter(kvs);
-    }
-    else if (ch == 'm') {
-        if      (iequals(type, KVTYPE_MOUNT))  proto = resolve_mount(kvs);
-        else if (iequals(type, KVTYPE_MCOVER)) proto = resolve_mcover(kvs);
-    }
-    else if (ch == 'p') {
-        if      (iequals(type, KVTYPE_PLAN)) proto = resolve_plan(kvs);
-        else if (iequals(type, KVTYPE_PARK)) proto = resolve_park(kvs);
-    }
-    else if (ch == 's') {
-        if      (iequals(type, KVTYPE_SLEWTO)) proto = resolve_slewto(kvs);
-        else if (iequals(type, KVTYPE_SYNC))   proto = resolve_sync(kvs);
-    }
-	else if (ch == 't') {
-	    if      (iequals(type, KVTYPE_TKIMG))     proto = resolve_take_image(kvs);
-	    else if (iequals(type, KVTYPE_TRACK))     proto = resolve_track(kvs);
-	    else if (iequals(type, KVTYPE_TRACKVEL))  proto = resolve_trackvel(kvs);
-	}
-    else if (iequals(type, KVTYPE_EXPOSE))  proto = resolve_expose(kvs);
-    else if (iequals(type, KVTYPE_GUIDE))   proto = resolve_guide(kvs);
-    else if (iequals(type, KVTYPE_HOME))    proto = resolve_home(kvs);
-    else if (iequals(type, KVTYPE_OBSS))    proto = resolve_obss(kvs);
-    else if (iequals(type, KVTYPE_RMVPLAN)) proto = resolve_remove_plan(kvs);
-
-    if (proto.unique()) *proto = basis;
-    else _gLog.Write(LOG_FAULT, "%s:%s: %s", typeid(this).name(), __FUNCTION__, rcvd);
 
     return proto;
 }
 
+uint64_t KVProtocol::BadFrames() const {
+    return badFrames_;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // 功能
 /**
- * @brief 以=为分隔符, 解析关键字和键值
- * @param kv       keyword=value格式字符串
- * @param keyword  关键字
- * @param value    键值
- * @return keyword和value有效标志
+ * @brief 记录并丢弃数值字段无效的协议
  */
-bool KVProtocol::resolve_kv(const string& kv, string& keyword, string& value) {
-    char seps[] = "=";
-    vecstr tokens;
-
-    split(tokens, kv, is_any_of(seps), token_compress_on);
-    if (tokens.size() != 2) return false;
-    keyword = tokens[0]; trim(keyword);
-    value   = tokens[1]; trim(value);
-    return !(keyword.empty() || value.empty());
+KVBasePtr KVProtocol::bad_frame(const string& type, const NumFieldStatus& num) {
+    ++badFrames_;
+    _gLog.Write(LOG_WARN, "[%s]: %.*s=%.*s, %s", type.c_str(),
+        int(num.key.size()), num.key.data(),
+        int(num.value.size()), num.value.data(),
+        num_error_desc(num.code));
+    return KVBasePtr();
 }
 
 /**
- * @brief 解析键值对集合
- * @param str    键值对集合字符串, key1=val1,[key2=val2,...]
- * @param kvs    解析后键值对集合
- * @param basis  临时存储基础信息
+ * @brief 登记一个键值对. 关键字和键值去除首尾空白后均不可为空
+ * @param key  关键字起始地址
+ * @param eq   第一个'='的地址
+ * @param end  键值对结束地址, 即','或'\0'的地址
+ * @param kvs  键值对集合
  */
-void KVProtocol::resolve_kv(const char* str, KVVec& kvs, KVBase& basis) {
-    char seps[] = ",";
-    vecstr tokens;
-    string keyword, value;
-
-    split(tokens, str, is_any_of(seps), token_compress_on);
-    for(vecstr::iterator it = tokens.begin(); it != tokens.end(); ++it) {
-        if (!resolve_kv(*it, keyword, value)) continue;
-        if      (iequals(keyword, "utc")) basis.utc = value;
-        else if (iequals(keyword, "gid")) basis.gid = value;
-        else if (iequals(keyword, "uid")) basis.uid = value;
-        else if (iequals(keyword, "cid")) basis.cid = value;
-        else kvs.push_back(KeyValPair(keyword, value));
+void KVProtocol::append_kv(const char* key, const char* eq, const char* end, KVTokens& kvs) {
+    const char* val = eq + 1;
+    while (val < end && *val == '=') ++val; // 连续'='视为一个分隔符
+    std::string_view keyword = make_view(key, eq);
+    std::string_view value   = make_view(val, end);
+    if (keyword.empty() || value.empty()) return;
+
+    uint64_t hash = kv_hash(keyword);
+    switch (hash) {
+    case kv_hash("utc"): kvs.utc = value; break;
+    case kv_hash("gid"): kvs.gid = value; break;
+    case kv_hash("uid"): kvs.uid = value; break;
+    case kv_hash("cid"): kvs.cid = value; break;
+    default:
+        if (kvs.n < KVTokens::MAX_PAIRS) {
+            kvs.kvs[kvs.n].keyword = keyword;
+            kvs.kvs[kvs.n].value   = value;
+            kvs.kvs[kvs.n].hash    = hash;
+            ++kvs.n;
+        }
+        break;
     }
 }
 
-//////////////////////////////////////////////////////////////////////////////
-// 功能: 按协议类型创建对应实例指针
 /**
- * @brief 追加观测计划
+ * @brief 单次扫描解析键值对集合, 只生成指向str的视图
+ * @param str    键值对集合字符串, key1=val1,[key2=val2,...]
+ * @param kvs    解析后键值对集合
+ * @param sep    记录分隔符
+ * @note
+ * 与原基于split的实现一致: 空的键值对被跳过; 值中再次出现'='的键值对无效
  */
-KVBasePtr KVProtocol::resolve_append_plan(const KVVec& kvs) {
-    KVAppPlanPtr proto(new KVAppPlan);
-    KVVec& kvsProto = proto->kvs;
-
-    proto->coorsys = COORSYS_EQUA;
-    proto->epoch   = 2000.0;
-    try {
-        for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-            if      (iequals(it->keyword, "plan_sn"))  proto->plan_sn = it->value;
-            else if (iequals(it->keyword, "objid"))    proto->objid   = it->value;
-            else if (iequals(it->keyword, "obstype"))  proto->obstype = it->value;
-            else if (iequals(it->keyword, "coor_sys")) proto->coorsys = std::stoi(it->value);
-            else if (iequals(it->keyword, "ra"))       proto->ra      = std::stod(it->value);
-            else if (iequals(it->keyword, "dec"))      proto->dec     = std::stod(it->value);
-            else if (iequals(it->keyword, "ecoch"))    proto->epoch   = std::stod(it->value);
-            else if (iequals(it->keyword, "azi"))      proto->azi     = std::stod(it->value);
-            else if (iequals(it->keyword, "ele"))      proto->ele     = std::stod(it->value);
-            else if (iequals(it->keyword, "tle1"))     proto->tle1    = it->value;
-            else if (iequals(it->keyword, "tle2"))     proto->tle2    = it->value;
-            else if (iequals(it->keyword, "imgtype"))  proto->imgtype = it->value;
-            else if (iequals(it->keyword, "filter"))   proto->filter  = it->value;
-            else if (iequals(it->keyword, "exptime"))  proto->exptime = std::stod(it->value);
-            else if (iequals(it->keyword, "delay"))    proto->delay   = std::stod(it->value);
-            else if (iequals(it->keyword, "frmcnt"))   proto->frmcnt  = std::stoi(it->value);
-            else if (iequals(it->keyword, "loopcnt"))  proto->loopcnt = std::stoi(it->value);
-            else if (iequals(it->keyword, "priority")) proto->priority= std::stoi(it->value);
-            else if (iequals(it->keyword, "plan_beg")) proto->plan_begin= it->value;
-            else if (iequals(it->keyword, "plan_end")) proto->plan_end  = it->value;
-            else kvsProto.push_back(*it);
+const char* KVProtocol::tokenize(const char* str, KVTokens& kvs, char sep) {
+    const char* key = str;  // 当前键值对起始地址
+    const char* eq = NULL;  // 当前键值对中第一个'='
+    bool valid(true);
+
+    for (const char* ptr = str; ; ++ptr) {
+        char c = *ptr;
+        if (c == '=') {
+            if (!eq) eq = ptr;
+            else if (ptr[-1] != '=') valid = false;
+        }
+        else if (c == ',' || !c || c == sep) {
+            if (eq && valid) append_kv(key, eq, ptr, kvs);
+            if (!c || c == sep) return ptr;
+            key = ptr + 1;
+            eq = NULL;
+            valid = true;
         }
-
-        // 修订缺省项
-        if (proto->imgtype.empty()) proto->imgtype = fabs(proto->exptime) < 1E-3 ? "BIAS" : "OBJECT";
-        if (proto->objid.empty())   proto->objid   = iequals(proto->imgtype, "BIAS") ? "bias"
-            : (iequals(proto->imgtype, "DARK") ? "dark"
-                : (iequals(proto->imgtype, "FLAT") ? "flat"
-                    : (iequals(proto->imgtype, "FOCUS") ? "focs" : "objt")));
-    }
-    catch(std::invalid_argument& ex1) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex1.what());
-    }
-    catch(std::out_of_range& ex2) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex2.what());
     }
-
-    return to_kvbase(proto);
-}
-
-/**
- * @brief 追加观测计划: GWAC
- */
-KVBasePtr KVProtocol::resolve_append_gwac(const KVVec& kvs) {
-    KVBasePtr proto = resolve_append_plan(kvs);
-	if (proto.unique()) proto->type = KVTYPE_APPGWAC;
-	return proto;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// 功能: 按协议类型创建对应实例指针
 /**
- * @brief 检查观测计划状态
+ * @brief 按字段表解析键值对
+ * @param kvs    键值对集合
+ * @param proto  协议实例
+ * @param num    数值字段解析状态
+ * @param extra  未登记的键值对. NULL: 忽略
  */
-KVBasePtr KVProtocol::resolve_check_plan(const KVVec& kvs) {
-    KVChkPlanPtr proto = boost::make_shared<KVCheckPlan>();
-
-    for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-        if (iequals(it->keyword, "plan_sn")) proto->plan_sn = it->value;
+template <class T> static void decode_fields(const KVTokens& kvs, T& proto, NumFieldStatus& num, KVVec* extra = NULL) {
+    const auto& table = T::Fields();
+    for (KVTokens::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
+        auto field = table.Find(it->hash);
+        if (field) field->Decode(proto, it->keyword, it->value, num);
+        else if (extra) extra->push_back(KeyValPair(string(it->keyword), string(it->value)));
     }
-    return to_kvbase(proto);
 }
 
 /**
- * @brief 删除观测计划
+ * @brief 按字段表创建协议实例. 实例取自对象池
  */
-KVBasePtr KVProtocol::resolve_remove_plan(const KVVec& kvs) {
-    KVRmvPlanPtr proto = boost::make_shared<KVRemovePlan>();
-
-    for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-        if (iequals(it->keyword, "plan_sn")) proto->plan_sn = it->value;
-    }
+template <class T> KVBasePtr KVProtocol::resolve(const KVTokens& kvs) {
+    boost::shared_ptr<T> proto = ProtoPool<T>::Acquire();
+    NumFieldStatus num;
+    decode_fields(kvs, *proto, num);
+    if (num.Failed()) return bad_frame(proto->type, num);
     return to_kvbase(proto);
 }
 
 /**
- * @brief 观测计划实时
+ * @brief 追加观测计划
  */
-KVBasePtr KVProtocol::resolve_plan(const KVVec& kvs) {
-    KVPlanPtr proto = boost::make_shared<KVPlan>();
-
-    try {
-        for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-            if      (iequals(it->keyword, "state"))    proto->state    = std::stoi(it->value);
-            else if (iequals(it->keyword, "plan_sn"))  proto->plan_sn  = it->value;
-            else if (iequals(it->keyword, "tm_start")) proto->tm_start = it->value;
-            else if (iequals(it->keyword, "tm_stop"))  proto->tm_stop  = it->value;
-        }
-    }
-    catch(std::invalid_argument& ex1) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex1.what());
-    }
-    catch(std::out_of_range& ex2) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex2.what());
-    }
-    return to_kvbase(proto);
-}
+KVBasePtr KVProtocol::resolve_append_plan(const KVTokens& kvs) {
+    KVAppPlanPtr proto = boost::make_shared<KVAppPlan>();
+    NumFieldStatus num;
 
-/**
- * @brief 中断当前任务
- */
-KVBasePtr KVProtocol::resolve_abort(const KVVec& kvs) {
-    KVAbtPtr proto = boost::make_shared<KVAbort>();
-    return to_kvbase(proto);
-}
+    proto->coorsys = 0; // 计划缺省为赤经赤纬. 计划的坐标系编号与COORSYS_*不同
+    proto->epoch   = 2000.0;
+    decode_fields(kvs, *proto, num, &proto->kvs);
+    if (num.Failed()) return bad_frame(proto->type, num);
 
-/**
- * @brief 观测系统实时工作状态
- */
-KVBasePtr KVProtocol::resolve_obss(const KVVec& kvs) {
-    KVObssPtr proto = boost::make_shared<KVOBSS>();
-    try {
-        for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-            if      (iequals(it->keyword, "state"))  proto->state  = std::stoi(it->value);
-            else if (iequals(it->keyword, "mount"))  proto->mount  = std::stoi(it->value);
-            else if (iequals(it->keyword, "camera")) proto->camera = std::stoi(it->value);
-        }
-    }
-    catch(std::invalid_argument& ex1) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex1.what());
-    }
-    catch(std::out_of_range& ex2) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex2.what());
-    }
-    return to_kvbase(proto);
-}
+    // 修订缺省项
+    if (proto->imgtype.empty()) proto->imgtype = fabs(proto->exptime) < 1E-3 ? "BIAS" : "OBJECT";
+    if (proto->objid.empty())   proto->objid   = iequals(proto->imgtype, "BIAS") ? "bias"
+        : (iequals(proto->imgtype, "DARK") ? "dark"
+            : (iequals(proto->imgtype, "FLAT") ? "flat"
+                : (iequals(proto->imgtype, "FOCUS") ? "focs" : "objt")));
 
-/**
- * @brief 转台实时工作状态
- */
-KVBasePtr KVProtocol::resolve_mount(const KVVec& kvs) {
-    KVMountPtr proto = boost::make_shared<KVMount>();
-
-    try {
-        for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-            if      (iequals(it->keyword, "state"))    proto->state    = std::stoi(it->value);
-            else if (iequals(it->keyword, "errcode"))  proto->errcode  = std::stoi(it->value);
-            else if (iequals(it->keyword, "mjd"))      proto->mjd      = std::stod(it->value);
-            else if (iequals(it->keyword, "lst"))      proto->lst      = std::stod(it->value);
-            else if (iequals(it->keyword, "ra"))       proto->ra       = std::stod(it->value);
-            else if (iequals(it->keyword, "dec"))      proto->dec      = std::stod(it->value);
-            else if (iequals(it->keyword, "ra2k"))     proto->ra2k     = std::stod(it->value);
-            else if (iequals(it->keyword, "dec2k"))    proto->dec2k    = std::stod(it->value);
-            else if (iequals(it->keyword, "azi"))      proto->azi      = std::stod(it->value);
-            else if (iequals(it->keyword, "ele"))      proto->ele      = std::stod(it->value);
-        }
-    }
-    catch(std::invalid_argument& ex1) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex1.what());
-    }
-    catch(std::out_of_range& ex2) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex2.what());
-    }
     return to_kvbase(proto);
 }
 
 /**
- * @brief 相机实时工作状态
+ * @brief 批量追加观测计划
  */
-KVBasePtr KVProtocol::resolve_camera(const KVVec& kvs) {
-    KVCamPtr proto = boost::make_shared<KVCamera>();
-
-    try {
-        for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-            if      (iequals(it->keyword, "state"))    proto->state    = std::stoi(it->value);
-            else if (iequals(it->keyword, "errcode"))  proto->errcode  = std::stoi(it->value);
-            else if (iequals(it->keyword, "left"))     proto->left     = std::stod(it->value);
-            else if (iequals(it->keyword, "percent"))  proto->percent  = std::stod(it->value);
-            else if (iequals(it->keyword, "freedisk")) proto->freedisk = std::stoi(it->value);
-            else if (iequals(it->keyword, "coolget"))  proto->coolget  = std::stoi(it->value);
-            else if (iequals(it->keyword, "loopno"))   proto->loopno   = std::stoi(it->value);
-            else if (iequals(it->keyword, "frmno"))    proto->frmno    = std::stoi(it->value);
-            else if (iequals(it->keyword, "imgtype"))  proto->imgtype  = it->value;
-            else if (iequals(it->keyword, "filter"))   proto->filter   = it->value;
-            else if (iequals(it->keyword, "filename")) proto->fileName = it->value;
-            else if (iequals(it->keyword, "plan_sn"))  proto->plan_sn  = it->value;
+KVBasePtr KVProtocol::resolve_append_batch(const char* str) {
+    KVAppBatchPtr batch = boost::make_shared<KVAppBatch>();
+    const char* ptr = str;
+
+    while (*ptr) {
+        KVTokens kvs;
+        const char* end = tokenize(ptr, kvs, '&');
+        if (kvs.n) {// 忽略空记录
+            KVBasePtr proto = resolve_append_plan(kvs);
+            if (!proto) return proto;
+            proto->utc = kvs.utc;
+            proto->gid = kvs.gid;
+            proto->uid = kvs.uid;
+            batch->plans.push_back(boost::static_pointer_cast<KVAppPlan>(proto));
         }
+        ptr = *end ? end + 1 : end;
     }
-    catch(std::invalid_argument& ex1) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex1.what());
-    }
-    catch(std::out_of_range& ex2) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex2.what());
-    }
-    return to_kvbase(proto);
+    return to_kvbase(batch);
 }
 
 /**
- * @brief 转台: 搜索零点
+ * @brief 追加观测计划: GWAC
  */
-KVBasePtr KVProtocol::resolve_home(const KVVec& kvs) {
-    KVHomePtr proto = boost::make_shared<KVHome>();
-    return to_kvbase(proto);
+KVBasePtr KVProtocol::resolve_append_gwac(const KVTokens& kvs) {
+    KVBasePtr proto = resolve_append_plan(kvs);
+	if (proto.unique()) {
+		proto->type   = KVTYPE_APPGWAC;
+		proto->typeId = KVID_APPGWAC;
+	}
+	return proto;
 }
 
 /**
  * @brief 转台: 同步零点
  */
-KVBasePtr KVProtocol::resolve_sync(const KVVec& kvs) {
+KVBasePtr KVProtocol::resolve_sync(const KVTokens& kvs) {
     KVSyncPtr proto = boost::make_shared<KVSync>();
+    NumFieldStatus num;
 
-    try {
-        proto->epoch = 2000.0;
-        for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-            if      (iequals(it->keyword, "ra"))    proto->ra    = std::stod(it->value);
-            else if (iequals(it->keyword, "dec"))   proto->dec   = std::stod(it->value);
-            else if (iequals(it->keyword, "ecoch")) proto->epoch = std::stod(it->value);
-        }
-    }
-    catch(std::invalid_argument& ex1) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex1.what());
-    }
-    catch(std::out_of_range& ex2) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex2.what());
-    }
-    return to_kvbase(proto);
-}
-
-/**
- * @brief 转台: 复位
- */
-KVBasePtr KVProtocol::resolve_park(const KVVec& kvs) {
-    KVParkPtr proto = boost::make_shared<KVPark>();
+    proto->epoch = 2000.0;
+    decode_fields(kvs, *proto, num);
+    if (num.Failed()) return bad_frame(proto->type, num);
     return to_kvbase(proto);
 }
 
 /**
  * @brief 转台: 指向
  */
-KVBasePtr KVProtocol::resolve_slewto(const KVVec& kvs) {
+KVBasePtr KVProtocol::resolve_slewto(const KVTokens& kvs) {
     KVSlewPtr proto = boost::make_shared<KVSlewto>();
+    NumFieldStatus num;
 
     proto->coorsys = COORSYS_EQUA;
     proto->epoch   = 2000.0;
-    try {
-        for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-            if      (iequals(it->keyword, "coor_sys")) proto->coorsys = std::stoi(it->value);
-            else if (iequals(it->keyword, "ra"))       proto->ra      = std::stod(it->value);
-            else if (iequals(it->keyword, "dec"))      proto->dec     = std::stod(it->value);
-            else if (iequals(it->keyword, "ecoch"))    proto->epoch   = std::stod(it->value);
-            else if (iequals(it->keyword, "azi"))      proto->azi     = std::stod(it->value);
-            else if (iequals(it->keyword, "ele"))      proto->ele     = std::stod(it->value);
-            else if (iequals(it->keyword, "tle1"))     proto->tle1    = it->value;
-            else if (iequals(it->keyword, "tle2"))     proto->tle2    = it->value;
-        }
-    }
-    catch(std::invalid_argument& ex1) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex1.what());
-    }
-    catch(std::out_of_range& ex2) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex2.what());
-    }
-    return to_kvbase(proto);
-}
-
-/**
- * @brief 转台: 导星
- */
-KVBasePtr KVProtocol::resolve_guide(const KVVec& kvs) {
-    KVGuidePtr proto = boost::make_shared<KVGuide>();
-
-    try {
-        for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-            if      (iequals(it->keyword, "ra"))       proto->ra      = std::stoi(it->value);
-            else if (iequals(it->keyword, "dec"))      proto->dec     = std::stoi(it->value);
-            else if (iequals(it->keyword, "result"))   proto->result  = std::stoi(it->value);
-            else if (iequals(it->keyword, "op"))       proto->op      = std::stoi(it->value);
-        }
-    }
-    catch(std::invalid_argument& ex1) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex1.what());
-    }
-    catch(std::out_of_range& ex2) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex2.what());
-    }
-    return to_kvbase(proto);
-}
-
-/**
- * @brief 转台: 切换跟踪模式
- */
-KVBasePtr KVProtocol::resolve_track(const KVVec& kvs) {
-	KVTrackPtr proto = boost::make_shared<KVTrack>();
-    return to_kvbase(proto);
-}
-
-/**
- * @brief 转台: 改变跟踪速度
- */
-KVBasePtr KVProtocol::resolve_trackvel(const KVVec& kvs) {
-    KVTrackVelPtr proto = boost::make_shared<KVTrackVel>();
-
-    try {
-        for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-            if      (iequals(it->keyword, "ra"))   proto->ra   = std::stod(it->value);
-            else if (iequals(it->keyword, "dec"))  proto->dec  = std::stod(it->value);
-        }
-    }
-    catch(std::invalid_argument& ex1) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex1.what());
-    }
-    catch(std::out_of_range& ex2) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex2.what());
-    }
+    decode_fields(kvs, *proto, num);
+    if (num.Failed()) return bad_frame(proto->type, num);
     return to_kvbase(proto);
 }
 
 /**
  * @brief 相机: 手动曝光
  */
-KVBasePtr KVProtocol::resolve_take_image(const KVVec& kvs) {
+KVBasePtr KVProtocol::resolve_take_image(const KVTokens& kvs) {
     KVBasePtr proto = resolve_append_plan(kvs);
-	if (proto.unique()) proto->type = KVTYPE_TKIMG;
+	if (proto.unique()) {
+		proto->type   = KVTYPE_TKIMG;
+		proto->typeId = KVID_TKIMG;
+	}
 	return proto;
 }
-
-/**
- * @brief 相机: 曝光指令
- */
-KVBasePtr KVProtocol::resolve_expose(const KVVec& kvs){
-    KVExpPtr proto = boost::make_shared<KVExpose>();
-
-    try {
-        for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-            if (iequals(it->keyword, "command"))     proto->command = std::stoi(it->value);
-            else if (iequals(it->keyword, "frmno"))  proto->frmno   = std::stoi(it->value);
-            else if (iequals(it->keyword, "loopno")) proto->loopno  = std::stoi(it->value);
-        }
-    }
-    catch(std::invalid_argument& ex1) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex1.what());
-    }
-    catch(std::out_of_range& ex2) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex2.what());
-    }
-    return to_kvbase(proto);
-}
-
-/**
- * @brief 相机参数: 状态/查询/修改
- */
-KVBasePtr KVProtocol::resolve_camset(const KVVec& kvs) {
-    KVCamSetPtr proto = boost::make_shared<KVCamSet>();
-
-    try {
-        for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-            if      (iequals(it->keyword, "optype"))     proto->opType     = std::stoi(it->value);
-            else if (iequals(it->keyword, "bitDepth"))   proto->bitDepth   = std::stoi(it->value);
-            else if (iequals(it->keyword, "iADC"))       proto->iADC       = std::stoi(it->value);
-            else if (iequals(it->keyword, "iReadPort"))  proto->iReadPort  = std::stoi(it->value);
-            else if (iequals(it->keyword, "iReadRate"))  proto->iReadRate  = std::stoi(it->value);
-            else if (iequals(it->keyword, "iVSRate"))    proto->iVSRate    = std::stoi(it->value);
-            else if (iequals(it->keyword, "iGain"))      proto->iGain      = std::stoi(it->value);
-            else if (iequals(it->keyword, "coolSet"))    proto->coolSet    = std::stoi(it->value);
-            else if (iequals(it->keyword, "bitPixel"))   proto->bitPixel   = std::stoi(it->value);
-            else if (iequals(it->keyword, "ADC"))        proto->ADC        = it->value;
-            else if (iequals(it->keyword, "readPort"))   proto->readPort   = it->value;
-            else if (iequals(it->keyword, "readRate"))   proto->readRate   = it->value;
-            else if (iequals(it->keyword, "vsRate"))     proto->vsRate     = std::stod(it->value);
-            else if (iequals(it->keyword, "gain"))       proto->gain       = std::stod(it->value);
-        }
-    }
-    catch(std::invalid_argument& ex1) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex1.what());
-    }
-    catch(std::out_of_range& ex2) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex2.what());
-    }
-    return to_kvbase(proto);
-}
-
-/**
- * @brief 调焦: 开环调焦
- */
-KVBasePtr KVProtocol::resolve_focus(const KVVec& kvs) {
-    KVFocusPtr proto = boost::make_shared<KVFocus>();
-
-    try {
-        for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-            if      (iequals(it->keyword, "optype"))  proto->opType  = std::stoi(it->value);
-			else if (iequals(it->keyword, "state"))   proto->state   = std::stoi(it->value);
-            else if (iequals(it->keyword, "relpos"))  proto->relPos  = std::stoi(it->value);
-            else if (iequals(it->keyword, "pos"))     proto->pos     = std::stoi(it->value);
-            else if (iequals(it->keyword, "posTar"))  proto->posTar  = std::stoi(it->value);
-        }
-    }
-    catch(std::invalid_argument& ex1) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex1.what());
-    }
-    catch(std::out_of_range& ex2) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex2.what());
-    }
-    return to_kvbase(proto);
-}
-
-/**
- * @brief 调焦: 重置焦点零点
- */
-KVBasePtr KVProtocol::resolve_focus_sync(const KVVec& kvs) {
-	KVFocusSyncPtr proto = boost::make_shared<KVFocusSync>();
-	return to_kvbase(proto);
-}
-
-/**
- * @brief 调焦: 闭环调焦
- */
-KVBasePtr KVProtocol::resolve_fwhm(const KVVec& kvs) {
-    KVFwhmPtr proto = boost::make_shared<KVFWHM>();
-
-    try {
-        for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-            if      (iequals(it->keyword, "value")) proto->value = std::stod(it->value);
-            else if (iequals(it->keyword, "tmimg")) proto->tmimg = it->value;
-        }
-    }
-    catch(std::invalid_argument& ex1) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex1.what());
-    }
-    catch(std::out_of_range& ex2) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex2.what());
-    }
-    return to_kvbase(proto);
-}
-
-/**
- * @brief 消旋器: 指令和状态
- */
-KVBasePtr KVProtocol::resolve_derot(const KVVec& kvs) {
-    KVDerotPtr proto = boost::make_shared<KVDerot>();
-
-    try {
-        for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-            if      (iequals(it->keyword, "optype"))  proto->opType  = std::stoi(it->value);
-            else if (iequals(it->keyword, "command")) proto->command = std::stoi(it->value);
-            else if (iequals(it->keyword, "state"))   proto->state   = std::stoi(it->value);
-            else if (iequals(it->keyword, "postar"))  proto->posTar  = std::stod(it->value);
-            else if (iequals(it->keyword, "pos"))     proto->pos     = std::stod(it->value);
-        }
-    }
-    catch(std::invalid_argument& ex1) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex1.what());
-    }
-    catch(std::out_of_range& ex2) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex2.what());
-    }
-    return to_kvbase(proto);
-}
-
-/**
- * @brief 圆顶和天窗: 指令和状态
- */
-KVBasePtr KVProtocol::resolve_dome(const KVVec& kvs) {
-    KVDomePtr proto = boost::make_shared<KVDome>();
-
-    try {
-        for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-            if      (iequals(it->keyword, "optype"))  proto->opType  = std::stoi(it->value);
-            else if (iequals(it->keyword, "command")) proto->command = std::stoi(it->value);
-            else if (iequals(it->keyword, "state"))   proto->state   = std::stoi(it->value);
-            else if (iequals(it->keyword, "azi"))     proto->azi     = std::stod(it->value);
-            else if (iequals(it->keyword, "ele"))     proto->ele     = std::stod(it->value);
-            else if (iequals(it->keyword, "aziobj"))  proto->aziObj  = std::stod(it->value);
-            else if (iequals(it->keyword, "eleobj"))  proto->eleObj  = std::stod(it->value);
-        }
-    }
-    catch(std::invalid_argument& ex1) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex1.what());
-    }
-    catch(std::out_of_range& ex2) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex2.what());
-    }
-    return to_kvbase(proto);
-}
-
-/**
- * @brief 镜盖: 指令和状态
- */
-KVBasePtr KVProtocol::resolve_mcover(const KVVec& kvs) {
-    KVMCoverPtr proto = boost::make_shared<KVMirrCover>();
-
-    try {
-        for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-            if      (iequals(it->keyword, "optype"))  proto->opType  = std::stoi(it->value);
-            else if (iequals(it->keyword, "command")) proto->command = std::stoi(it->value);
-            else if (iequals(it->keyword, "state"))   proto->state   = std::stoi(it->value);
-        }
-    }
-    catch(std::invalid_argument& ex1) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex1.what());
-    }
-    catch(std::out_of_range& ex2) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex2.what());
-    }
-    return to_kvbase(proto);
-}
-
-/**
- * @brief 滤光片(单独控制): 指令和状态
- */
-KVBasePtr KVProtocol::resolve_filter(const KVVec& kvs) {
-    KVFilPtr proto = boost::make_shared<KVFilter>();
-
-    try {
-        for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-            if      (iequals(it->keyword, "optype")) proto->opType = std::stoi(it->value);
-            else if (iequals(it->keyword, "name"))   proto->name   = it->value;
-        }
-    }
-    catch(std::invalid_argument& ex1) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex1.what());
-    }
-    catch(std::out_of_range& ex2) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex2.what());
-    }
-    return to_kvbase(proto);
-}
-
-/**
- * @brief 测站位置: 状态/查询/修改
- */
-KVBasePtr KVProtocol::resolve_geosite(const KVVec& kvs) {
-    KVSitePtr proto = boost::make_shared<KVGeoSite>();
-
-    try {
-        for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-            if      (iequals(it->keyword, "optype")) proto->opType = std::stoi(it->value);
-            else if (iequals(it->keyword, "name"))   proto->name   = std::stod(it->value);
-            else if (iequals(it->keyword, "lon"))    proto->lon    = std::stod(it->value);
-            else if (iequals(it->keyword, "lat"))    proto->lat    = std::stod(it->value);
-            else if (iequals(it->keyword, "alt"))    proto->alt    = std::stod(it->value);
-        }
-    }
-    catch(std::invalid_argument& ex1) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex1.what());
-    }
-    catch(std::out_of_range& ex2) {
-        proto.reset();
-        _gLog.Write(LOG_WARN, "[%s]: %s", proto->type.c_str(), ex2.what());
-    }
-    return to_kvbase(proto);
-}
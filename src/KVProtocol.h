@@ -13,7 +13,42 @@
 #ifndef KVPROTOCOL_H
 #define KVPROTOCOL_H
 
+#include <string_view>
+#include <boost/atomic.hpp>
 #include "ProtoKV.h"
+#include "ProtoNumber.h"
+
+/**
+ * @brief 键-值对视图, 指向接收缓冲区, 不复制数据
+ */
+struct KeyValView {
+    std::string_view keyword; ///< 关键字
+    std::string_view value;   ///< 数值
+    uint64_t hash;            ///< 关键字散列, 分词时计算一次. 由kv_hash()定义
+};
+
+/**
+ * @brief 单条协议中键值对视图的集合
+ * @note
+ * 定长存储, 分词时不申请堆内存. 超出MAX_PAIRS的键值对被忽略
+ */
+struct KVTokens {
+    enum {
+        MAX_PAIRS = 64  ///< 最大键值对数量
+    };
+    typedef const KeyValView* const_iterator;
+
+    KeyValView kvs[MAX_PAIRS];  ///< 键值对, 不含公共键值
+    int n = 0;                  ///< 键值对数量
+    std::string_view utc;   ///< 公共键值: 时间戳
+    std::string_view gid;   ///< 公共键值: 组标志
+    std::string_view uid;   ///< 公共键值: 单元标志
+    std::string_view cid;   ///< 公共键值: 相机标志
+
+public:
+    const_iterator begin() const { return kvs; }
+    const_iterator end() const   { return kvs + n; }
+};
 
 class KVProtocol
 {
@@ -29,144 +64,83 @@ public:
      * @return KVBasePtr
      */
     KVBasePtr Resolve(const char* rcvd);
-
-// 功能
-private:
     /**
-     * @brief 以=为分隔符, 解析关键字和键值
-     * @param kv       keyword=value格式字符串
-     * @param keyword  关键字
-     * @param value    键值
-     * @return keyword和value有效标志
+     * @brief 查找协议类型编号
+     * @param type  协议类型名称, 大小写无关
+     * @return 类型编号. 未知类型返回KVID_UNKNOWN
      */
-    bool resolve_kv(const string& kv, string& keyword, string& value);
+    static KVTypeId TypeId(std::string_view type);
     /**
-     * @brief 解析键值对集合
-     * @param str    键值对集合字符串, key1=val1,[key2=val2,...]
-     * @param kvs    解析后键值对集合
-     * @param basis  临时存储基础信息
+     * @brief 查看被丢弃的协议数量: 未知类型或数值字段无效
      */
-    void resolve_kv(const char* str, KVVec& kvs, KVBase& basis);
+    uint64_t BadFrames() const;
 
-// 功能: 按协议类型创建对应实例指针
+// 数据
+protected:
+    boost::atomic<uint64_t> badFrames_; ///< 被丢弃的协议数量
+
+// 功能
 private:
     /**
-     * @brief 追加观测计划
-     */
-    KVBasePtr resolve_append_plan(const KVVec& kvs);
-    /**
-     * @brief 追加观测计划: GWAC
-     */
-    KVBasePtr resolve_append_gwac(const KVVec& kvs);
-    /**
-     * @brief 检查观测计划状态
-     */
-    KVBasePtr resolve_check_plan(const KVVec& kvs);
-    /**
-     * @brief 删除观测计划
+     * @brief 记录并丢弃数值字段无效的协议
+     * @param type  协议类型
+     * @param num   字段解析状态, 包含首个出错字段
+     * @return 空指针
      */
-    KVBasePtr resolve_remove_plan(const KVVec& kvs);
+    KVBasePtr bad_frame(const string& type, const NumFieldStatus& num);
     /**
-     * @brief 观测计划实时
+     * @brief 登记一个键值对. 关键字和键值去除首尾空白后均不可为空
+     * @param key  关键字起始地址
+     * @param eq   第一个'='的地址
+     * @param end  键值对结束地址, 即','或'\0'的地址
+     * @param kvs  键值对集合
      */
-    KVBasePtr resolve_plan(const KVVec& kvs);
+    void append_kv(const char* key, const char* eq, const char* end, KVTokens& kvs);
     /**
-     * @brief 中断当前任务
+     * @brief 单次扫描解析键值对集合, 只生成指向str的视图
+     * @param str    键值对集合字符串, key1=val1,[key2=val2,...]
+     * @param kvs    解析后键值对集合
+     * @param sep    记录分隔符. '\0': 只有一条记录
+     * @return
+     * 结束位置, 即sep或'\0'的地址
      */
-    KVBasePtr resolve_abort(const KVVec& kvs);
+    const char* tokenize(const char* str, KVTokens& kvs, char sep = '\0');
 
+// 功能: 按协议类型创建对应实例指针
+private:
     /**
-     * @brief 观测系统实时工作状态
+     * @brief 按字段表创建协议实例, 适用于无缺省值和后处理的协议
+     * @note
+     * 实例取自ProtoPool, 最后一个引用释放后回收
      */
-    KVBasePtr resolve_obss(const KVVec& kvs);
+    template <class T> KVBasePtr resolve(const KVTokens& kvs);
     /**
-     * @brief 转台实时工作状态
+     * @brief 追加观测计划
      */
-    KVBasePtr resolve_mount(const KVVec& kvs);
+    KVBasePtr resolve_append_plan(const KVTokens& kvs);
     /**
-     * @brief 相机实时工作状态
+     * @brief 追加观测计划: GWAC
      */
-    KVBasePtr resolve_camera(const KVVec& kvs);
-
+    KVBasePtr resolve_append_gwac(const KVTokens& kvs);
     /**
-     * @brief 转台: 搜索零点
+     * @brief 批量追加观测计划
+     * @param str  以'&'分隔的计划集合
+     * @note
+     * 任一计划无效时丢弃整帧
      */
-    KVBasePtr resolve_home(const KVVec& kvs);
+    KVBasePtr resolve_append_batch(const char* str);
     /**
      * @brief 转台: 同步零点
      */
-    KVBasePtr resolve_sync(const KVVec& kvs);
-    /**
-     * @brief 转台: 复位
-     */
-    KVBasePtr resolve_park(const KVVec& kvs);
+    KVBasePtr resolve_sync(const KVTokens& kvs);
     /**
      * @brief 转台: 指向
      */
-    KVBasePtr resolve_slewto(const KVVec& kvs);
-    /**
-     * @brief 转台: 导星
-     */
-    KVBasePtr resolve_guide(const KVVec& kvs);
-    /**
-     * @brief 转台: 切换跟踪模式
-     */
-    KVBasePtr resolve_track(const KVVec& kvs);
-    /**
-     * @brief 转台: 改变跟踪速度
-     */
-    KVBasePtr resolve_trackvel(const KVVec& kvs);
-
+    KVBasePtr resolve_slewto(const KVTokens& kvs);
     /**
      * @brief 相机: 手动曝光
      */
-    KVBasePtr resolve_take_image(const KVVec& kvs);
-    /**
-     * @brief 相机: 曝光指令
-     */
-    KVBasePtr resolve_expose(const KVVec& kvs);
-    /**
-     * @brief 相机参数: 状态/查询/修改
-     */
-    KVBasePtr resolve_camset(const KVVec& kvs);
-
-    /**
-     * @brief 调焦: 开环调焦
-     */
-    KVBasePtr resolve_focus(const KVVec& kvs);
-    /**
-     * @brief 调焦: 重置焦点零点
-     */
-    KVBasePtr resolve_focus_sync(const KVVec& kvs);
-    /**
-     * @brief 调焦: 闭环调焦
-     */
-    KVBasePtr resolve_fwhm(const KVVec& kvs);
-
-    /**
-     * @brief 消旋器: 指令和状态
-     */
-    KVBasePtr resolve_derot(const KVVec& kvs);
-
-    /**
-     * @brief 圆顶和天窗: 指令和状态
-     */
-    KVBasePtr resolve_dome(const KVVec& kvs);
-
-    /**
-     * @brief 镜盖: 指令和状态
-     */
-    KVBasePtr resolve_mcover(const KVVec& kvs);
-
-    /**
-     * @brief 滤光片(单独控制): 指令和状态
-     */
-    KVBasePtr resolve_filter(const KVVec& kvs);
-
-    /**
-     * @brief 测站位置: 状态/查询/修改
-     */
-    KVBasePtr resolve_geosite(const KVVec& kvs);
+    KVBasePtr resolve_take_image(const KVTokens& kvs);
 };
 
 #endif
@@ -1,49 +1,91 @@
 /*!
- * @file MessageQueue.h 声明文件, 基于boost::interprocess::ipc::message_queue封装消息队列
+ * @file MessageQueue.cpp 定义文件, 基于进程内环形队列封装消息队列
  * @version 0.2
  * @date 2017-10-02
  * - 优化消息队列实现方式
  * @date 2020-10-01
  * - 优化
+ * @date 2024-04-08
+ * - 以多生产者/单消费者环形队列和eventfd替代boost::interprocess::message_queue
  */
 
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include "MessageQueue.h"
 #include "GLog.h"
 
-using namespace boost::interprocess;
+/////////////////////////////////////////////////////////////////////
+/*--------------------- 环形队列 ---------------------*/
+MessageQueue::MsgRing::MsgRing(size_t capacity)
+	: mask_(capacity - 1), enqPos_(0), deqPos_(0) {
+	cells_.reset(new Cell[capacity]);
+	for (size_t i = 0; i < capacity; ++i) cells_[i].seq.store(i, boost::memory_order_relaxed);
+}
+
+bool MessageQueue::MsgRing::Push(Message& msg) {
+	Cell* cell;
+	size_t pos = enqPos_.load(boost::memory_order_relaxed);
+
+	while (1) {
+		cell = &cells_[pos & mask_];
+		size_t seq = cell->seq.load(boost::memory_order_acquire);
+		intptr_t dif = intptr_t(seq) - intptr_t(pos);
+		if (dif == 0) {// 单元空闲, 竞争写入位置
+			if (enqPos_.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed)) break;
+		}
+		else if (dif < 0) return false; // 队列已满
+		else pos = enqPos_.load(boost::memory_order_relaxed);
+	}
+	cell->msg = std::move(msg);
+	cell->seq.store(pos + 1, boost::memory_order_release);
+	return true;
+}
+
+bool MessageQueue::MsgRing::Pop(Message& msg) {
+	Cell* cell = &cells_[deqPos_ & mask_];
+	size_t seq = cell->seq.load(boost::memory_order_acquire);
+	if (intptr_t(seq) - intptr_t(deqPos_ + 1) < 0) return false; // 队列为空或单元写入未完成
+	msg = std::move(cell->msg);
+	cell->seq.store(deqPos_ + mask_ + 1, boost::memory_order_release);
+	++deqPos_;
+	return true;
+}
 
+/////////////////////////////////////////////////////////////////////
+/*--------------------- 消息队列 ---------------------*/
 MessageQueue::MessageQueue()
-	: funcs_count_(1024) {
+	: mqHigh_(1024), mqLow_(1024), waiting_(false), running_(false), funcs_count_(1024) {
+	evfd_ = eventfd(0, EFD_CLOEXEC);
 	funcs_.reset(new CBF[funcs_count_]);
+	funcsPayload_.reset(new CBFPayload[funcs_count_]);
 }
 
 MessageQueue::~MessageQueue() {
 	Stop();
+	if (evfd_ >= 0) close(evfd_);
 }
 
 bool MessageQueue::Start(const char *name) {
 	if (!thrdMsgLoop_.unique()) {
-		try {// 启动消息队列
-			mqName_ = name;
-			message_queue::remove(name);
-			mqPtr_.reset(new MsgQue(open_or_create, name, 1024, sizeof(Message)));
-			register_messages();
-			thrdMsgLoop_.reset(new boost::thread(boost::bind(&MessageQueue::message_loop, this)));
-		}
-		catch(interprocess_exception &ex) {
-			_gLog.Write(LOG_FAULT, "[%s : %s] %s", __FILE__, __FUNCTION__, ex.what());
+		if (evfd_ < 0) {
+			_gLog.Write(LOG_FAULT, "[%s : %s] failed to create eventfd for <%s>", __FILE__, __FUNCTION__, name);
 			return false;
 		}
+		mqName_ = name;
+		register_messages();
+		running_ = true;
+		thrdMsgLoop_.reset(new boost::thread(boost::bind(&MessageQueue::message_loop, this)));
 	}
 	return thrdMsgLoop_.unique();
 }
 
 void MessageQueue::Stop() {
 	if (thrdMsgLoop_.unique()) {
-		SendMessage(MSG_QUIT);
+		running_ = false; // 先拒绝新消息, 再投递退出消息
+		Message msg(MSG_QUIT, 0, 0);
+		push_message(mqHigh_, msg);
 		thrdMsgLoop_->join();
 		thrdMsgLoop_.reset();
-		message_queue::remove(mqName_.c_str());
 	}
 }
 
@@ -54,29 +96,81 @@ bool MessageQueue::RegisterMessage(const long id, const CBSlot& slot) {
 	return rslt;
 }
 
+bool MessageQueue::RegisterMessage(const long id, const CBSlotPayload& slot) {
+	long pos(id - MSG_USER);
+	bool rslt = pos >= 0 && pos < funcs_count_;
+	if (rslt) funcsPayload_[pos].connect(slot);
+	return rslt;
+}
+
 void MessageQueue::PostMessage(const long id, const long par1, const long par2) {
-	if (mqPtr_.unique()) {
+	if (running_) {
 		Message msg(id, par1, par2);
-		mqPtr_->send(&msg, sizeof(Message), 1);
+		push_message(mqLow_, msg);
 	}
 }
 
 void MessageQueue::SendMessage(const long id, const long par1, const long par2) {
-	if (mqPtr_.unique()) {
+	if (running_) {
 		Message msg(id, par1, par2);
-		mqPtr_->send(&msg, sizeof(Message), 10);
+		push_message(mqHigh_, msg);
+	}
+}
+
+void MessageQueue::PostMessage(const long id, MsgPayloadPtr payload, const long par1, const long par2) {
+	if (running_) {
+		Message msg(id, std::move(payload), par1, par2);
+		push_message(mqLow_, msg);
+	}
+}
+
+void MessageQueue::SendMessage(const long id, MsgPayloadPtr payload, const long par1, const long par2) {
+	if (running_) {
+		Message msg(id, std::move(payload), par1, par2);
+		push_message(mqHigh_, msg);
+	}
+}
+
+void MessageQueue::push_message(MsgRing& ring, Message& msg) {
+	while (!ring.Push(msg)) {// 队列已满. 停止后消息线程不再取出消息, 放弃投递
+		if (!running_ && msg.id != MSG_QUIT) return;
+		boost::this_thread::yield();
+	}
+	if (waiting_.exchange(false)) {// 仅在消息线程等待时唤醒
+		uint64_t one(1);
+		ssize_t rslt = write(evfd_, &one, sizeof(one));
+		(void) rslt;
+	}
+}
+
+void MessageQueue::wait_message(Message& msg) {
+	uint64_t count;
+
+	while (!mqHigh_.Pop(msg) && !mqLow_.Pop(msg)) {
+		/*
+		 * 先声明等待再检查队列: 生产者写入消息后检查waiting_,
+		 * 因此生产者或者看到waiting_并唤醒, 或者其消息被此处检查到
+		 */
+		waiting_ = true;
+		if (mqHigh_.Pop(msg) || mqLow_.Pop(msg)) {
+			waiting_ = false;
+			break;
+		}
+		ssize_t rslt = read(evfd_, &count, sizeof(count));
+		(void) rslt;
 	}
 }
 
 void MessageQueue::message_loop() {
 	Message msg;
-	MsgQue::size_type szRcv, szBuf(sizeof(Message));
-	uint32_t priority, pos;
+	unsigned long pos;
 
 	do {
-		mqPtr_->receive(&msg, szBuf, szRcv, priority);
-		if ((pos = msg.id - MSG_USER) >= 0 && pos < funcs_count_) {
-			(funcs_[pos])(msg.par1, msg.par2);
+		wait_message(msg);
+		if ((pos = msg.id - MSG_USER) < (unsigned long) funcs_count_) {
+			if (!funcsPayload_[pos].empty()) (funcsPayload_[pos])(msg.payload, msg.par1, msg.par2);
+			else (funcs_[pos])(msg.par1, msg.par2);
 		}
+		msg.payload.reset(); // 未被响应函数取走的载荷
 	} while(msg.id != MSG_QUIT);
 }
@@ -6,22 +6,69 @@
  * @date 2020-10-01
  * - 优化
  * - 面向gtoaes, 将GeneralControl和ObservationSystem的共同特征迁移至此处
+ * @date 2024-04-08
+ * - 以进程内多生产者/单消费者环形队列替代boost::interprocess::message_queue
+ * - 高/低优先级各一条队列, 消息线程优先处理高优先级队列
+ * - 消息线程空闲时阻塞在eventfd上, 生产者仅在消息线程等待时写eventfd唤醒
+ * @date 2024-04-10
+ * - 消息可携带只可移动的类型化载荷, 响应函数直接取得所有权, 不再以long传递指针
  */
 
 #ifndef SRC_MESSAGEQUEUE_H_
 #define SRC_MESSAGEQUEUE_H_
 
 #include <string>
-#include <boost/interprocess/ipc/message_queue.hpp>
+#include <memory>
+#include <utility>
+#include <boost/atomic.hpp>
 #include <boost/signals2/signal.hpp>
 #include "BoostInclude.h"
 
+/*!
+ * @brief 消息载荷基类
+ * @note
+ * 载荷随消息由投递方移交消息线程, 响应函数可取走所有权, 否则在响应后释放
+ */
+struct MessagePayload {
+	virtual ~MessagePayload() {}
+};
+typedef std::unique_ptr<MessagePayload> MsgPayloadPtr;
+
+/*!
+ * @brief 类型化消息载荷
+ */
+template <class T>
+struct MessageData : public MessagePayload {
+	T data;	///< 数据
+
+public:
+	MessageData(const T& _data) : data(_data) {}
+	MessageData(T&& _data) : data(std::move(_data)) {}
+
+	/*!
+	 * @brief 创建载荷
+	 */
+	static MsgPayloadPtr Create(T data) {
+		return MsgPayloadPtr(new MessageData(std::move(data)));
+	}
+	/*!
+	 * @brief 访问载荷数据
+	 * @return
+	 * 数据指针. 载荷为空或类型不符时返回NULL
+	 */
+	static T* Get(const MsgPayloadPtr& payload) {
+		MessageData* ptr = dynamic_cast<MessageData*>(payload.get());
+		return ptr ? &ptr->data : NULL;
+	}
+};
+
 class MessageQueue {
 protected:
 	/*--------------- 数据类型 ---------------*/
 	struct Message {
 		long id;			///< 消息编号
 		long par1, par2;	///< 参数
+		MsgPayloadPtr payload;	///< 载荷. 只可移动
 
 	public:
 		Message() {
@@ -33,14 +80,56 @@ protected:
 			par1 = _par1;
 			par2 = _par2;
 		}
+
+		Message(long _id, MsgPayloadPtr&& _payload, long _par1 = 0, long _par2 = 0)
+			: payload(std::move(_payload)) {
+			id   = _id;
+			par1 = _par1;
+			par2 = _par2;
+		}
+	};
+
+	/*!
+	 * @brief 有界多生产者/单消费者环形队列
+	 * @note
+	 * - 每个单元以序号标记状态, 生产者以CAS竞争写入位置, 无锁
+	 * - 只允许消息线程调用Pop()
+	 */
+	class MsgRing {
+	protected:
+		struct Cell {
+			boost::atomic<size_t> seq;	///< 单元序号
+			Message msg;				///< 消息
+		};
+
+		const size_t mask_;		///< 容量-1. 容量为2的幂
+		boost::shared_array<Cell> cells_;	///< 存储区
+		boost::atomic<size_t> enqPos_;		///< 写入位置
+		size_t deqPos_;						///< 读出位置
+
+	public:
+		MsgRing(size_t capacity);
+		/*!
+		 * @brief 写入消息. 写入成功时移走msg
+		 * @return
+		 * 队列已满时返回false
+		 */
+		bool Push(Message& msg);
+		/*!
+		 * @brief 读出消息
+		 * @return
+		 * 队列为空时返回false
+		 */
+		bool Pop(Message& msg);
 	};
 
 	//////////////////////////////////////////////////////////////////////////////
 	typedef boost::signals2::signal<void (const long, const long)>  CBF;	///< 消息回调函数
 	typedef CBF::slot_type CBSlot;	///< 回调函数插槽
 	typedef boost::shared_array<CBF> CBArray;	///< 回调函数数组
-	typedef boost::interprocess::message_queue MsgQue;	///< boost消息队列
-	typedef boost::shared_ptr<MsgQue> MsgQuePtr;	///< boost消息队列指针
+	typedef boost::signals2::signal<void (MsgPayloadPtr&, const long, const long)> CBFPayload;	///< 消息回调函数, 带载荷
+	typedef CBFPayload::slot_type CBSlotPayload;	///< 回调函数插槽, 带载荷
+	typedef boost::shared_array<CBFPayload> CBPayloadArray;	///< 回调函数数组, 带载荷
 
 protected:
 	/* 成员变量 */
@@ -52,10 +141,15 @@ protected:
 
 	//////////////////////////////////////////////////////////////////////////////
 	/* 消息队列 */
-	std::string mqName_;		///< 消息队列名称. 用于删除错误创建的消息队列
-	MsgQuePtr mqPtr_;			///< 消息队列
+	std::string mqName_;		///< 消息队列名称
+	MsgRing mqHigh_;			///< 消息队列: 高优先级
+	MsgRing mqLow_;				///< 消息队列: 低优先级
+	int evfd_;					///< eventfd: 唤醒消息线程
+	boost::atomic<bool> waiting_;	///< 消息线程等待唤醒
+	boost::atomic<bool> running_;	///< 消息线程运行中, 接受消息
 	const long funcs_count_;	///< 自定义回调函数数组长度
 	CBArray funcs_;				///< 回调函数数组
+	CBPayloadArray funcsPayload_;	///< 回调函数数组, 带载荷
 
 	/* 多线程 */
 	ThrdPtr thrdMsgLoop_;	///< 消息响应线程
@@ -65,7 +159,7 @@ public:
 	virtual ~MessageQueue();
 	/*!
 	 * @brief 创建消息队列并启动监测/响应服务
-	 * @param name 消息队列名称
+	 * @param name 消息队列名称, 用于日志
 	 * @return
 	 * 操作结果. false代表失败
 	 */
@@ -82,6 +176,16 @@ public:
 	 * 消息注册结果. 若失败返回false
 	 */
 	bool RegisterMessage(const long id, const CBSlot& slot);
+	/*!
+	 * @brief 注册消息及其响应函数, 响应函数接收消息载荷
+	 * @param id   消息代码
+	 * @param slot 回调函数插槽
+	 * @return
+	 * 消息注册结果. 若失败返回false
+	 * @note
+	 * 同一消息注册了带载荷的响应函数时, 不再调用不带载荷的响应函数
+	 */
+	bool RegisterMessage(const long id, const CBSlotPayload& slot);
 	/*!
 	 * @brief 投递低优先级消息
 	 * @param id   消息代码
@@ -96,6 +200,22 @@ public:
 	 * @param par2 参数2
 	 */
 	void SendMessage(const long id, const long par1 = 0, const long par2 = 0);
+	/*!
+	 * @brief 投递携带载荷的低优先级消息
+	 * @param id      消息代码
+	 * @param payload 载荷, 移交消息线程
+	 * @param par1    参数1
+	 * @param par2    参数2
+	 */
+	void PostMessage(const long id, MsgPayloadPtr payload, const long par1 = 0, const long par2 = 0);
+	/*!
+	 * @brief 投递携带载荷的高优先级消息
+	 * @param id      消息代码
+	 * @param payload 载荷, 移交消息线程
+	 * @param par1    参数1
+	 * @param par2    参数2
+	 */
+	void SendMessage(const long id, MsgPayloadPtr payload, const long par1 = 0, const long par2 = 0);
 
 protected:
 	/* 消息响应函数 */
@@ -105,6 +225,17 @@ protected:
 	virtual void register_messages() = 0;
 
 protected:
+	/*!
+	 * @brief 将消息写入队列并唤醒消息线程
+	 * @note
+	 * 队列已满时让出CPU并重试, 与message_queue::send()的阻塞语义一致.
+	 * Stop()清除running_后放弃重试, 仅MSG_QUIT继续等待写入
+	 */
+	void push_message(MsgRing& ring, Message& msg);
+	/*!
+	 * @brief 依优先级取出消息. 无消息时阻塞
+	 */
+	void wait_message(Message& msg);
 	/*!
 	 * @brief 线程, 监测/响应消息
 	 */
@@ -5,263 +5,399 @@
  * @date           2017年2月20日
  */
 
+#include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
+#include <time.h>
+#include <algorithm>
+#include <charconv>
 #include <typeinfo>
-#include <boost/utility/string_ref.hpp>
-#include <boost/algorithm/string.hpp>
-#include <boost/date_time/posix_time/posix_time.hpp>
 #include "NonKVProtocol.h"
+#include "ProtoPool.h"
 #include "GLog.h"
 
 using namespace boost;
-using namespace boost::posix_time;
 
 NonKVProtocol::NonKVProtocol() {
 	gid_ = uid_ = "";
+	head_ = "g#";
+	serno_ = 1;
+	badFrames_ = 0;
 }
 
 NonKVProtocol::NonKVProtocol(const string& gid, const string& uid) {
 	gid_ = gid;
 	uid_ = uid;
+	head_ = "g#" + gid + uid;
+	serno_ = 1;
+	badFrames_ = 0;
 }
 
-NonKVProtocol::~NonKVProtocol() {
+uint64_t NonKVProtocol::BadFrames() const {
+	return badFrames_;
 }
 
-// 解析焦点位置
-int NonKVProtocol::resolve_focus(const char* id) {
-	if (iequals(id, "es")) return 0;
-	if (iequals(id, "ws")) return 1;
-	if (iequals(id, "wn")) return 2;
-	if (iequals(id, "en")) return 3;
-	if (iequals(id, "mid")) return 4;
-	return -1;
+NonKVProtocol::~NonKVProtocol() {
 }
 
 int NonKVProtocol::increase_serno() {
-	int serno = serno_;
-	if (++serno_ == 100000) serno_ = 1;
+	int serno = serno_.load(), next;
+	do {
+		next = serno == 99999 ? 1 : serno + 1;
+	} while (!serno_.compare_exchange_weak(serno, next));
 	return serno;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+/* GWAC协议帧解析
+ * 帧格式: g#<gid:3>[<uid:3>]<类型><数据>%[数据%]<YYYY-MM-DD>%<hh:mm:ss>%<序列号>%
+ * - 单次扫描以'%'切分为若干段, 再按首段中的类型关键字定长解码
+ * - 指令回馈: 首段中含"Rec", 其后的'%'可省略
+ * - 调焦到位("finished")及未知类型被忽略, 不计入无效协议
+ */
+/**
+ * @brief GWAC协议帧: 以'%'切分的段视图
+ */
+struct GwacFrame {
+	enum {
+		MAX_SEGS = 8	///< 最大段数. 多余的段被忽略
+	};
+
+	std::string_view seg[MAX_SEGS];	///< 段视图, 不含'%'
+	int n = 0;	///< 段数量
+
+public:
+	/*!
+	 * @brief 查看段. 越界时返回空视图
+	 */
+	std::string_view operator[](int i) const {
+		return i < n ? seg[i] : std::string_view();
+	}
+};
+
+/*!
+ * @brief 切分协议帧
+ * @param first  首段起始地址, 即引导符之后
+ * @param last   帧结束地址, 即结束符的地址
+ */
+static void split_frame(const char* first, const char* last, GwacFrame& frm) {
+	for (const char* ptr = first; frm.n < GwacFrame::MAX_SEGS; ++ptr) {
+		if (ptr == last || *ptr == '%') {
+			frm.seg[frm.n++] = std::string_view(first, ptr - first);
+			if (ptr == last) break;
+			first = ptr + 1;
+		}
+	}
+}
+
+/*!
+ * @brief 查找焦点位置序号
+ * @return 序号. 未知标志返回-1
+ */
+static int focus_index(std::string_view id) {
+	static const std::string_view ids[] = {"es", "ws", "wn", "en", "mid"};
+	for (int i = 0; i < int(sizeof(ids) / sizeof(ids[0])); ++i) {
+		if (id.size() == ids[i].size() && !strncasecmp(id.data(), ids[i].data(), id.size())) return i;
+	}
+	return -1;
+}
+
+/*!
+ * @brief 转台状态: 每个字符对应一台转台
+ * @note sample: g#002status0000555755%2024-03-29%13:07:26%32846%
+ */
+static NonKVBasePtr decode_status(std::string_view data, const GwacFrame&, NumError&) {
+	boost::shared_ptr<NonKVStatus> body = ProtoPool<NonKVStatus>::Acquire();
+	for (size_t i = 0; i < data.size() && body->n < int(sizeof(body->state)); ++i)
+		body->state[body->n++] = data[i] - '0';
+	return body;
+}
+
+/*!
+ * @brief 转台指向位置: 赤经和赤纬各占一段, 量纲: 1E-4角度
+ * @note sample: g#002006currentpos1234567%-0123456%2024-03-29%13:07:26%32846%
+ */
+static NonKVBasePtr decode_position(std::string_view data, const GwacFrame& frm, NumError& rc) {
+	int ra, dec;
+	if ((rc = parse_number(data, ra)) != NUMERR_OK
+			|| (rc = parse_number(frm[1], dec)) != NUMERR_OK)
+		return NonKVBasePtr();
+
+	boost::shared_ptr<NonKVPosition> body = ProtoPool<NonKVPosition>::Acquire();
+	body->ra  = ra * 1E-4;
+	body->dec = dec * 1E-4;
+	return body;
+}
+
+/*!
+ * @brief 焦点位置: 焦点标志与数值交替出现
+ * @note sample: g#002006focuses+0010en-0030ws+0020wn-0025mid+0015%...
+ */
+static NonKVBasePtr decode_focus(std::string_view data, const GwacFrame&, NumError& rc) {
+	boost::shared_ptr<NonKVFocus> body = ProtoPool<NonKVFocus>::Acquire();
+	int n(data.size());
+	int idb(-1), nb(-1), index(-1);	// 焦点标志起始位置, 数值起始位置, 焦点序号
+
+	for (int i = 0; i <= n; ++i) {
+		bool alpha = i < n && isalpha((unsigned char) data[i]);
+		if (i == n || (alpha && nb >= 0)) {// 一组焦点位置结束
+			if (idb >= 0 && nb >= 0) {
+				if ((index = focus_index(data.substr(idb, nb - idb))) < 0) break;
+				if ((rc = parse_number(data.substr(nb, i - nb), body->pos[index])) != NUMERR_OK) break;
+			}
+			if (i == n) break;
+			idb = nb = -1;
+		}
+		if (alpha) {
+			if (idb < 0) idb = i;
+		}
+		else if (nb < 0) nb = i;
+	}
+
+	if (index < 0 || rc != NUMERR_OK) return NonKVBasePtr();
+	return body;
+}
+
+/**
+ * @brief GWAC协议类型: 按类型关键字定位解码函数
+ */
+struct GwacType {
+	std::string_view keyword;	///< 类型关键字
+	size_t offset;	///< 关键字在首段中的偏移: 3, 无单元标志; 6, 含单元标志
+	int nseg;		///< 数据占用的段数, 含首段
+	NonKVBasePtr (*decode)(std::string_view data, const GwacFrame& frm, NumError& rc);	///< 解码函数
+};
+
+static const GwacType gwacTypes[] = {
+	{NONKVTYPE_STATE, 3, 1, decode_status},
+	{NONKVTYPE_POS,   6, 2, decode_position},
+	{NONKVTYPE_FOCUS, 6, 1, decode_focus}
+};
+
+/*!
+ * @brief 按首段查找协议类型
+ * @param head     首段
+ * @param aligned  类型关键字是否位于约定偏移. false: 组标志或单元标志长度错误
+ * @return 协议类型. 未知类型返回NULL
+ */
+static const GwacType* find_type(std::string_view head, bool& aligned) {
+	aligned = true;
+	for (const GwacType& type : gwacTypes) {
+		if (head.size() >= type.offset && head.substr(type.offset, type.keyword.size()) == type.keyword)
+			return &type;
+	}
+	aligned = false;
+	for (const GwacType& type : gwacTypes) {
+		if (head.find(type.keyword) != std::string_view::npos) return &type;
+	}
+	return NULL;
+}
+
 NonKVBasePtr NonKVProtocol::Resolve(const char* rcvd) {
+	const size_t group_len = 3;	// 约定: 组标志长度为3字节
+	const size_t unit_len  = 3;	// 约定: 单元标志长度为3字节
+	const std::string_view rsp("Rec");	// 约定: 回馈指令特征字
+	size_t len(strlen(rcvd)), pos;
+	GwacFrame frm;
 	NonKVBasePtr proto;
-	string_ref sref(rcvd);
-	string prefix("g#");				// 定义引导符
-	string suffix("%");					// 定义结束符: 同时还是中间符!!!
-	string type_state(NONKVTYPE_STATE);	// 定义协议: status
-	string type_pos(NONKVTYPE_POS);		// 定义协议: currentpos
-	string type_focus(NONKVTYPE_FOCUS);	// 定义协议: focus
-
-	char sep = '%';			// 数据间分隔符
-	int group_len = 3;		// 约定: 组标志长度为3字节
-	int unit_len = 3;		// 约定: 单元标志长度为3字节
-	int rsp_len = 3;		// 约定: 回馈指令特征字"Rec"长度为3字节
-	int n(sref.length() - suffix.length()), pos, i(0), j;
-	char ch, buff[20], buff1[20];
-
-	if (!sref.starts_with(prefix) || !sref.ends_with(suffix)) {
+	NumError rc(NUMERR_OK);	// 数值字段解析结果
+	std::string_view head, uid, date;
+	int tail(1);	// 时标及序列号的起始段
+
+	if (len < 3 || rcvd[0] != 'g' || rcvd[1] != '#' || rcvd[len - 1] != '%') {
+		++badFrames_;
 		_gLog.Write(LOG_FAULT, "%s:%s, illegal protocol[%s]",
 			typeid(this).name(), __FUNCTION__, rcvd);
+		return proto;
 	}
-	else if ((pos = sref.find("Rec")) > 0) {// 指令回馈
+
+	split_frame(rcvd + 2, rcvd + len - 1, frm);
+	head = frm[0];
+	if ((pos = head.find(rsp)) != std::string_view::npos) {// 指令回馈
 	// g#001001trackRec%YYYY-MM-DD%hh:mm:ss%xxxxxx%
 	// g#002008fwhm0810024T101756000Rec%2024-03-28%10:17:56%%00001%
-		boost::shared_ptr<NonKVResponse> body(new NonKVResponse);
-		for (i = prefix.length(), j = 0; j < group_len; ++i, ++j) body->gid += sref.at(i);
-		for (j = 0; j < unit_len; ++i, ++j) body->uid += sref.at(i);
-		i = pos + rsp_len;
-		if (sref.at(i) != sep) --i; // 容错:g#001001trackRecYYYY-MM-DD%hh:mm:ss%xxxxxx%
-		proto = boost::static_pointer_cast<NonKVBase>(body);
-	}
-	else if ((pos = sref.find("finished")) > 0) {// 指令回馈: 调焦到位
-	}
-	else if ((pos = sref.find(type_state)) > 0) {// state
-	// g#002status0000555755%2024-03-29%13:07:26%32846%
-		boost::shared_ptr<NonKVStatus> body(new NonKVStatus);
-		for (i = prefix.length(); i < pos; ++i) body->gid += sref.at(i);
-		for (i = pos + type_state.length(), j = 0; i < n && sref.at(i) != sep; ++i, ++j, ++body->n) body->state[j] = sref.at(i) - '0';
-		proto = boost::static_pointer_cast<NonKVBase>(body);
+	// 容错: g#001001trackRecYYYY-MM-DD%hh:mm:ss%xxxxxx%
+		if (pos >= group_len + unit_len) {
+			proto = ProtoPool<NonKVResponse>::Acquire();
+			uid  = head.substr(group_len, unit_len);
+			date = head.substr(pos + rsp.size());
+		}
 	}
-	else if ((pos = sref.find(type_pos)) > 0) {// currentpos
-		boost::shared_ptr<NonKVPosition> body(new NonKVPosition);
-		int j1(0), j2(0);
-		pos -= unit_len;
-		for (i = prefix.length(); i < pos; ++i) body->gid += sref.at(i);
-		pos += unit_len;
-		for (; i < pos; ++i) body->uid += sref.at(i);
-		for (i = pos + type_pos.length(), j1 = 0; i < n && sref.at(i) != sep; ++i, ++j1) buff[j1] = sref.at(i);
-		buff[j1] = '\0';
-		body->ra = atoi(buff) * 1E-4;
-		for (++i, j2 = 0; i < n && sref.at(i) != sep; ++i, ++j2) buff[j2] = sref.at(i);
-		buff[j2] = '\0';
-		body->dec = atoi(buff) * 1E-4;
-		if (j1 && j2) proto = boost::static_pointer_cast<NonKVBase>(body);
+	else if (head.find("finished") != std::string_view::npos) {// 指令回馈: 调焦到位
+		return proto;
 	}
-	else if ((pos = sref.find(type_focus)) > 0) {// focus
-		// sample: g#002006focuses+0010en-0030ws+0020wn-0025mid+0015%
-		boost::shared_ptr<NonKVFocus> body(new NonKVFocus);
-		int j1(0), j2(0), index(-1);
-		pos -= unit_len;
-		for (i = prefix.length(); i < pos; ++i) body->gid += sref.at(i);
-		pos += unit_len;
-		for (; i < pos; ++i) body->uid += sref.at(i);
-		for (i = pos + type_focus.length(); i < n; ++i) {
-			if ((ch = sref.at(i)) == sep) {
-				if (j1 && j2) {
-					buff[j1]  = '\0';
-					buff1[j2] = '\0';
-					index = resolve_focus(buff);
-					if (index >= 0) body->pos[index] = atoi(buff1);
-				}
-				break;
-			}
-			if (isalpha(ch)) {
-				if (j1 && j2) {
-					buff[j1]  = '\0';
-					buff1[j2] = '\0';
-					j1 = j2 = 0;
-					if ((index = resolve_focus(buff)) < 0) break;
-					body->pos[index] = atoi(buff1);
-				}
-				buff[j1++] = ch;
-			}
-			else buff1[j2++] = ch;
+	else {
+		bool aligned;
+		const GwacType* type = find_type(head, aligned);
+		if (!type) return proto;
+		if (aligned) {
+			proto = type->decode(head.substr(type->offset + type->keyword.size()), frm, rc);
+			if (type->offset > group_len) uid = head.substr(group_len, unit_len);
+			tail = type->nseg;
 		}
-
-		if (index >= 0) proto = boost::static_pointer_cast<NonKVBase>(body);
 	}
 
-	if (proto.unique()) {
-		if (proto->gid.size() != group_len || (proto->uid.size() && proto->uid.size() != unit_len))
-			proto.reset();
-		else {
-			for (++i; i < n && sref.at(i) != sep; ++i) proto->utc += sref.at(i);
-			proto->utc += "T";
-			for (++i; i < n && sref.at(i) != sep; ++i) proto->utc += sref.at(i);
-			for (++i, j = 0; i < n && sref.at(i) != sep; ++i, ++j) buff[j] = sref.at(i);
-			buff[j] = '\0';
-
-			if (j > 0) proto->sn = atoi(buff);
-			else proto.reset();
+	if (proto) {
+		if (date.empty()) date = frm[tail++];
+		proto->gid.assign(head.substr(0, group_len));
+		proto->uid.assign(uid);
+		proto->utc.assign(date).append(1, 'T').append(frm[tail]);
+		if ((rc = parse_number(frm[tail + 1], proto->sn)) != NUMERR_OK) proto.reset();
+	}
+	if (!proto) {
+		++badFrames_;
+		if (rc != NUMERR_OK) {
+			_gLog.Write(LOG_WARN, "%s:%s, %s[%s]",
+				typeid(this).name(), __FUNCTION__, num_error_desc(rc), rcvd);
 		}
 	}
 
 	return proto;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+/* GWAC指令组装
+ * 指令格式: g#<gid><uid><类型><参数>%<YYYY-MM-DD>%<hh:mm:ss>%<序列号>%\n
+ * - 引导段在构造时生成, UTC时标每线程每秒格式化一次
+ * - 参数按固定宽度追加, 与printf的%0Nd, %+0Nd和%+Nd格式一致
+ */
+/*!
+ * @brief 当前UTC时标, 格式: YYYY-MM-DD%hh:mm:ss
+ */
+static std::string_view utc_field() {
+	thread_local time_t last = -1;
+	thread_local char text[64];
+	time_t now = time(NULL);
+	if (now != last) {
+		struct tm tmu;
+		gmtime_r(&now, &tmu);
+		snprintf(text, sizeof(text), "%04d-%02d-%02d%%%02d:%02d:%02d",
+			tmu.tm_year + 1900, tmu.tm_mon + 1, tmu.tm_mday,
+			tmu.tm_hour, tmu.tm_min, tmu.tm_sec);
+		last = now;
+	}
+	return std::string_view(text, 19);
+}
+
+/**
+ * @brief GWAC指令缓冲区: 按模板逐段追加
+ */
+class GwacCommand {
+public:
+	enum {
+		FMT_SIGN  = 1,	///< 总是输出符号
+		FMT_SPACE = 2	///< 以空格填充宽度. 缺省以'0'填充
+	};
+
+protected:
+	char buff_[128];	///< 指令缓冲区
+	char* ptr_;			///< 追加位置
+	char* end_;		///< 缓冲区结束位置, 预留时标、序列号和结束符
+
+public:
+	GwacCommand(const string& head, std::string_view type)
+		: ptr_(buff_), end_(buff_ + sizeof(buff_) - 32) {
+		Str(head).Str(type);
+	}
+
+	/*!
+	 * @brief 追加字符串. 超出缓冲区的部分被截断
+	 */
+	GwacCommand& Str(std::string_view str) {
+		size_t n = std::min(str.size(), size_t(end_ - ptr_));
+		memcpy(ptr_, str.data(), n);
+		ptr_ += n;
+		return *this;
+	}
+
+	/*!
+	 * @brief 追加分隔符
+	 */
+	GwacCommand& Sep() {
+		if (ptr_ < end_) *ptr_++ = '%';
+		return *this;
+	}
+
+	/*!
+	 * @brief 追加整数
+	 * @param val    数值
+	 * @param width  最小宽度, 含符号
+	 * @param flags  格式: FMT_SIGN, FMT_SPACE
+	 */
+	GwacCommand& Int(int val, int width = 0, int flags = 0) {
+		char digits[12];
+		unsigned int u = val < 0 ? 0U - unsigned(val) : unsigned(val);
+		int n = std::to_chars(digits, digits + sizeof(digits), u).ptr - digits;
+		char sign = val < 0 ? '-' : (flags & FMT_SIGN ? '+' : 0);
+		int pad = width - n - (sign ? 1 : 0);
+
+		if (end_ - ptr_ < n + 1 + std::max(pad, 0)) return *this;
+		if (flags & FMT_SPACE) for (; pad > 0; --pad) *ptr_++ = ' ';
+		if (sign) *ptr_++ = sign;
+		for (; pad > 0; --pad) *ptr_++ = '0';
+		memcpy(ptr_, digits, n);
+		ptr_ += n;
+		return *this;
+	}
+
+	/*!
+	 * @brief 追加时标、序列号和结束符, 生成指令
+	 */
+	string Finish(int serno) {
+		end_ += 32;
+		Sep().Str(utc_field()).Sep().Int(serno, 5).Sep();
+		*ptr_++ = '\n';
+		return string(buff_, ptr_ - buff_);
+	}
+};
+
 string NonKVProtocol::FindHome(int& serno, bool ra, bool dec) {
-	MtxLck lck(mtxSerno_);
-	char buff[100];
-	ptime utc = second_clock::universal_time();
-	snprintf (buff, 100, "g#%s%shomera%ddec%d%%%s%%%s%%%05d%%\n",
-		gid_.c_str(), uid_.c_str(),
-		ra, dec,
-		to_iso_extended_string(utc.date()).c_str(),
-		to_simple_string(utc.time_of_day()).c_str(),
-		serno_);
 	serno = increase_serno();
-	return string(buff);
+	return GwacCommand(head_, "homera").Int(ra).Str("dec").Int(dec).Finish(serno);
 }
 
 string NonKVProtocol::HomeSync(int& serno, double ra, double dec) {
-	MtxLck lck(mtxSerno_);
-	char buff[100];
-	ptime utc = second_clock::universal_time();
-	snprintf(buff, 100, "g#%s%ssync%07d%%%+07d%%%s%%%s%%%05d%%\n",
-		gid_.c_str(), uid_.c_str(),
-		int(ra * 10000), int(dec * 10000),
-		to_iso_extended_string(utc.date()).c_str(),
-		to_simple_string(utc.time_of_day()).c_str(),
-		serno_);
 	serno = increase_serno();
-	return string(buff);
+	return GwacCommand(head_, "sync").Int(int(ra * 10000), 7).Sep()
+		.Int(int(dec * 10000), 7, GwacCommand::FMT_SIGN).Finish(serno);
 }
 
 string NonKVProtocol::Slew(int& serno, double ra, double dec) {
-	MtxLck lck(mtxSerno_);
-	char buff[100];
-	ptime utc = second_clock::universal_time();
-	snprintf(buff, 100, "g#%s%sslew%07d%%%+07d%%%s%%%s%%%05d%%\n",
-		gid_.c_str(), uid_.c_str(),
-		int(ra * 10000), int(dec * 10000),
-		to_iso_extended_string(utc.date()).c_str(),
-		to_simple_string(utc.time_of_day()).c_str(),
-		serno_);
 	serno = increase_serno();
-	return string(buff);
+	return GwacCommand(head_, "slew").Int(int(ra * 10000), 7).Sep()
+		.Int(int(dec * 10000), 7, GwacCommand::FMT_SIGN).Finish(serno);
 }
 
 string NonKVProtocol::SlewHD(int& serno, double ha, double dec) {
-	MtxLck lck(mtxSerno_);
-	char buff[100];
-	ptime utc = second_clock::universal_time();
 	if (ha < 0.0) ha += 360.0;
-	snprintf(buff, 100, "g#%s%sHA%07d%%%+07d%%%s%%%s%%%05d%%\n",
-		gid_.c_str(), uid_.c_str(),
-		int(ha * 10000), int(dec * 10000),
-		to_iso_extended_string(utc.date()).c_str(),
-		to_simple_string(utc.time_of_day()).c_str(),
-		serno_);
 	serno = increase_serno();
-	return string(buff);
+	return GwacCommand(head_, "HA").Int(int(ha * 10000), 7).Sep()
+		.Int(int(dec * 10000), 7, GwacCommand::FMT_SIGN).Finish(serno);
 }
 
 string NonKVProtocol::Guide(int& serno, int ra, int dec) {
-	MtxLck lck(mtxSerno_);
-	char buff[100];
-	ptime utc = second_clock::universal_time();
-	snprintf(buff, 100, "g#%s%sguide%+06d%%%+06d%%%s%%%s%%%05d%%\n",
-		gid_.c_str(), uid_.c_str(),
-		ra, dec,
-		to_iso_extended_string(utc.date()).c_str(),
-		to_simple_string(utc.time_of_day()).c_str(),
-		serno_);
 	serno = increase_serno();
-	return string(buff);
+	return GwacCommand(head_, "guide").Int(ra, 6, GwacCommand::FMT_SIGN).Sep()
+		.Int(dec, 6, GwacCommand::FMT_SIGN).Finish(serno);
 }
 
 string NonKVProtocol::Park(int& serno) {
-	MtxLck lck(mtxSerno_);
-	char buff[100];
-	ptime utc = second_clock::universal_time();
-	snprintf(buff, 100, "g#%s%spark%%%s%%%s%%%05d%%\n",
-		gid_.c_str(), uid_.c_str(),
-		to_iso_extended_string(utc.date()).c_str(),
-		to_simple_string(utc.time_of_day()).c_str(),
-		serno_);
 	serno = increase_serno();
-	return string(buff);
+	return GwacCommand(head_, "park").Finish(serno);
 }
 
 string NonKVProtocol::AbortSlew(int& serno) {
-	MtxLck lck(mtxSerno_);
-	char buff[100];
-	ptime utc = second_clock::universal_time();
-	snprintf(buff, 100, "g#%s%sabortslew%%%s%%%s%%%05d%%\n",
-		gid_.c_str(), uid_.c_str(),
-		to_iso_extended_string(utc.date()).c_str(),
-		to_simple_string(utc.time_of_day()).c_str(),
-		serno_);
 	serno = increase_serno();
-	return string(buff);
+	return GwacCommand(head_, "abortslew").Finish(serno);
 }
 
 /**
  * @brief 组装构建track指令
  */
 string NonKVProtocol::Track(int& serno) {
-	MtxLck lck(mtxSerno_);
-	char buff[100];
-	ptime utc = second_clock::universal_time();
-	snprintf(buff, 100, "g#%s%strack%%%s%%%s%%%05d%%\n",
-		gid_.c_str(), uid_.c_str(),
-		to_iso_extended_string(utc.date()).c_str(),
-		to_simple_string(utc.time_of_day()).c_str(),
-		serno_);
 	serno = increase_serno();
-	return string(buff);
+	return GwacCommand(head_, "track").Finish(serno);
 }
 
 /**
@@ -271,47 +407,23 @@ string NonKVProtocol::Track(int& serno) {
  * @note 设置转台自定义跟踪速度
  */
 string NonKVProtocol::TrackVelocity(int& serno, double ra, double dec) {
-	MtxLck lck(mtxSerno_);
-	char buff[100];
-	ptime utc = second_clock::universal_time();
-	snprintf(buff, 100, "g#%s%strackvel%+8d%%%+8d%%%s%%%s%%%05d%%\n",
-		gid_.c_str(), uid_.c_str(),
-		int(ra * 1000 + 0.5), int(dec * 1000 + 0.5),
-		to_iso_extended_string(utc.date()).c_str(),
-		to_simple_string(utc.time_of_day()).c_str(),
-		serno_);
+	const int flags = GwacCommand::FMT_SIGN | GwacCommand::FMT_SPACE;
 	serno = increase_serno();
-	return string(buff);
+	return GwacCommand(head_, "trackvel").Int(int(ra * 1000 + 0.5), 8, flags).Sep()
+		.Int(int(dec * 1000 + 0.5), 8, flags).Finish(serno);
 }
 
 string NonKVProtocol::FWHM(int& serno, const string& cid, const string& tmobs, double fwhm) {
 	/* 组装调焦指令 */
-	MtxLck lck(mtxSerno_);
-	char buff[100];
-	ptime utc = second_clock::universal_time();
-	snprintf(buff, 100, "g#%s%sfwhm%s%04dT%s%%%s%%%s%%%05d%%\n",
-		gid_.c_str(), uid_.c_str(), cid.c_str(),
-		int(fwhm * 1000 + 0.5), tmobs.c_str(),
-		to_iso_extended_string(utc.date()).c_str(),
-		to_simple_string(utc.time_of_day()).c_str(),
-		serno_);
 	serno = increase_serno();
-	return string(buff);
+	return GwacCommand(head_, "fwhm").Str(cid).Int(int(fwhm * 1000 + 0.5), 4)
+		.Str("T").Str(tmobs).Finish(serno);
 }
 
 string NonKVProtocol::Focus(int& serno, const std::string& cid, int pos) {
 	/* 组装调焦指令 */
-	MtxLck lck(mtxSerno_);
-	char buff[100];
-	ptime utc = second_clock::universal_time();
-	snprintf(buff, 100, "g#%s%sfocus%s%+05d%%%s%%%s%%%05d%%\n",
-		gid_.c_str(), uid_.c_str(), cid.c_str(),
-		pos,
-		to_iso_extended_string(utc.date()).c_str(),
-		to_simple_string(utc.time_of_day()).c_str(),
-		serno_);
 	serno = increase_serno();
-	return string(buff);
+	return GwacCommand(head_, "focus").Str(cid).Int(pos, 5, GwacCommand::FMT_SIGN).Finish(serno);
 }
 
 /*!
@@ -322,14 +434,6 @@ string NonKVProtocol::Focus(int& serno, const std::string& cid, int pos) {
  */
 string NonKVProtocol::FocusSync(int& serno, const std::string& cid) {
 	/* 组装焦点重置指令 */
-	MtxLck lck(mtxSerno_);
-	char buff[100];
-	ptime utc = second_clock::universal_time();
-	snprintf(buff, 100, "g#%s%sfocus%sclear%%%s%%%s%%%05d%%\n",
-		gid_.c_str(), uid_.c_str(), cid.c_str(),
-		to_iso_extended_string(utc.date()).c_str(),
-		to_simple_string(utc.time_of_day()).c_str(),
-		serno_);
 	serno = increase_serno();
-	return string(buff);
+	return GwacCommand(head_, "focus").Str(cid).Str("clear").Finish(serno);
 }
@@ -15,8 +15,11 @@
 #define NONKV_PROTOCOL_H_
 
 #include <string>
+#include <string_view>
 #include <limits.h>
+#include <boost/atomic.hpp>
 #include "BoostInclude.h"
+#include "ProtoNumber.h"
 
 using std::string;
 
@@ -138,13 +141,12 @@ protected:
 	// 成员变量
 	string gid_;	///< 组标志
 	string uid_;	///< 单元标志
-	boost::mutex mtxSerno_;	///< 序列号互斥锁
-	int serno_ = 1;	///< 指令序列号
+	string head_;	///< 指令引导段: g#<gid><uid>
+	boost::atomic<int> serno_;	///< 指令序列号
+	boost::atomic<uint64_t> badFrames_;	///< 被丢弃的协议数量
 
 private:
-	// 解析焦点位置
-	int resolve_focus(const char* id);
-	// 增加序列号
+	// 增加序列号. 无锁, 可在多个线程中调用
 	int increase_serno();
 
 public:
@@ -153,8 +155,14 @@ public:
 	 * @param rcvd   从网络中收到的信息
 	 * @return
 	 * 协议. 若无法识别协议类型则返回空指针
+	 * @note
+	 * 按定长格式自左向右单次扫描, 协议实例取自ProtoPool, 不申请内存
 	 */
 	NonKVBasePtr Resolve(const char* rcvd);
+	/*!
+	 * @brief 查看被丢弃的协议数量: 格式错误或数值字段无效
+	 */
+	uint64_t BadFrames() const;
 
 public:
 	/*!
@@ -5,6 +5,8 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/format.hpp>
 #include "ObservationSystem.h"
+#include "ADefine.h"
+#include "AMath.h"
 #include "GLog.h"
 
 using namespace boost;
@@ -49,7 +51,7 @@ bool ObservationSystem::Start(int type) {
 	_gLog.Write("OBSS<%s:%s> goes running", gid_.c_str(), uid_.c_str());
 	obssType_ = type;
 	if (!obssType_) thrdReWriteProto_ = Thread(boost::bind(&ObservationSystem::thread_rewrite, this));
-	thrdObsplan_ = Thread(boost::bind(&ObservationSystem::thread_obsplan, this));
+	thrdTimer_ = Thread(boost::bind(&ObservationSystem::thread_timer, this));
 
 	return true;
 }
@@ -59,7 +61,7 @@ bool ObservationSystem::Start(int type) {
  */
 void ObservationSystem::Stop() {
 	interrupt_thread(thrdReWriteProto_);
-	interrupt_thread(thrdObsplan_);
+	interrupt_thread(thrdTimer_);
 	MessageQueue::Stop();
 }
 
@@ -77,6 +79,16 @@ bool ObservationSystem::IsMatched(const string& gid, const string& uid) {
 			);												// 不接受单元标志相同, 而组标志相同
 }
 
+// 查看组标志
+const string& ObservationSystem::GetGid() {
+	return gid_;
+}
+
+// 查看单元标志
+const string& ObservationSystem::GetUid() {
+	return uid_;
+}
+
 // 查看转台状态
 const KVMount& ObservationSystem::GetInfoMount() {
 	return mountInfo_;
@@ -87,6 +99,42 @@ const ObservationSystem::CameraInfoVector& ObservationSystem::GetInfoCamera() {
 	return camInfoVec_;
 }
 
+// 检查计划类型是否与系统类型一致
+bool ObservationSystem::AcceptPlan(const KVAppPlan& plan) {
+	if (!obssType_) return plan.EquatorialCoord(); // GWAC只采用赤道坐标
+	return plan.typeId != KVID_APPGWAC;
+}
+
+// 评估执行观测计划的代价
+bool ObservationSystem::EvaluatePlan(const KVAppPlan& plan, double& slew) {
+	if (!AcceptPlan(plan) || !tcpMount_.use_count() || !sysState_.camonline) return false;
+	AstroUtil::AMath math;
+	slew = 0.0;
+	if (iequals(plan.imgtype, "bias") || iequals(plan.imgtype, "dark")) return true; // 无需指向
+	// 与process_new_plan()一致: 赤道、地平坐标估算指向距离, TLE不估算
+	if (plan.EquatorialCoord()) {// 指向中时以目标位置为起点
+		double ra  = mountInfo_.objra < 1000.0 ? mountInfo_.objra : mountInfo_.ra;
+		double dec = mountInfo_.objra < 1000.0 ? mountInfo_.objdec : mountInfo_.dec;
+		if (ra < 1000.0 && dec < 1000.0)
+			slew = math.SphereRange(ra * AU_D2R, dec * AU_D2R, plan.ra * AU_D2R, plan.dec * AU_D2R) * AU_R2D;
+		else slew = 180.0;
+	}
+	else if (plan.HorizonCoord()) {
+		if (mountInfo_.azi < 1000.0 && mountInfo_.ele < 1000.0)
+			slew = math.SphereRange(mountInfo_.azi * AU_D2R, mountInfo_.ele * AU_D2R,
+				plan.azi * AU_D2R, plan.ele * AU_D2R) * AU_R2D;
+		else slew = 180.0;
+	}
+	return true;
+}
+
+// 查看负载
+int ObservationSystem::PlanLoad() {
+	int n = int(planQueue_.Size());
+	if (plan_ || sysState_.AnyExposing()) ++n;
+	return n;
+}
+
 // 注册回调函数: 观测计划状态
 void ObservationSystem::RegisterPlanCallback(const PlanCBSlot& slot) {
 	cbfPlan_.disconnect_all_slots();
@@ -131,6 +179,7 @@ void ObservationSystem::CoupleMount(TcpCPtr ptrTcp) {
 		tcpMount_ = ptrTcp;
 		countMountPos_ = 0;
 		mountInfo_.state = MOUNT_MIN;
+		notify_plan_event();
 	}
 }
 
@@ -223,7 +272,7 @@ bool ObservationSystem::CoupleCamera(TcpCPtr ptrTcp, const string& cid) {
 		obssType_ ? PEER_CAMERA_GFT : PEER_CAMERA_GWAC);
 	ptrTcp->RegisterRead(slot);
 	// 在断点恢复计划
-	if (found && plan_.unique()) {
+	if (found && plan_) {
 		string cmd = plan_->ToString();
 		ptrTcp->Write(cmd.c_str(), cmd.size());
 
@@ -235,6 +284,7 @@ bool ObservationSystem::CoupleCamera(TcpCPtr ptrTcp, const string& cid) {
 			expose2camera(EXP_START, frmno >= 0 ? frmno : 0, cid.c_str());
 		}
 	}
+	notify_plan_event();
 
 	return true;
 }
@@ -258,8 +308,7 @@ void ObservationSystem::NotifyMountState(int state) {
 			if (plan_.use_count()) {
 				if (mountInfo_.state == MOUNT_GUIDING) {
 					KVGuide proto;
-					string cmd = proto.ToString();
-					write2camera(cmd.c_str(), cmd.size());
+					write2camera(proto);
 				}
 				else if (mountInfo_.state == MOUNT_SLEWING) expose2camera(EXP_START);
 			}
@@ -351,38 +400,69 @@ void ObservationSystem::NotifyResponse(const NonKVResponse& rsp) {
 void ObservationSystem::NotifyPlan(KVBasePtr proto) {
 	// 此转换带来限制: 不能在多个观测系统中复用相同观测计划
 	KVAppPlanPtr plan = boost::static_pointer_cast<KVAppPlan>(proto);
-	if (!plan_.unique() && sysState_.exposing) {// 手动曝光
+	if (!plan_ && sysState_.exposing) {// 手动曝光
 		_gLog.Write(LOG_WARN, "new plan<%s> was rejected for manual expose",
 			plan->ToString().c_str());
 	}
-	else {// 自动流程
+	else {// 自动流程: 计划入队, 由on_check_plan()按优先级启动
+		if (plan->plan_sn.empty()) plan->plan_sn = new_plan_sn();
 		_gLog.Write("new plan<%s:%s> %s", gid_.c_str(), uid_.c_str(), plan->ToString().c_str());
-		// 终止当前计划
-		if (plan_.unique()) Abort();
-		// 保存计划
-		plan_ = plan;
-		// 更新计划状态
-		plan_state_->UpdateUTC();
-		plan_state_->plan_sn = plan_->plan_sn;
-		plan_state_->state = OBSPLAN_CATALOGED;
-		cbfPlan_(plan_state_);
-		// 并通知处理新计划
-		cvNewPlan_.notify_one();
+		if (catalog_plan(plan)) {
+			set_wakeup(planQueue_.NextBegin());
+			notify_plan_event();
+		}
+	}
+}
+
+// 通知;观测计划: 批量保存新计划
+void ObservationSystem::NotifyPlan(const std::vector<KVAppPlanPtr>& plans) {
+	if (!plan_ && sysState_.exposing) {// 手动曝光
+		_gLog.Write(LOG_WARN, "%d new plans were rejected for manual expose", int(plans.size()));
+		return;
+	}
+	int n(0);
+	for (auto it = plans.begin(); it != plans.end(); ++it) {
+		if ((*it)->plan_sn.empty()) (*it)->plan_sn = new_plan_sn();
+		if (catalog_plan(*it)) ++n;
+	}
+	_gLog.Write("%d new plans<%s:%s> in batch, %d cataloged", int(plans.size()), gid_.c_str(), uid_.c_str(), n);
+	if (n) {
+		set_wakeup(planQueue_.NextBegin());
+		notify_plan_event();
 	}
 }
 
 // 通知: 检查计划状态
 KVPlanPtr ObservationSystem::CheckPlan(const string& plan_sn) {
 	KVPlanPtr plan;
-	if (iequals(plan_state_->plan_sn, plan_sn)) plan = plan_state_;
+	if (planQueue_.Find(plan_sn)) {// 待执行
+		plan = boost::make_shared<KVPlan>();
+		plan->UpdateUTC();
+		plan->gid = gid_;
+		plan->uid = uid_;
+		plan->plan_sn = plan_sn;
+		plan->state = OBSPLAN_CATALOGED;
+	}
+	else if (iequals(plan_state_->plan_sn, plan_sn)) plan = plan_state_;
 	return plan;
 }
 
 // 通知: 删除计划
 bool ObservationSystem::RemovePlan(const string& plan_sn) {
+	KVAppPlanPtr plan = planQueue_.Find(plan_sn);
+	if (plan && planQueue_.Remove(plan_sn)) {// 待执行
+		_gLog.Write("plan<%s> is removed from queue", plan->plan_sn.c_str());
+		report_plan(plan, OBSPLAN_DELETED);
+		set_wakeup(planQueue_.NextBegin());
+		return true;
+	}
 	if (iequals(plan_state_->plan_sn, plan_sn)) {
-		// 转台
-		// 相机
+		if (plan_ && iequals(plan_->plan_sn, plan_sn)) {// 执行中
+			Abort();
+			plan_state_->UpdateUTC();
+			plan_state_->state = OBSPLAN_DELETED;
+			cbfPlan_(plan_state_, KVAppPlanPtr());
+		}
 		return true;
 	}
 	return false;
@@ -391,6 +471,20 @@ bool ObservationSystem::RemovePlan(const string& plan_sn) {
 // 通知: 中断当前计划/指向/曝光
 void ObservationSystem::Abort() {
 	_gLog.Write("Abort OBSS<%s:%s> current operations", gid_.c_str(), uid_.c_str());
+	abort_devices();
+	if (plan_) {// 计划
+		_gLog.Write("plan<%s> is aborted", plan_->plan_sn.c_str());
+		plan_.reset();
+
+		// 更新计划状态
+		plan_state_->UpdateUTC();
+		plan_state_->tm_stop = plan_state_->utc;
+		plan_state_->state = OBSPLAN_INTERRUPTED;
+		cbfPlan_(plan_state_, KVAppPlanPtr());
+	}
+}
+
+void ObservationSystem::abort_devices() {
 	if (tcpMount_.use_count()) {// 转台
 		string cmd;
 		if (!obssType_) {
@@ -411,21 +505,27 @@ void ObservationSystem::Abort() {
 	if (sysState_.AnyExposing()) {
 		expose2camera(EXP_STOP);
 	}
-	if (plan_.unique()) {// 计划
-		_gLog.Write("plan<%s> is aborted", plan_->plan_sn.c_str());
-		plan_.reset();
+}
 
-		// 更新计划状态
-		plan_state_->UpdateUTC();
-		plan_state_->tm_stop = plan_state_->utc;
-		plan_state_->state = OBSPLAN_INTERRUPTED;
-		cbfPlan_(plan_state_);
+void ObservationSystem::preempt_plan() {
+	KVAppPlanPtr plan = plan_;
+	abort_devices();
+	plan_.reset();
+	if (planQueue_.Restore(planItem_, second_clock::universal_time())) {
+		_gLog.Write("plan<%s> is returned to queue", plan->plan_sn.c_str());
+		report_plan(plan, OBSPLAN_CATALOGED);
 	}
+	else {
+		_gLog.Write(LOG_WARN, "plan<%s> is abandoned for its end time <%s>",
+			plan->plan_sn.c_str(), plan->plan_end.c_str());
+		report_plan(plan, OBSPLAN_ABANDONED);
+	}
+	planItem_ = PlanQueue::Item();
 }
 
 // 通知: 指向
 void ObservationSystem::Slewto(KVSlewPtr proto) {
-	if (plan_.unique()) {
+	if (plan_) {
 		_gLog.Write("plan<%s> in OBSS<%s:%s> rejects command slew",
 			plan_->plan_sn.c_str(), gid_.c_str(), uid_.c_str());
 	}
@@ -475,15 +575,23 @@ void ObservationSystem::Park() {
 		_gLog.Write("abort exposing <%s:%s>", gid_.c_str(), uid_.c_str());
 		expose2camera(EXP_STOP);
 	}
-	if (plan_.unique()) {// 计划
+	if (plan_) {// 计划
 		_gLog.Write("plan<%s> is aborted", plan_->plan_sn.c_str());
 		plan_.reset();
 		// 更新计划状态
 		plan_state_->UpdateUTC();
 		plan_state_->tm_stop = plan_state_->utc;
 		plan_state_->state = OBSPLAN_INTERRUPTED;
-		cbfPlan_(plan_state_);
+		cbfPlan_(plan_state_, KVAppPlanPtr());
+	}
+	// 复位后不再自动启动待执行计划
+	std::vector<KVAppPlanPtr> removed;
+	planQueue_.Clear(removed);
+	for (auto it = removed.begin(); it != removed.end(); ++it) {
+		_gLog.Write("plan<%s> is abandoned for parking", (*it)->plan_sn.c_str());
+		report_plan(*it, OBSPLAN_ABANDONED);
 	}
+	set_wakeup(ptime(not_a_date_time));
 }
 
 // 通知: 导星
@@ -505,8 +613,7 @@ void ObservationSystem::Guide(KVGuidePtr proto) {
 	}
 	// 通知相机
 	proto->op = proto->result ? 0 : 1;
-	string cmd = proto->ToString();
-	write2camera(cmd.c_str(), cmd.size());
+	write2camera(*proto);
 }
 
 // 通知: 转台切换进入跟踪状态
@@ -596,7 +703,7 @@ void ObservationSystem::HomeSync(KVSyncPtr proto) {
 
 // 通知: 曝光
 void ObservationSystem::TakeImage(KVTkImgPtr proto0) {
-	if (plan_.unique()) {
+	if (plan_) {
 		_gLog.Write("plan<%s> in OBSS<%s:%s> rejects command slew",
 			plan_->plan_sn.c_str(), gid_.c_str(), uid_.c_str());
 	}
@@ -604,28 +711,18 @@ void ObservationSystem::TakeImage(KVTkImgPtr proto0) {
 		KVAppPlanPtr proto(new KVAppPlan);
 		*proto = *proto0;
 		// 补全协议缺失项
-		if (proto->plan_sn.empty()) {
-			ptime utc = second_clock::universal_time();
-			ptime::date_type day = utc.date();
-			if (day.day() != oldDay_) {
-				oldDay_ = day.day();
-				planSN_ = 0;
-			}
-			boost::format fmt("%02d%02d%02d%03d");
-			fmt % (day.year() - 2000) % day.month().as_number() % day.day() % ++planSN_;
-			proto->plan_sn = gid_ + uid_ + "_" + fmt.str();
-		}
+		if (proto->plan_sn.empty()) proto->plan_sn = new_plan_sn();
 		if (proto->exptime < 0) proto->exptime = 0.0;
 		if (proto->imgtype.empty()) proto->imgtype = proto->exptime == 0.0 ? "bias" : "object";
 		if (proto->objid.empty())   proto->objid = proto->imgtype;
 		if (proto->frmcnt <= 0) proto->frmcnt = 1;
-		proto->type = KVTYPE_APPGWAC; // 修改指令字
+		proto->type   = KVTYPE_APPGWAC; // 修改指令字
+		proto->typeId = KVID_APPGWAC;
 		_gLog.Write("TakeImage<%s:%s>: imgtype = %s, exptime = %.3lf, frmcnt = %d",
 			gid_.c_str(), uid_.c_str(),
 			proto->imgtype.c_str(), proto->exptime, proto->frmcnt);
 		// 相机指令
-		string cmd = proto->ToString();
-		write2camera(cmd.c_str(), cmd.size(), proto->cid.c_str());
+		write2camera(*proto, proto->cid.c_str());
 		expose2camera(EXP_START, 0, proto->cid.c_str());
 	}
 }
@@ -753,13 +850,71 @@ void ObservationSystem::Dome(KVDomePtr proto) {
  * @brief 注册消息响应函数
  */
 void ObservationSystem::register_messages() {
-	const CBSlot& slot1 = boost::bind(&ObservationSystem::on_tcp_close,   this, _1, _2);
-	const CBSlot& slot2 = boost::bind(&ObservationSystem::on_tcp_receive, this, _1, _2);
+	const CBSlotPayload& slot1 = boost::bind(&ObservationSystem::on_tcp_close,   this, _1, _2, _3);
+	const CBSlotPayload& slot2 = boost::bind(&ObservationSystem::on_tcp_receive, this, _1, _2, _3);
 	const CBSlot& slot3 = boost::bind(&ObservationSystem::on_flat_reslew, this, _1, _2);
+	const CBSlot& slot4 = boost::bind(&ObservationSystem::on_check_plan,  this, _1, _2);
+	const CBSlot& slot5 = boost::bind(&ObservationSystem::on_plan_deadline, this, _1, _2);
 
 	RegisterMessage(MSG_TCP_CLOSE,   slot1);
 	RegisterMessage(MSG_TCP_RECEIVE, slot2);
 	RegisterMessage(MSG_FLAT_RESLEW, slot3);
+	RegisterMessage(MSG_CHECK_PLAN,  slot4);
+	RegisterMessage(MSG_PLAN_DEADLINE, slot5);
+}
+
+void ObservationSystem::notify_plan_event() {
+	using namespace boost::chrono;
+	SendMessage(MSG_CHECK_PLAN, long(duration_cast<boost::chrono::microseconds>(steady_clock::now().time_since_epoch()).count()));
+}
+
+void ObservationSystem::set_deadline(const ptime& tm) {
+	MtxLck lck(mtxTimer_);
+	tmDeadline_ = tm;
+	cvTimer_.notify_one();
+}
+
+void ObservationSystem::set_wakeup(const ptime& tm) {
+	MtxLck lck(mtxTimer_);
+	tmWakeup_ = tm;
+	cvTimer_.notify_one();
+}
+
+bool ObservationSystem::catalog_plan(const KVAppPlanPtr& plan) {
+	if (!planQueue_.Push(plan, second_clock::universal_time())) {
+		_gLog.Write(LOG_WARN, "plan<%s> is abandoned for its end time <%s>",
+			plan->plan_sn.c_str(), plan->plan_end.c_str());
+		report_plan(plan, OBSPLAN_ABANDONED);
+		return false;
+	}
+	report_plan(plan, OBSPLAN_CATALOGED);
+	return true;
+}
+
+void ObservationSystem::report_plan(const KVAppPlanPtr& plan, int state) {
+	KVPlanPtr proto = boost::make_shared<KVPlan>();
+	proto->UpdateUTC();
+	proto->gid = gid_;
+	proto->uid = uid_;
+	proto->plan_sn = plan->plan_sn;
+	proto->state = state;
+	cbfPlan_(proto, state == OBSPLAN_CATALOGED ? plan : KVAppPlanPtr());
+}
+
+string ObservationSystem::new_plan_sn() {
+	ptime utc = second_clock::universal_time();
+	ptime::date_type day = utc.date();
+	if (day.day() != oldDay_) {
+		oldDay_ = day.day();
+		planSN_ = 0;
+	}
+	string plan_sn;
+	do {
+		boost::format fmt("%02d%02d%02d%03d");
+		fmt % (day.year() - 2000) % day.month().as_number() % day.day() % ++planSN_;
+		plan_sn = gid_ + uid_ + "_" + fmt.str();
+	} while (planQueue_.Find(plan_sn));
+	return plan_sn;
 }
 
 void ObservationSystem::process_new_plan() {
@@ -783,16 +938,15 @@ void ObservationSystem::process_new_plan() {
 			cvNewProto_.notify_one();
 		}
 		else {// 后随; 三坐标系
-			int coorsys = plan_->coorsys;
 			KVSlewto proto;
 			proto.UpdateUTC();
-			proto.coorsys = coorsys;
-			if (coorsys == 0) {
+			proto.coorsys = plan_->SlewCoorsys(); // 计划与指向的坐标系编号不同
+			if (proto.coorsys == COORSYS_EQUA) {
 				proto.ra    = plan_->ra;
 				proto.dec   = plan_->dec;
 				proto.epoch = plan_->epoch;
 			}
-			else if (coorsys == 1) {
+			else if (proto.coorsys == COORSYS_ALTAZ) {
 				proto.azi = plan_->azi;
 				proto.ele = plan_->ele;
 			}
@@ -807,30 +961,32 @@ void ObservationSystem::process_new_plan() {
 		mountInfo_.objdec = plan_->dec;
 	}
 	// 通知相机: 观测计划描述信息; 立即开始曝光
-	string cmd = plan_->ToString();
-	write2camera(cmd.c_str(), cmd.size());
+	write2camera(*plan_);
 	if (!slew_req) expose2camera(EXP_START);
 	// 更新计划状态
 	plan_state_->UpdateUTC();
 	plan_state_->plan_sn = plan_->plan_sn;
 	plan_state_->tm_start = plan_state_->utc;
 	plan_state_->state = OBSPLAN_RUNNING;
-	cbfPlan_(plan_state_);
+	cbfPlan_(plan_state_, KVAppPlanPtr());
 }
 
 void ObservationSystem::tcp_receive(TcpClient* cliptr, boost::system::error_code ec, int peer_type) {
-	PostMessage(!ec ? MSG_TCP_RECEIVE : MSG_TCP_CLOSE, (const long) cliptr, peer_type);
+	PostMessage(!ec ? MSG_TCP_RECEIVE : MSG_TCP_CLOSE,
+		MessageData<TcpCPtr>::Create(cliptr->shared_from_this()), peer_type);
 }
 
 // 关闭相机TCP连接
-void ObservationSystem::on_tcp_close(const long connptr, const long peer_type) {
-	TcpClient *ptrTcp = (TcpClient*) connptr;
+void ObservationSystem::on_tcp_close(MsgPayloadPtr& payload, const long peer_type, const long) {
+	TcpCPtr* conn = MessageData<TcpCPtr>::Get(payload);
+	if (!conn) return;
+	const TcpCPtr& ptrTcp = *conn;
 	if (peer_type == PEER_CAMERA_GFT || peer_type == PEER_CAMERA_GWAC) {
 		for (auto it = camInfoVec_.begin(); it != camInfoVec_.end(); ++it) {
-			if ((*it).ptrTcp.get() == ptrTcp) {
+			if ((*it).ptrTcp == ptrTcp) {
 				_gLog.Write("Camera<%s:%s:%s> is off-line", gid_.c_str(), uid_.c_str(),
 					(*it).info.cid.c_str());
-				if ((*it).info.state > CAMCTL_IDLE) sysState_.LeaveExpose();
+				if ((*it).info.state > CAMCTL_IDLE && sysState_.LeaveExpose()) notify_plan_event();
 				sysState_.CameraOnline(false);
 				(*it).info.state = CAMCTL_ERROR;
 				(*it).info.errcode = 1;
@@ -847,31 +1003,26 @@ void ObservationSystem::on_tcp_close(const long connptr, const long peer_type) {
 }
 
 // 接收到相机TCP信息
-void ObservationSystem::on_tcp_receive(const long connptr, const long peer_type) {
+void ObservationSystem::on_tcp_receive(MsgPayloadPtr& payload, const long peer_type, const long) {
 	const char term[] = "\n"; // 结束符
 	const int len = strlen(term); // 结束符长度
-	char buff[TCP_PACK_SIZE];
-	int pos, to_read;
-	TcpClient* ptrTcp = (TcpClient*) connptr;
+	TcpCPtr* conn = MessageData<TcpCPtr>::Get(payload);
+	if (!conn) return;
+	const TcpCPtr& ptrTcp = *conn;
 
-	while ((pos = ptrTcp->Lookup(term, len)) >= 0) {
-		if ((to_read = pos + len) > TCP_PACK_SIZE) {// 信息长度超过预设最大值
-			_gLog.Write(LOG_FAULT, "protocol length from camera is over than threshold");
+	auto handler = [&](std::string_view frame) -> bool {
+		KVBasePtr proto = kvproto_.Resolve(frame.data());
+		if (proto.unique()) process_protocol_camera(ptrTcp, proto);
+		else {
+			_gLog.Write(LOG_FAULT, "undefined protocol from camera");
 			ptrTcp->Close();
 		}
-		else {
-			ptrTcp->Read(buff, pos + len);
-			buff[pos] = '\0';
+		return ptrTcp->IsOpen();
+	};
 
-			KVBasePtr proto = kvproto_.Resolve(buff);
-			if (proto.unique()) {
-				process_protocol_camera(ptrTcp, proto);
-			}
-			else {
-				_gLog.Write(LOG_FAULT, "undefined protocol from camera");
-				ptrTcp->Close();
-			}
-		}
+	if (ptrTcp->DrainFrames(term, len, handler) < 0) {// 信息长度超过预设最大值
+		_gLog.Write(LOG_FAULT, "protocol length from camera is over than threshold");
+		ptrTcp->Close();
 	}
 }
 
@@ -880,25 +1031,77 @@ void ObservationSystem::on_flat_reslew(const long, const long) {
 
 }
 
+// 更新计划队列, 检查抢占和启动条件并启动计划
+void ObservationSystem::on_check_plan(const long event_us, const long) {
+	std::vector<KVAppPlanPtr> expired;
+	planQueue_.Refresh(second_clock::universal_time(), expired);
+	for (auto it = expired.begin(); it != expired.end(); ++it) {
+		_gLog.Write(LOG_WARN, "plan<%s> is abandoned for its end time <%s>",
+			(*it)->plan_sn.c_str(), (*it)->plan_end.c_str());
+		report_plan(*it, OBSPLAN_ABANDONED);
+	}
+	set_wakeup(planQueue_.NextBegin());
+
+	KVAppPlanPtr top = planQueue_.Top();
+	if (!top) return; // 无可执行计划
+	if (plan_) {// 抢占: 优先级较低的计划回到队列. 相机结束曝光后再次触发
+		if (top->priority <= plan_->priority) return;
+		_gLog.Write("plan<%s> preempts plan<%s>", top->plan_sn.c_str(), plan_->plan_sn.c_str());
+		preempt_plan();
+	}
+	if (!tcpMount_.use_count())  return;  // 转台: 掉线
+	if (!sysState_.camonline)    return;  // 相机: 掉线
+	if (sysState_.AnyExposing()) return;  // 任一相机仍在曝光
+
+	using namespace boost::chrono;
+	PlanQueue::Item item;
+	if (!planQueue_.Pop(item)) return;
+	plan_ = item.plan;
+	planItem_ = item;
+	steady_clock::time_point now = steady_clock::now();
+	process_new_plan();
+	_gLog.Write("plan<%s> starts %.1f ms after cataloged, %.3f ms after device event",
+		plan_->plan_sn.c_str(),
+		duration<double, boost::milli>(now - item.tmCataloged).count(),
+		(duration_cast<boost::chrono::microseconds>(now.time_since_epoch()).count() - event_us) * 1E-3);
+	// 截止时间: 计划结束时间之后, 再宽限一个曝光时间
+	ptime tmend(not_a_date_time);
+	try {
+		tmend = from_iso_extended_string(plan_->plan_end) + millisec(int64_t(plan_->exptime * 1000.0) + 1000);
+	}
+	catch(...) {
+	}
+	set_deadline(tmend);
+}
+
+// 计划超出截止时间
+void ObservationSystem::on_plan_deadline(const long, const long) {
+	if (plan_ && plan_state_->state == OBSPLAN_RUNNING) {
+		_gLog.Write(LOG_WARN, "plan<%s> is over its end time <%s>",
+			plan_->plan_sn.c_str(), plan_->plan_end.c_str());
+		Abort();
+	}
+}
+
 // 处理图像协议: 相机
-void ObservationSystem::process_protocol_camera(TcpClient* cliptr, KVBasePtr proto) {
+void ObservationSystem::process_protocol_camera(const TcpCPtr& client, KVBasePtr proto) {
 	// 解析通信协议
 	int state_new(CAMCTL_ERROR), state_old(CAMCTL_ERROR);
 	KVCamPtr camera;
 	KVCamSetPtr camset;
-	if (iequals(proto->type, KVTYPE_CAMERA)) {
+	if (proto->typeId == KVID_CAMERA) {
 		camera = boost::static_pointer_cast<KVCamera>(proto);
 		state_new = camera->state;
 	}
-	else if (iequals(proto->type, KVTYPE_CAMSET)) {
+	else if (proto->typeId == KVID_CAMSET) {
 		camset = boost::static_pointer_cast<KVCamSet>(proto);
 	}
 	// 更新相机状态
 	for (auto it = camInfoVec_.begin(); it != camInfoVec_.end(); ++it) {
-		if ((*it).ptrTcp.get() == cliptr) {
+		if ((*it).ptrTcp == client) {
 			if (camera.use_count()) {
 				state_old = (*it).info.state;
-				(*it).info = *camera;
+				kv_swap((*it).info, *camera, KVCamera::Fields()); // 交换而非复制
 			}
 			else if (camset.use_count()) {
 			}
@@ -909,16 +1112,18 @@ void ObservationSystem::process_protocol_camera(TcpClient* cliptr, KVBasePtr pro
 	// 检查相机工作状态
 	if (state_new != state_old) {
 		if (state_new <= CAMCTL_IDLE && state_old > CAMCTL_IDLE) {
-			if (sysState_.LeaveExpose() && plan_.unique()) {// 更新计划状态
-				if (plan_.unique()) {// 清理计划
+			if (sysState_.LeaveExpose()) {// 全部相机结束曝光
+				// 结束执行中的计划. 待执行计划在曝光结束后启动
+				if (plan_ && plan_state_->state == OBSPLAN_RUNNING) {// 清理计划
 					_gLog.Write("plan<%s> is over", plan_->plan_sn.c_str());
 					plan_.reset();
 					// 更新计划状态
 					plan_state_->UpdateUTC();
 					plan_state_->tm_stop = plan_state_->utc;
 					plan_state_->state = OBSPLAN_OVER;
-					cbfPlan_(plan_state_);
+					cbfPlan_(plan_state_, KVAppPlanPtr());
 				}
+				notify_plan_event();
 			}
 		}
 		else if (state_new > CAMCTL_IDLE && state_old <= CAMCTL_IDLE) sysState_.EnterExpose();
@@ -936,53 +1141,56 @@ void ObservationSystem::process_protocol_camera(TcpClient* cliptr, KVBasePtr pro
 // 将指定协议发送给相机
 void ObservationSystem::write2camera(const char* cmd, int n, const char* cid) {
 	bool empty = !cid || iequals(cid, "");
+	TcpBufPtr buf; // 各相机共享同一缓冲区
 	for (auto it = camInfoVec_.begin(); it != camInfoVec_.end(); ++it) {
 		if ((*it).ptrTcp.use_count()
 				&& (empty || iequals((*it).info.cid, cid))) {
-			(*it).ptrTcp->Write(cmd, n);
+			if (!buf) buf = boost::make_shared<const string>(cmd, n);
+			(*it).ptrTcp->Write(buf);
 			if (!empty) break;
 		}
 	}
 }
 
+// 编码协议并发送给相机
+void ObservationSystem::write2camera(const KVBase& proto, const char* cid) {
+	OutBuffer& out = OutBuffer::Local();
+	proto.AppendTo(out);
+	write2camera(out.Data(), out.Size(), cid);
+}
+
 // 将指定曝光协议发送给相机
 void ObservationSystem::expose2camera(int cmd, int frmno, const char* cid) {
 	KVExpose proto;
 	proto.command = cmd;
 	proto.frmno = frmno;
-	string output = proto.ToString();
-	write2camera(output.c_str(), output.size(), cid);
+	write2camera(proto, cid);
 }
 
-// 线程: 监测观测计划
-void ObservationSystem::thread_obsplan() {
-	boost::mutex mtx;
-	MtxLck lck(mtx);
-	boost::chrono::seconds period(10);
-	ptime tmend(not_a_date_time); // 计划结束时间
+// 线程: 计划定时事件. 执行中计划的截止时间; 待执行计划的开始时间
+void ObservationSystem::thread_timer() {
+	MtxLck lck(mtxTimer_);
 
 	while (1) {
-		cvNewPlan_.wait_for(lck, period);
-		if (!plan_.unique()) continue;  // 无计划
-
-		if (plan_state_->state == OBSPLAN_CATALOGED) {// 检查条件并启动计划
-			if (!tcpMount_.use_count())  continue;  // 转台; 掉线
-			if (!sysState_.camonline)    continue;  // 相机: 掉线
-			if (sysState_.AnyExposing()) continue;  // 任一相机仍在曝光
-			process_new_plan();
-			try {
-				tmend = from_iso_extended_string(plan_->plan_end);
+		ptime tm = tmDeadline_;
+		if (tm.is_special() || (!tmWakeup_.is_special() && tmWakeup_ < tm)) tm = tmWakeup_;
+		if (tm.is_special()) cvTimer_.wait(lck);
+		else {
+			ptime now = microsec_clock::universal_time();
+			if (now < tm) {
+				cvTimer_.wait_for(lck, boost::chrono::milliseconds((tm - now).total_milliseconds() + 1));
 			}
-			catch(...) {
-				tmend = ptime(not_a_date_time);
+			else {// 在锁外投递消息: 消息线程会调用set_deadline()/set_wakeup()
+				bool deadline = !tmDeadline_.is_special() && tmDeadline_ <= now;
+				bool wakeup   = !tmWakeup_.is_special() && tmWakeup_ <= now;
+				if (deadline) tmDeadline_ = ptime(not_a_date_time);
+				if (wakeup)   tmWakeup_ = ptime(not_a_date_time);
+				lck.unlock();
+				if (deadline) PostMessage(MSG_PLAN_DEADLINE);
+				if (wakeup)   notify_plan_event();
+				lck.lock();
 			}
 		}
-		else if (plan_state_->state == OBSPLAN_RUNNING
-				&& !tmend.is_special()) {// 检查条件并结束计划
-			ptime now = second_clock::universal_time();
-			int over_secs = (now - tmend).total_seconds();
-			if (over_secs > plan_->exptime) Abort();
-		}
 	}
 }
 
@@ -22,6 +22,7 @@
 #include "KVProtocol.h"
 #include "NonKVProtocol.h"
 #include "ATimeSpace.h"
+#include "PlanQueue.h"
 
 class ObservationSystem : public MessageQueue {
 public:
@@ -56,8 +57,9 @@ public:
 	/*!
 	 * @brief 声明回调函数及插槽: 观测计划状态
 	 * @param 1 观测计划状态
+	 * @param 2 观测计划. 仅在计划入库时有效, 用于记录计划日志
 	 */
-	typedef boost::signals2::signal<void (KVPlanPtr)> PlanCBF;
+	typedef boost::signals2::signal<void (KVPlanPtr, KVAppPlanPtr)> PlanCBF;
 	typedef PlanCBF::slot_type PlanCBSlot;
 
 private:
@@ -187,8 +189,9 @@ private:
 	CameraInfoVector camInfoVec_;	///< 相机集成接口
 	TcpCPtr tcpFocus_;	///< TCP连接: 调焦
 
-	KVAppPlanPtr plan_;			///< 观测计划
-	// KVAppPlanPtr plan_wait_;	///< 观测计划: 待执行
+	KVAppPlanPtr plan_;			///< 观测计划: 执行中
+	PlanQueue::Item planItem_;	///< 执行中计划的入队信息, 被抢占时据此重新入队
+	PlanQueue planQueue_;		///< 观测计划: 待执行
 	KVPlanPtr plan_state_;	///< 观测计划状态
 	PlanCBF cbfPlan_;		///< 回调函数: 观测计划状态
 
@@ -196,8 +199,11 @@ private:
 	int oldDay_ = 0;	///< UTC日期
 	int planSN_ = 0;	///< 自定义计划序号
 
-	Thread thrdObsplan_;	///< 线程: 监测观测计划
-	boost::condition_variable cvNewPlan_;	///< 事件: 在线程中启动观测计划
+	boost::mutex mtxTimer_;	///< 互斥锁: 计划定时事件
+	boost::condition_variable cvTimer_;	///< 事件: 计划定时事件变更
+	boost::posix_time::ptime tmDeadline_;	///< 执行中计划的截止时间. 超出后中断计划
+	boost::posix_time::ptime tmWakeup_;		///< 待执行计划的最早开始时间
+	Thread thrdTimer_;	///< 线程: 计划定时事件
 
 	boost::posix_time::ptime lastClosed_;	///< 设备最后断开时间
 
@@ -233,12 +239,34 @@ public:
 	 * 匹配一致则返回true, 否则返回false
 	 */
 	bool IsMatched(const string& gid, const string& uid);
+	// 查看组标志
+	const string& GetGid();
+	// 查看单元标志
+	const string& GetUid();
 	// 查看转台状态
 	const KVMount& GetInfoMount();
 	// 查看相机状态
 	const CameraInfoVector& GetInfoCamera();
 	// 注册回调函数: 观测计划状态
 	void RegisterPlanCallback(const PlanCBSlot& slot);
+	/*!
+	 * @brief 评估在本系统中执行观测计划的代价
+	 * @param plan  观测计划
+	 * @param slew  转台从当前位置指向计划位置的距离, 角度
+	 * @return
+	 * 系统能否执行计划. false: 计划类型不符, 或转台、相机脱机
+	 */
+	bool EvaluatePlan(const KVAppPlan& plan, double& slew);
+	/*!
+	 * @brief 检查计划类型是否与系统类型一致
+	 * @return
+	 * GWAC系统只接受赤道坐标的计划; 后随系统不接受append_gwac
+	 */
+	bool AcceptPlan(const KVAppPlan& plan);
+	/*!
+	 * @brief 查看负载: 执行中与待执行的计划数量, 手动曝光计为1
+	 */
+	int PlanLoad();
 	/**
 	 * @brief 计算当前时间与设备最后关闭时间的差异
 	 * @param now  当前UTC时间
@@ -302,6 +330,8 @@ public:
 public:
 	// 通知: 观测计划
 	void NotifyPlan(KVBasePtr proto);
+	// 通知;观测计划: 批量保存新计划, 只触发一次启动检查
+	void NotifyPlan(const std::vector<KVAppPlanPtr>& plans);
 	// 通知: 检查计划状态
 	KVPlanPtr CheckPlan(const string& plan_sn);
 	// 通知: 删除计划
@@ -343,34 +373,80 @@ private:
 		MSG_TCP_CLOSE = MSG_USER,
 		MSG_TCP_RECEIVE,
 		MSG_FLAT_RESLEW,
+		MSG_CHECK_PLAN,
+		MSG_PLAN_DEADLINE,
 		MSG_MAX
 	};
 	/*!
 	 * @brief 注册消息响应函数
 	 */
 	void register_messages();
-	// 关闭TCP连接
-	void on_tcp_close(const long connptr, const long peer_type);
-	// 接收到TCP信息
-	void on_tcp_receive(const long connptr, const long peer_type);
+	// 关闭TCP连接. 载荷: TcpCPtr
+	void on_tcp_close(MsgPayloadPtr& payload, const long peer_type, const long);
+	// 接收到TCP信息. 载荷: TcpCPtr
+	void on_tcp_receive(MsgPayloadPtr& payload, const long peer_type, const long);
 	// 平场: 重新指向
 	void on_flat_reslew(const long, const long);
+	// 更新计划队列, 检查抢占和启动条件并启动计划. 参数1: 触发事件的时间, 微秒
+	void on_check_plan(const long event_us, const long);
+	// 计划超出截止时间
+	void on_plan_deadline(const long, const long);
 
 private:
+	/*!
+	 * @brief 设备或计划事件: 触发检查计划启动条件
+	 * @note
+	 * 转台联机、相机联机、曝光结束、新计划及计划到达开始时间时调用, 在消息线程中启动计划
+	 */
+	void notify_plan_event();
+	/*!
+	 * @brief 设置执行中计划的截止时间
+	 * @param tm 截止时间. not_a_date_time: 无截止时间
+	 */
+	void set_deadline(const boost::posix_time::ptime& tm);
+	/*!
+	 * @brief 设置待执行计划的最早开始时间
+	 * @param tm 开始时间. not_a_date_time: 无等待开始的计划
+	 */
+	void set_wakeup(const boost::posix_time::ptime& tm);
+	/*!
+	 * @brief 计划入队, 并通知计划状态
+	 * @return
+	 * 计划是否入队. false: 计划已过期
+	 */
+	bool catalog_plan(const KVAppPlanPtr& plan);
+	/*!
+	 * @brief 通知未执行计划的状态
+	 */
+	void report_plan(const KVAppPlanPtr& plan, int state);
+	/*!
+	 * @brief 生成自定义计划编号
+	 * @note
+	 * 跳过队列中已有的编号, 如重启后恢复的计划
+	 */
+	string new_plan_sn();
 	// 启动执行观测计划
 	void process_new_plan();
+	// 中断转台指向和相机曝光
+	void abort_devices();
+	/*!
+	 * @brief 抢占: 中断执行中的计划, 并将其按原入队序号放回队列
+	 */
+	void preempt_plan();
 	// 收到网络信息: 相机/后随转台
 	void tcp_receive(TcpClient* cliptr, boost::system::error_code ec, int peer_type);
 	// 处理图像协议: 相机
-	void process_protocol_camera(TcpClient* cliptr, KVBasePtr proto);
+	void process_protocol_camera(const TcpCPtr& client, KVBasePtr proto);
 	// 将指定协议发送给相机
 	void write2camera(const char* cmd, int n, const char* cid = NULL);
+	// 编码协议并发送给相机
+	void write2camera(const KVBase& proto, const char* cid = NULL);
 	// 将指定曝光协议发送给相机
 	void expose2camera(int cmd, int frmno = 0, const char* cid = NULL);
 
 private:
-	// 线程: 监测观测计划
-	void thread_obsplan();
+	// 线程: 计划定时事件
+	void thread_timer();
 	// 线程: 重发
 	void thread_rewrite();
 };
@@ -17,12 +17,21 @@ bool Parameter::Init(const string& filepath) {
 	ptNet.add("FocusGWAC.<xmlattr>.port",  portFocusGWAC);
 	ptNet.add("MountGFT.<xmlattr>.port",   portMountGFT);
 	ptNet.add("CameraGFT.<xmlattr>.port",  portCameraGFT);
+	ptNet.add("IOThread.<xmlattr>.count",  ioThreads);
+	ptNet.add("ClientQueue.<xmlattr>.high",   clientQueueHigh);
+	ptNet.add("ClientQueue.<xmlattr>.low",    clientQueueLow);
+	ptNet.add("ClientQueue.<xmlattr>.policy", clientQueuePolicy);
+	ptNet.add("Capture.<xmlattr>.path", capturePath);
 
 	ptree& ptSite = pt.add("GeoSite", "");
 	ptSite.add("<xmlattr>.name", siteName);
 	ptSite.add("Coords.<xmlattr>.lon", siteLon);
 	ptSite.add("Coords.<xmlattr>.lat", siteLat);
 	ptSite.add("Coords.<xmlattr>.alt", siteAlt);
+	ptSite.add("Horizon.<xmlattr>.minEle", minEle);
+
+	ptree& ptPlan = pt.add("Plan", "");
+	ptPlan.add("Journal.<xmlattr>.path", planJournal);
 
 	xml_writer_settings<std::string> settings(' ', 4);
 	try {
@@ -47,11 +56,18 @@ bool Parameter::Load(const string& filepath) {
 		portFocusGWAC  = pt.get("Network.FocusGWAC.<xmlattr>.port",  5013);
 		portMountGFT   = pt.get("Network.MountGFT.<xmlattr>.port",   5014);
 		portCameraGFT  = pt.get("Network.CameraGFT.<xmlattr>.port",  5015);
+		ioThreads      = pt.get("Network.IOThread.<xmlattr>.count",  0);
+		clientQueueHigh   = pt.get("Network.ClientQueue.<xmlattr>.high",   49152);
+		clientQueueLow    = pt.get("Network.ClientQueue.<xmlattr>.low",    16384);
+		clientQueuePolicy = pt.get("Network.ClientQueue.<xmlattr>.policy", "coalesce");
+		capturePath       = pt.get("Network.Capture.<xmlattr>.path", "");
 
 		siteName = pt.get("GeoSite.<xmlattr>.name", "");
 		siteLon  = pt.get("GeoSite.Coords.<xmlattr>.lon", 120);
 		siteLat  = pt.get("GeoSite.Coords.<xmlattr>.lat", 40);
 		siteAlt  = pt.get("GeoSite.Coords.<xmlattr>.alt", 900);
+		minEle   = pt.get("GeoSite.Horizon.<xmlattr>.minEle", 20.0);
+		planJournal = pt.get("Plan.Journal.<xmlattr>.path", "/var/lib/gtoaes/plan.journal");
 
 		return true;
 	}
@@ -72,12 +88,21 @@ bool Parameter::Save(const string& filepath) {
 	ptNet.add("FocusGWAC.<xmlattr>.port",  portFocusGWAC);
 	ptNet.add("MountGFT.<xmlattr>.port",   portMountGFT);
 	ptNet.add("CameraGFT.<xmlattr>.port",  portCameraGFT);
+	ptNet.add("IOThread.<xmlattr>.count",  ioThreads);
+	ptNet.add("ClientQueue.<xmlattr>.high",   clientQueueHigh);
+	ptNet.add("ClientQueue.<xmlattr>.low",    clientQueueLow);
+	ptNet.add("ClientQueue.<xmlattr>.policy", clientQueuePolicy);
+	ptNet.add("Capture.<xmlattr>.path", capturePath);
 
 	ptree& ptSite = pt.add("GeoSite", "");
 	ptSite.add("<xmlattr>.name", siteName);
 	ptSite.add("Coords.<xmlattr>.lon", siteLon);
 	ptSite.add("Coords.<xmlattr>.lat", siteLat);
 	ptSite.add("Coords.<xmlattr>.alt", siteAlt);
+	ptSite.add("Horizon.<xmlattr>.minEle", minEle);
+
+	ptree& ptPlan = pt.add("Plan", "");
+	ptPlan.add("Journal.<xmlattr>.path", planJournal);
 
 	xml_writer_settings<std::string> settings(' ', 4);
 	try {
@@ -25,12 +25,21 @@ struct Parameter
 	int portFocusGWAC   = 5013;	//< 调焦, GWAC
 	int portMountGFT    = 5014; //< 后随望远镜
 	int portCameraGFT   = 5015; //< 相机, 后随望远镜
+	int ioThreads       = 0;	//< 网络I/O线程数量. <=0: CPU核数
+	// 客户端发送队列: 水位及拥塞策略
+	int clientQueueHigh = 49152;	//< 高水位, 字节
+	int clientQueueLow  = 16384;	//< 低水位, 字节
+	string clientQueuePolicy = "coalesce";	//< 拥塞策略: drop_oldest, coalesce, disconnect
+	string capturePath  = "";	//< 接收数据捕获文件, 用于离线回放. 空: 不捕获
 
 	// 测站位置
 	string siteName = "Xinglong";	//< 名称
 	double siteLon  = 117.57454;	//< 地理经度, 角度, 东经为正
 	double siteLat  = 40.39593;		//< 地理纬度, 角度, 北纬为正
 	double siteAlt  = 900;			//< 海拔, 米
+	double minEle   = 20.0;			//< 调度观测计划时的最低高度角, 角度
+	// 观测计划
+	string planJournal = "/var/lib/gtoaes/plan.journal";	//< 计划日志文件, 用于重启后恢复计划. 空: 不记录
 
 public:
 	// 初始化配置参数
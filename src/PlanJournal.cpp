@@ -0,0 +1,288 @@
+/**
+ * @file PlanJournal.cpp 观测计划日志: 重启后恢复待执行计划
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/filesystem.hpp>
+#include "PlanJournal.h"
+#include "GLog.h"
+
+using namespace boost::chrono;
+namespace fs = boost::filesystem;
+
+PlanJournal::PlanJournal() {
+	fd_ = -1;
+	seq_ = 0;
+	records_ = 0;
+}
+
+PlanJournal::~PlanJournal() {
+	Stop();
+}
+
+bool PlanJournal::Start(const string& filepath) {
+	steady_clock::time_point tmStart = steady_clock::now();
+	boost::system::error_code ec;
+	fs::path path(filepath);
+
+	filepath_ = filepath;
+	if (path.has_parent_path()) fs::create_directories(path.parent_path(), ec);
+	if ((fd_ = open(filepath_.c_str(), O_RDWR | O_CREAT, 0644)) < 0) {
+		_gLog.Write(LOG_WARN, "failed to open plan journal <%s>: %s", filepath_.c_str(), strerror(errno));
+		return false;
+	}
+	// 截断异常退出时未写完的记录, 此后追加写入
+	size_t size = replay();
+	if (ftruncate(fd_, off_t(size)) || lseek(fd_, 0, SEEK_END) < 0) {
+		_gLog.Write(LOG_WARN, "failed to truncate plan journal <%s>: %s", filepath_.c_str(), strerror(errno));
+		close(fd_);
+		fd_ = -1;
+		return false;
+	}
+	_gLog.Write("plan journal <%s>: %d plans are recovered from %d records in %.1f ms",
+		filepath_.c_str(), int(live_.size()), int(records_),
+		duration_cast<microseconds>(steady_clock::now() - tmStart).count() * 1E-3);
+	if (records_ >= COMPACT_MIN && records_ > COMPACT_RATIO * live_.size()) compact();
+	thrdWrite_ = Thread(boost::bind(&PlanJournal::thread_write, this));
+	return true;
+}
+
+void PlanJournal::Stop() {
+	if (fd_ < 0) return;
+	interrupt_thread(thrdWrite_);
+	string data;
+	{
+		MtxLck lck(mtx_);
+		data.swap(pending_);
+	}
+	if (data.size()) write_sync(data);
+	close(fd_);
+	fd_ = -1;
+}
+
+void PlanJournal::Catalog(const KVAppPlanPtr& plan) {
+	if (fd_ < 0) return;
+	string key = plan_key(plan->gid, plan->uid, plan->plan_sn);
+	OutBuffer& out = OutBuffer::Local();
+	plan->AppendTo(out);
+
+	MtxLck lck(mtx_);
+	EntryMap::iterator it = live_.find(key);
+	if (it != live_.end() && it->second.plan == plan) {// 取回的计划重新入库
+		if (it->second.state == OBSPLAN_CATALOGED) return;
+		it->second.state = OBSPLAN_CATALOGED;
+		KVPlan state;
+		state.UpdateUTC();
+		state.gid = plan->gid;
+		state.uid = plan->uid;
+		state.plan_sn = plan->plan_sn;
+		state.state = OBSPLAN_CATALOGED;
+		out.Clear();
+		state.AppendTo(out);
+	}
+	else {
+		Entry& entry = live_[key];
+		entry.plan  = plan;
+		entry.state = OBSPLAN_CATALOGED;
+		entry.seq   = ++seq_;
+	}
+	pending_.append(out.Data(), out.Size());
+	++records_;
+	if (pending_.size() == out.Size()) cv_.notify_one();
+}
+
+void PlanJournal::Update(const KVPlan& state) {
+	if (fd_ < 0 || state.state == OBSPLAN_CATALOGED) return; // 入库由Catalog()记录
+	string key = plan_key(state.gid, state.uid, state.plan_sn);
+
+	MtxLck lck(mtx_);
+	EntryMap::iterator it = live_.find(key);
+	if (it == live_.end() || it->second.state == state.state) return;
+	if (plan_over(state.state)) live_.erase(it);
+	else it->second.state = state.state;
+	OutBuffer& out = OutBuffer::Local();
+	state.AppendTo(out);
+	pending_.append(out.Data(), out.Size());
+	++records_;
+	if (pending_.size() == out.Size()) cv_.notify_one();
+}
+
+void PlanJournal::Restore(const string& gid, const string& uid, std::vector<KVAppPlanPtr>& plans) {
+	std::vector<const Entry*> entries;
+	MtxLck lck(mtx_);
+	for (EntryMap::const_iterator it = live_.begin(); it != live_.end(); ++it) {
+		const KVAppPlan& plan = *it->second.plan;
+		if (boost::iequals(plan.gid, gid) && boost::iequals(plan.uid, uid)) entries.push_back(&it->second);
+	}
+	std::sort(entries.begin(), entries.end(), [](const Entry* a, const Entry* b) { return a->seq < b->seq; });
+	plans.reserve(plans.size() + entries.size());
+	for (auto it = entries.begin(); it != entries.end(); ++it) plans.push_back((*it)->plan);
+}
+
+string PlanJournal::plan_key(const string& gid, const string& uid, const string& plan_sn) {
+	string key;
+	key.reserve(gid.size() + uid.size() + plan_sn.size() + 2);
+	key.append(gid).append(1, ':').append(uid).append(1, ':').append(plan_sn);
+	for (string::iterator it = key.begin(); it != key.end(); ++it) *it = tolower(*it);
+	return key;
+}
+
+bool PlanJournal::plan_over(int state) {
+	return state == OBSPLAN_OVER || state == OBSPLAN_INTERRUPTED
+		|| state == OBSPLAN_ABANDONED || state == OBSPLAN_DELETED;
+}
+
+size_t PlanJournal::replay() {
+	struct stat st;
+	if (fstat(fd_, &st) || !st.st_size) return 0;
+	// 一次读入, 以'\0'替换换行符后原位解析
+	string data(size_t(st.st_size), '\0');
+	size_t n(0);
+	ssize_t rd;
+	while (n < data.size() && (rd = pread(fd_, &data[n], data.size() - n, off_t(n))) > 0) n += rd;
+	data.resize(n);
+	live_.reserve(std::count(data.begin(), data.end(), '\n'));
+
+	size_t pos(0), end;
+	for (; (end = data.find('\n', pos)) != string::npos; pos = end + 1) {
+		data[end] = '\0';
+		++records_;
+		KVBasePtr proto = kvproto_.Resolve(data.c_str() + pos);
+		if (!proto.use_count()) continue;
+		if (proto->typeId == KVID_APPPLAN || proto->typeId == KVID_APPGWAC) {
+			KVAppPlanPtr plan = boost::static_pointer_cast<KVAppPlan>(proto);
+			Entry& entry = live_[plan_key(plan->gid, plan->uid, plan->plan_sn)];
+			entry.plan  = plan;
+			entry.state = OBSPLAN_CATALOGED;
+			entry.seq   = ++seq_;
+		}
+		else if (proto->typeId == KVID_PLAN) {
+			KVPlanPtr state = boost::static_pointer_cast<KVPlan>(proto);
+			EntryMap::iterator it = live_.find(plan_key(state->gid, state->uid, state->plan_sn));
+			if (it == live_.end()) continue;
+			if (plan_over(state->state)) live_.erase(it);
+			else it->second.state = state->state;
+		}
+	}
+	if (pos < data.size()) {
+		_gLog.Write(LOG_WARN, "plan journal <%s>: %d bytes of incomplete record are discarded",
+			filepath_.c_str(), int(data.size() - pos));
+	}
+	return pos;
+}
+
+bool PlanJournal::compact() {
+	std::vector<Entry> entries;
+	string tail; // 已包含在未结束计划中的待写入记录. 重写失败时追加至原日志
+	size_t before; // 重写前的记录数
+	{
+		MtxLck lck(mtx_);
+		before = records_;
+		entries.reserve(live_.size());
+		for (EntryMap::const_iterator it = live_.begin(); it != live_.end(); ++it) entries.push_back(it->second);
+		tail.swap(pending_);
+	}
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.seq < b.seq; });
+
+	OutBuffer& out = OutBuffer::Local();
+	string data;
+	size_t records(0);
+	KVPlan state;
+	for (auto it = entries.begin(); it != entries.end(); ++it) {
+		out.Clear();
+		it->plan->AppendTo(out);
+		data.append(out.Data(), out.Size());
+		++records;
+		if (it->state != OBSPLAN_CATALOGED) {// 执行中
+			state.UpdateUTC();
+			state.gid = it->plan->gid;
+			state.uid = it->plan->uid;
+			state.plan_sn = it->plan->plan_sn;
+			state.state = it->state;
+			out.Clear();
+			state.AppendTo(out);
+			data.append(out.Data(), out.Size());
+			++records;
+		}
+	}
+
+	// 写入临时文件后替换原日志
+	string tmppath = filepath_ + ".tmp";
+	int fd = open(tmppath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	bool success = fd >= 0;
+	for (size_t n(0); success && n < data.size(); ) {
+		ssize_t wr = write(fd, data.data() + n, data.size() - n);
+		if (wr < 0 && errno != EINTR) success = false;
+		else if (wr > 0) n += wr;
+	}
+	if (success) success = !fdatasync(fd);
+	if (fd >= 0) close(fd);
+	if (success) success = !rename(tmppath.c_str(), filepath_.c_str());
+	if (success) success = (fd = open(filepath_.c_str(), O_WRONLY | O_APPEND)) >= 0;
+	if (!success) {
+		_gLog.Write(LOG_WARN, "failed to compact plan journal <%s>: %s", filepath_.c_str(), strerror(errno));
+		unlink(tmppath.c_str());
+		if (tail.size()) write_sync(tail);
+		return false;
+	}
+	// 同步目录项, 确保替换后的日志在断电后有效
+	fs::path dir = fs::path(filepath_).parent_path();
+	int fddir = open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+	if (fddir >= 0) {
+		fsync(fddir);
+		close(fddir);
+	}
+	close(fd_);
+	fd_ = fd;
+	_gLog.Write("plan journal <%s> is compacted from %d to %d records",
+		filepath_.c_str(), int(before), int(records));
+	MtxLck lck(mtx_);
+	records_ = records + (records_ - before); // 重写期间的新记录待写入新日志
+	return true;
+}
+
+bool PlanJournal::write_sync(const string& data) {
+	for (size_t n(0); n < data.size(); ) {
+		ssize_t wr = write(fd_, data.data() + n, data.size() - n);
+		if (wr > 0) n += wr;
+		else if (wr < 0 && errno != EINTR) {
+			_gLog.Write(LOG_WARN, "failed to write plan journal <%s>: %s", filepath_.c_str(), strerror(errno));
+			return false;
+		}
+	}
+	if (fdatasync(fd_)) {
+		_gLog.Write(LOG_WARN, "failed to sync plan journal <%s>: %s", filepath_.c_str(), strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+void PlanJournal::thread_write() {
+	boost::chrono::milliseconds period(50); // 合并周期50毫秒
+	bool compacting;
+	string data;
+
+	while (1) {
+		{
+			MtxLck lck(mtx_);
+			while (pending_.empty()) cv_.wait(lck);
+		}
+		boost::this_thread::sleep_for(period);
+		{
+			MtxLck lck(mtx_);
+			data.swap(pending_);
+			compacting = records_ >= COMPACT_MIN && records_ > COMPACT_RATIO * live_.size();
+		}
+		write_sync(data);
+		data.clear();
+		if (compacting) compact();
+	}
+}
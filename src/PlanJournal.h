@@ -0,0 +1,117 @@
+/**
+ * @file PlanJournal.h 观测计划日志: 重启后恢复待执行计划
+ * @brief
+ * - 只追加写入入库计划和计划状态变更, 由独立线程合并写入并同步到磁盘, 不阻塞调度流程
+ * - 记录采用通信协议格式, 每行一条: 入库计划为append_plan/append_gwac, 状态变更为plan
+ * - 在内存中维护未结束计划. 计划完成、中断、抛弃或删除后, 不再恢复
+ * - 记录数远多于未结束计划时, 以未结束计划重写日志
+ * - 观测系统创建时, 取回该系统的未结束计划并重新入队. 重启时执行中的计划重新入队
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#ifndef PLAN_JOURNAL_H
+#define PLAN_JOURNAL_H
+
+#include <string>
+#include <vector>
+#include <boost/unordered_map.hpp>
+#include "BoostInclude.h"
+#include "KVProtocol.h"
+
+using std::string;
+
+class PlanJournal {
+protected:
+	/*!
+	 * @brief 未结束计划
+	 */
+	struct Entry {
+		KVAppPlanPtr plan;	///< 观测计划
+		int state;			///< 最新状态
+		uint64_t seq;		///< 入库序号, 用于恢复入库顺序
+	};
+	typedef boost::unordered_map<string, Entry> EntryMap;
+
+	enum {
+		COMPACT_MIN   = 10000,	///< 重写日志的最少记录数
+		COMPACT_RATIO = 4		///< 重写日志的记录数与未结束计划数之比
+	};
+
+protected:
+	string filepath_;	///< 日志文件路径
+	int fd_;			///< 日志文件描述符. -1: 未启用
+	KVProtocol kvproto_;	///< 解析日志记录
+
+	boost::mutex mtx_;	///< 互斥锁: 未结束计划和待写入记录
+	boost::condition_variable cv_;	///< 事件: 新的待写入记录
+	EntryMap live_;		///< 未结束计划. 键值: gid:uid:plan_sn, 小写
+	uint64_t seq_;		///< 入库序号
+	string pending_;	///< 待写入记录
+	size_t records_;	///< 日志记录数
+	Thread thrdWrite_;	///< 线程: 写入日志
+
+public:
+	PlanJournal();
+	virtual ~PlanJournal();
+	/*!
+	 * @brief 打开日志并恢复未结束计划, 启动写入线程
+	 * @param filepath  日志文件路径. 目录不存在时创建
+	 * @return
+	 * 操作结果. false: 无法打开日志, 不记录计划
+	 */
+	bool Start(const string& filepath);
+	/*!
+	 * @brief 写入剩余记录并关闭日志
+	 */
+	void Stop();
+	/*!
+	 * @brief 记录入库计划
+	 * @param plan  观测计划
+	 * @note
+	 * Restore()取回的计划重新入库时不再重复记录
+	 */
+	void Catalog(const KVAppPlanPtr& plan);
+	/*!
+	 * @brief 记录计划状态变更. 只记录未结束计划
+	 */
+	void Update(const KVPlan& state);
+	/*!
+	 * @brief 取回观测系统的未结束计划
+	 * @param gid    组标志
+	 * @param uid    单元标志
+	 * @param plans  按入库顺序排列的观测计划
+	 */
+	void Restore(const string& gid, const string& uid, std::vector<KVAppPlanPtr>& plans);
+
+protected:
+	/*!
+	 * @brief 计算计划键值
+	 */
+	static string plan_key(const string& gid, const string& uid, const string& plan_sn);
+	/*!
+	 * @brief 计划状态是否为结束状态
+	 */
+	static bool plan_over(int state);
+	/*!
+	 * @brief 读取日志, 重建未结束计划
+	 * @return
+	 * 最后一条完整记录的结束位置. 其后为异常退出时未写完的记录
+	 */
+	size_t replay();
+	/*!
+	 * @brief 以未结束计划重写日志
+	 * @return
+	 * 操作结果
+	 */
+	bool compact();
+	/*!
+	 * @brief 写入数据并同步到磁盘
+	 */
+	bool write_sync(const string& data);
+	/*!
+	 * @brief 线程: 合并写入待写入记录
+	 */
+	void thread_write();
+};
+
+#endif
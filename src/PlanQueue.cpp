@@ -0,0 +1,132 @@
+/**
+ * @file PlanQueue.cpp 观测计划队列: 按优先级调度, 支持延时启动和过期
+ */
+
+#include <boost/algorithm/string.hpp>
+#include "PlanQueue.h"
+
+using namespace boost::posix_time;
+
+/*!
+ * @brief 解析计划时间
+ * @return
+ * UTC时间. 空或格式错误时返回not_a_date_time
+ */
+static ptime plan_time(const string& str) {
+	if (str.empty()) return ptime(not_a_date_time);
+	try {
+		return from_iso_extended_string(str);
+	}
+	catch(...) {
+		return ptime(not_a_date_time);
+	}
+}
+
+bool PlanQueue::Push(const KVAppPlanPtr& plan, const ptime& now) {
+	Item item;
+	item.plan  = plan;
+	item.begin = plan_time(plan->plan_begin);
+	item.end   = plan_time(plan->plan_end);
+	if (!item.end.is_special() && item.end <= now) return false;
+	item.tmCataloged = boost::chrono::steady_clock::now();
+
+	MtxLck lck(mtx_);
+	string key = boost::to_lower_copy(plan->plan_sn);
+	HandleMap::iterator it = index_.find(key);
+	if (it != index_.end()) erase(it);
+
+	item.seq = ++seq_;
+	Handle handle;
+	handle.deferred = !item.begin.is_special() && item.begin > now;
+	if (handle.deferred) handle.wait = deferred_.push(item);
+	else handle.ready = ready_.push(item);
+	index_[key] = handle;
+	return true;
+}
+
+bool PlanQueue::Restore(const Item& item, const ptime& now) {
+	if (!item.end.is_special() && item.end <= now) return false;
+
+	MtxLck lck(mtx_);
+	string key = boost::to_lower_copy(item.plan->plan_sn);
+	HandleMap::iterator it = index_.find(key);
+	if (it != index_.end()) erase(it);
+
+	Handle handle;
+	handle.deferred = !item.begin.is_special() && item.begin > now;
+	if (handle.deferred) handle.wait = deferred_.push(item);
+	else handle.ready = ready_.push(item);
+	index_[key] = handle;
+	return true;
+}
+
+bool PlanQueue::Remove(const string& plan_sn) {
+	MtxLck lck(mtx_);
+	HandleMap::iterator it = index_.find(boost::to_lower_copy(plan_sn));
+	if (it == index_.end()) return false;
+	erase(it);
+	return true;
+}
+
+void PlanQueue::Clear(std::vector<KVAppPlanPtr>& removed) {
+	MtxLck lck(mtx_);
+	for (auto it = ready_.ordered_begin(); it != ready_.ordered_end(); ++it) removed.push_back(it->plan);
+	for (auto it = deferred_.ordered_begin(); it != deferred_.ordered_end(); ++it) removed.push_back(it->plan);
+	ready_.clear();
+	deferred_.clear();
+	index_.clear();
+}
+
+KVAppPlanPtr PlanQueue::Find(const string& plan_sn) const {
+	MtxLck lck(mtx_);
+	HandleMap::const_iterator it = index_.find(boost::to_lower_copy(plan_sn));
+	if (it == index_.end()) return KVAppPlanPtr();
+	return it->second.deferred ? (*it->second.wait).plan : (*it->second.ready).plan;
+}
+
+void PlanQueue::Refresh(const ptime& now, std::vector<KVAppPlanPtr>& expired) {
+	MtxLck lck(mtx_);
+	while (!deferred_.empty() && deferred_.top().begin <= now) {// 到达开始时间
+		Item item = deferred_.top();
+		deferred_.pop();
+		Handle& handle = index_[boost::to_lower_copy(item.plan->plan_sn)];
+		handle.deferred = false;
+		handle.ready = ready_.push(item);
+	}
+	// 抛弃过期计划. 过期计划不在堆顶时保留至其到达堆顶或被删除
+	while (!ready_.empty() && !ready_.top().end.is_special() && ready_.top().end <= now) {
+		expired.push_back(ready_.top().plan);
+		index_.erase(boost::to_lower_copy(ready_.top().plan->plan_sn));
+		ready_.pop();
+	}
+}
+
+KVAppPlanPtr PlanQueue::Top() const {
+	MtxLck lck(mtx_);
+	return ready_.empty() ? KVAppPlanPtr() : ready_.top().plan;
+}
+
+bool PlanQueue::Pop(Item& item) {
+	MtxLck lck(mtx_);
+	if (ready_.empty()) return false;
+	item = ready_.top();
+	index_.erase(boost::to_lower_copy(item.plan->plan_sn));
+	ready_.pop();
+	return true;
+}
+
+ptime PlanQueue::NextBegin() const {
+	MtxLck lck(mtx_);
+	return deferred_.empty() ? ptime(not_a_date_time) : deferred_.top().begin;
+}
+
+size_t PlanQueue::Size() const {
+	MtxLck lck(mtx_);
+	return index_.size();
+}
+
+void PlanQueue::erase(HandleMap::iterator it) {
+	if (it->second.deferred) deferred_.erase(it->second.wait);
+	else ready_.erase(it->second.ready);
+	index_.erase(it);
+}
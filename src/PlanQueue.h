@@ -0,0 +1,142 @@
+/**
+ * @file PlanQueue.h 观测计划队列: 按优先级调度, 支持延时启动和过期
+ * @brief
+ * - 可执行计划按优先级排序, 优先级相同时先入先出
+ * - plan_begin晚于当前时间的计划按开始时间排序, 到时后转入可执行队列
+ * - plan_end早于当前时间的计划在取出时被抛弃
+ * - 以plan_sn索引队列句柄: 查找O(1), 入队、删除和取出O(log n)
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#ifndef PLAN_QUEUE_H
+#define PLAN_QUEUE_H
+
+#include <string>
+#include <vector>
+#include <boost/chrono/chrono.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/heap/d_ary_heap.hpp>
+#include <boost/unordered_map.hpp>
+#include "BoostInclude.h"
+#include "ProtoKV.h"
+
+class PlanQueue {
+public:
+	/*!
+	 * @brief 队列中的计划
+	 */
+	struct Item {
+		KVAppPlanPtr plan;	///< 观测计划
+		boost::posix_time::ptime begin;	///< 开始时间. not_a_date_time: 立即
+		boost::posix_time::ptime end;	///< 结束时间. not_a_date_time: 不过期
+		boost::chrono::steady_clock::time_point tmCataloged;	///< 入队时间
+		uint64_t seq = 0;	///< 入队序号
+	};
+
+protected:
+	struct ByPriority {// 堆顶: 优先级最高, 其次入队最早
+		bool operator()(const Item& a, const Item& b) const {
+			return a.plan->priority != b.plan->priority ? a.plan->priority < b.plan->priority : a.seq > b.seq;
+		}
+	};
+
+	struct ByBegin {// 堆顶: 开始时间最早, 其次入队最早
+		bool operator()(const Item& a, const Item& b) const {
+			return a.begin != b.begin ? a.begin > b.begin : a.seq > b.seq;
+		}
+	};
+
+	typedef boost::heap::d_ary_heap<Item, boost::heap::arity<4>, boost::heap::mutable_<true>,
+		boost::heap::compare<ByPriority> > ReadyHeap;
+	typedef boost::heap::d_ary_heap<Item, boost::heap::arity<4>, boost::heap::mutable_<true>,
+		boost::heap::compare<ByBegin> > DeferredHeap;
+
+	struct Handle {
+		bool deferred;	///< 所在队列. true: 等待开始时间
+		ReadyHeap::handle_type ready;
+		DeferredHeap::handle_type wait;
+	};
+	typedef boost::unordered_map<string, Handle> HandleMap;
+
+protected:
+	mutable boost::mutex mtx_;	///< 互斥锁
+	ReadyHeap ready_;		///< 可执行计划
+	DeferredHeap deferred_;	///< 等待开始时间的计划
+	HandleMap index_;		///< 计划编号-句柄, 编号不区分大小写
+	uint64_t seq_ = 0;		///< 入队序号
+
+public:
+	/*!
+	 * @brief 计划入队. 编号相同的计划被替换
+	 * @param plan  观测计划
+	 * @param now   当前UTC时间
+	 * @return
+	 * 入队结果. false: 计划已过期
+	 */
+	bool Push(const KVAppPlanPtr& plan, const boost::posix_time::ptime& now);
+	/*!
+	 * @brief 取出的计划重新入队. 保留原入队序号和入队时间, 优先级相同时仍排在后入队的计划之前
+	 * @param item  Pop()取出的计划
+	 * @param now   当前UTC时间
+	 * @return
+	 * 入队结果. false: 计划已过期
+	 */
+	bool Restore(const Item& item, const boost::posix_time::ptime& now);
+	/*!
+	 * @brief 删除计划
+	 * @return
+	 * 计划是否在队列中
+	 */
+	bool Remove(const string& plan_sn);
+	/*!
+	 * @brief 清空队列
+	 * @param removed  被删除的计划
+	 */
+	void Clear(std::vector<KVAppPlanPtr>& removed);
+	/*!
+	 * @brief 查找计划
+	 * @return
+	 * 观测计划. 不在队列中时返回空指针
+	 */
+	KVAppPlanPtr Find(const string& plan_sn) const;
+	/*!
+	 * @brief 将已到开始时间的计划转入可执行队列, 并抛弃已过期的可执行计划
+	 * @param now      当前UTC时间
+	 * @param expired  被抛弃的计划
+	 */
+	void Refresh(const boost::posix_time::ptime& now, std::vector<KVAppPlanPtr>& expired);
+	/*!
+	 * @brief 查看最高优先级的可执行计划
+	 * @return
+	 * 观测计划. 无可执行计划时返回空指针
+	 * @note 调用前先调用Refresh()
+	 */
+	KVAppPlanPtr Top() const;
+	/*!
+	 * @brief 取出最高优先级的可执行计划
+	 * @param item  取出的计划
+	 * @return
+	 * 是否有可执行计划
+	 * @note 调用前先调用Refresh()
+	 */
+	bool Pop(Item& item);
+	/*!
+	 * @brief 查看最早的计划开始时间
+	 * @return
+	 * 开始时间. 无等待开始的计划时返回not_a_date_time
+	 */
+	boost::posix_time::ptime NextBegin() const;
+	/*!
+	 * @brief 查看队列中的计划数量
+	 */
+	size_t Size() const;
+
+protected:
+	/*!
+	 * @brief 从队列中删除句柄
+	 * @note 调用前须锁定mtx_
+	 */
+	void erase(HandleMap::iterator it);
+};
+
+#endif
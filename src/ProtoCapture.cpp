@@ -0,0 +1,136 @@
+/**
+ * @file ProtoCapture.cpp 捕获网络接收数据, 用于离线回放
+ */
+
+#include <string.h>
+#include <sys/time.h>
+#include "ProtoCapture.h"
+
+using namespace boost::chrono;
+
+static const char CAPTURE_MAGIC[] = "GTOACAP1";	// 文件魔数, 8字节
+
+/*!
+ * @brief 以小端字节序编码整数
+ */
+static uint8_t* put_le(uint8_t* ptr, uint64_t val, int n) {
+	for (int i = 0; i < n; ++i, val >>= 8) *ptr++ = uint8_t(val);
+	return ptr;
+}
+
+/*!
+ * @brief 以小端字节序解码整数
+ */
+static uint64_t get_le(const uint8_t* ptr, int n) {
+	uint64_t val(0);
+	for (int i = n - 1; i >= 0; --i) val = (val << 8) | ptr[i];
+	return val;
+}
+
+/////////////////////////////////////////////////////////////////////
+ProtoCapture::ProtoCapture(FILE* fp) {
+	fp_ = fp;
+	connSeq_ = 0;
+	tmStart_ = tmFlush_ = steady_clock::now();
+	setvbuf(fp_, NULL, _IOFBF, 1024 * 1024);
+}
+
+ProtoCapture::~ProtoCapture() {
+	if (fp_) fclose(fp_);
+}
+
+ProtoCapture::Pointer ProtoCapture::Create(const string& filepath) {
+	FILE* fp = fopen(filepath.c_str(), "wb");
+	if (!fp) return Pointer();
+
+	struct timeval tv;
+	uint8_t head[HEAD_SIZE];
+	gettimeofday(&tv, NULL);
+	memcpy(head, CAPTURE_MAGIC, 8);
+	put_le(head + 8, uint64_t(tv.tv_sec) * 1000000 + tv.tv_usec, 8);
+	if (fwrite(head, HEAD_SIZE, 1, fp) != 1) {
+		fclose(fp);
+		return Pointer();
+	}
+	return Pointer(new ProtoCapture(fp));
+}
+
+uint32_t ProtoCapture::Open(int peer) {
+	uint32_t conn = ++connSeq_;
+	MtxLck lck(mtx_);
+	write(conn, peer, CAPEVT_OPEN, NULL, 0);
+	return conn;
+}
+
+void ProtoCapture::Data(uint32_t conn, int peer, const char* data, int n) {
+	if (!data || n <= 0) return;
+	MtxLck lck(mtx_);
+	write(conn, peer, CAPEVT_DATA, data, n);
+	if (steady_clock::now() - tmFlush_ >= seconds(1)) {// 限制异常退出时丢失的数据
+		fflush(fp_);
+		tmFlush_ = steady_clock::now();
+	}
+}
+
+void ProtoCapture::Close(uint32_t conn, int peer) {
+	MtxLck lck(mtx_);
+	write(conn, peer, CAPEVT_CLOSE, NULL, 0);
+	fflush(fp_);
+	tmFlush_ = steady_clock::now();
+}
+
+void ProtoCapture::Flush() {
+	MtxLck lck(mtx_);
+	fflush(fp_);
+	tmFlush_ = steady_clock::now();
+}
+
+void ProtoCapture::write(uint32_t conn, int peer, int event, const char* data, int n) {
+	uint8_t head[RECORD_SIZE];
+	uint8_t* ptr = head;
+	uint64_t usec = duration_cast<microseconds>(steady_clock::now() - tmStart_).count();
+
+	ptr = put_le(ptr, usec, 8);
+	ptr = put_le(ptr, conn, 4);
+	ptr = put_le(ptr, n, 4);
+	*ptr++ = uint8_t(peer);
+	*ptr++ = uint8_t(event);
+	fwrite(head, RECORD_SIZE, 1, fp_);
+	if (n > 0) fwrite(data, n, 1, fp_);
+}
+
+/////////////////////////////////////////////////////////////////////
+CaptureReader::CaptureReader() {
+	fp_ = NULL;
+	utc_ = 0;
+}
+
+CaptureReader::~CaptureReader() {
+	if (fp_) fclose(fp_);
+}
+
+bool CaptureReader::Open(const string& filepath) {
+	uint8_t head[ProtoCapture::HEAD_SIZE];
+	if (fp_) fclose(fp_);
+	if (!(fp_ = fopen(filepath.c_str(), "rb"))) return false;
+	if (fread(head, sizeof(head), 1, fp_) != 1 || memcmp(head, CAPTURE_MAGIC, 8)) {
+		fclose(fp_);
+		fp_ = NULL;
+		return false;
+	}
+	utc_ = get_le(head + 8, 8);
+	return true;
+}
+
+bool CaptureReader::Next(ProtoCapture::Record& rec, string& data) {
+	uint8_t head[ProtoCapture::RECORD_SIZE];
+	if (!fp_ || fread(head, sizeof(head), 1, fp_) != 1) return false;
+
+	rec.usec   = get_le(head, 8);
+	rec.conn   = uint32_t(get_le(head + 8, 4));
+	rec.length = uint32_t(get_le(head + 12, 4));
+	rec.peer   = head[16];
+	rec.event  = head[17];
+	data.resize(rec.length);
+	return !rec.length || fread(&data[0], rec.length, 1, fp_) == 1;
+}
@@ -0,0 +1,130 @@
+/**
+ * @file ProtoCapture.h 捕获网络接收数据, 用于离线回放
+ * @brief
+ * - 在TcpClient接收路径上按连接记录接收时刻、终端类型和原始数据
+ * - 每条记录对应一次接收, 可能包含多条或不完整的信息. 回放时按原样发送, 分帧与现场一致
+ * - 由配置参数Network.Capture启用, 缺省关闭
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * 文件格式, 小端字节序:
+ * - 文件头: 魔数"GTOACAP1"(8字节), 捕获开始时的UTC时间(8字节, 微秒)
+ * - 记录: 相对时间(8字节, 微秒), 连接序号(4字节), 数据长度(4字节), 终端类型(1字节),
+ *   记录类型(1字节), 数据
+ */
+#ifndef PROTO_CAPTURE_H
+#define PROTO_CAPTURE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <boost/atomic.hpp>
+#include <boost/chrono/chrono.hpp>
+#include "BoostInclude.h"
+
+using std::string;
+
+class ProtoCapture {
+public:
+	typedef boost::shared_ptr<ProtoCapture> Pointer;
+	/*!
+	 * @brief 记录类型
+	 */
+	enum {
+		CAPEVT_OPEN,	///< 建立连接
+		CAPEVT_DATA,	///< 接收数据
+		CAPEVT_CLOSE	///< 断开连接
+	};
+	enum {
+		HEAD_SIZE   = 16,	///< 文件头长度
+		RECORD_SIZE = 18	///< 记录头长度
+	};
+	/*!
+	 * @brief 记录头
+	 */
+	struct Record {
+		uint64_t usec;	///< 相对于捕获开始的时间, 微秒
+		uint32_t conn;	///< 连接序号, 由1开始
+		uint32_t length;///< 数据长度
+		uint8_t peer;	///< 终端类型, PEER_*
+		uint8_t event;	///< 记录类型, CAPEVT_*
+	};
+
+protected:
+	FILE* fp_;		///< 捕获文件
+	boost::mutex mtx_;	///< 互斥锁: 写入文件
+	boost::atomic<uint32_t> connSeq_;	///< 连接序号
+	boost::chrono::steady_clock::time_point tmStart_;	///< 捕获开始时间
+	boost::chrono::steady_clock::time_point tmFlush_;	///< 最后一次刷新文件的时间
+
+public:
+	virtual ~ProtoCapture();
+	/*!
+	 * @brief 创建捕获文件
+	 * @param filepath  文件路径. 已存在时被覆盖
+	 * @return
+	 * 实例指针. 无法创建文件时返回空指针
+	 */
+	static Pointer Create(const string& filepath);
+	/*!
+	 * @brief 记录建立连接
+	 * @param peer  终端类型
+	 * @return
+	 * 连接序号
+	 */
+	uint32_t Open(int peer);
+	/*!
+	 * @brief 记录接收数据
+	 */
+	void Data(uint32_t conn, int peer, const char* data, int n);
+	/*!
+	 * @brief 记录断开连接
+	 */
+	void Close(uint32_t conn, int peer);
+	/*!
+	 * @brief 将缓冲区写入文件
+	 */
+	void Flush();
+
+protected:
+	ProtoCapture(FILE* fp);
+	/*!
+	 * @brief 写入一条记录
+	 * @note 调用前须锁定mtx_
+	 */
+	void write(uint32_t conn, int peer, int event, const char* data, int n);
+};
+typedef ProtoCapture::Pointer ProtoCapPtr;
+
+/**
+ * @brief 顺序读取捕获文件
+ */
+class CaptureReader {
+protected:
+	FILE* fp_;		///< 捕获文件
+	uint64_t utc_;	///< 捕获开始时的UTC时间, 微秒
+
+public:
+	CaptureReader();
+	virtual ~CaptureReader();
+	/*!
+	 * @brief 打开捕获文件并校验文件头
+	 */
+	bool Open(const string& filepath);
+	/*!
+	 * @brief 读取下一条记录
+	 * @param rec   记录头
+	 * @param data  数据
+	 * @return
+	 * 读取结果. false: 文件结束或记录不完整
+	 */
+	bool Next(ProtoCapture::Record& rec, string& data);
+	/*!
+	 * @brief 查看捕获开始时的UTC时间, 微秒
+	 */
+	uint64_t StartUTC() const {
+		return utc_;
+	}
+};
+
+#endif
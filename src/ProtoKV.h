@@ -16,6 +16,7 @@
 
 #define KVTYPE_APPGWAC     "append_gwac"    ///< 追加GWAC观测计划
 #define KVTYPE_APPPLAN     "append_plan"    ///< 追加观测计划
+#define KVTYPE_APPBATCH    "append_batch"   ///< 批量追加观测计划
 #define KVTYPE_CHKPLAN     "check_plan"     ///< 查询观测计划
 #define KVTYPE_RMVPLAN     "remove_plan"    ///< 删除观测计划. 若未执行, 则删除; 在执行, 中断后删除
 #define KVTYPE_PLAN        "plan"           ///< 计划状态
@@ -88,7 +89,7 @@ struct KVAppPlan : public KVBase
     string plan_sn;     ///< 计划编号
     string objid;       ///< 目标名称
 	string obstype; 	///< 计划类型
-    int    coorsys = 0; ///< 0: 赤道/赤经赤纬; 1: 赤道/时角赤纬
+    int    coorsys = 0; ///< 0: 赤道/赤经赤纬; 1: 地平/方位俯仰; 其它: TLE
     double ra = 0;      ///< 赤经/时角, 角度
     double dec= 0;      ///< 赤纬, 角度
     double epoch= 2000; ///< 历元. 0.0=当前历元
@@ -126,44 +127,106 @@ struct KVAppPlan : public KVBase
 public:
     KVAppPlan() {
 		type = KVTYPE_APPPLAN;
+		typeId = KVID_APPPLAN;
 	}
 
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        if (plan_sn.size()) ss << join_kv("plan_sn", plan_sn);
-        if (objid.size())   ss << join_kv("objid", objid);
-		if (obstype.size()) ss << join_kv("obstype",  obstype);
-        ss << join_kv("coor_sys", coorsys);
-		if (coorsys == 0) {
-	        ss << join_kv("ra",    ra);
-	        ss << join_kv("dec",   dec);
-	        ss << join_kv("epoch", epoch);
-		}
-		else if (coorsys == 1) {
-	        ss << join_kv("azi",   azi);
-	        ss << join_kv("ele",   ele);
-		}
-		else {
-	        ss << join_kv("tle1",   tle1);
-	        ss << join_kv("tle2",   tle2);
-		}
-        ss << join_kv("imgtype",  imgtype);
-		if (filter.size()) ss << join_kv("filter", filter);
-        ss << join_kv("exptime",  exptime);
-        ss << join_kv("delay",    delay);
-        ss << join_kv("frmcnt",   frmcnt);
-        ss << join_kv("loopcnt",  loopcnt);
-        ss << join_kv("priority", priority);
-        if (plan_begin.size()) ss << join_kv("plan_beg", plan_begin);
-        if (plan_end.size())   ss << join_kv("plan_end", plan_end);
+    static const auto& Fields() {
+        typedef KVField<KVAppPlan> F;
+        constexpr auto equa = [](const KVAppPlan& x) { return x.coorsys == 0; };
+        constexpr auto altaz = [](const KVAppPlan& x) { return x.coorsys == 1; };
+        constexpr auto orbit = [](const KVAppPlan& x) { return x.coorsys != 0 && x.coorsys != 1; };
+        static constexpr auto table = kv_fields<KVAppPlan>({
+            F("plan_sn",  &KVAppPlan::plan_sn).Optional(),
+            F("objid",    &KVAppPlan::objid).Optional(),
+            F("obstype",  &KVAppPlan::obstype).Optional(),
+            F("coor_sys", &KVAppPlan::coorsys),
+            F("ra",       &KVAppPlan::ra).When(equa),
+            F("dec",      &KVAppPlan::dec).When(equa),
+            F("epoch",    &KVAppPlan::epoch).Alias("ecoch").When(equa),
+            F("azi",      &KVAppPlan::azi).When(altaz),
+            F("ele",      &KVAppPlan::ele).When(altaz),
+            F("tle1",     &KVAppPlan::tle1).When(orbit),
+            F("tle2",     &KVAppPlan::tle2).When(orbit),
+            F("imgtype",  &KVAppPlan::imgtype),
+            F("filter",   &KVAppPlan::filter).Optional(),
+            F("exptime",  &KVAppPlan::exptime),
+            F("delay",    &KVAppPlan::delay),
+            F("frmcnt",   &KVAppPlan::frmcnt),
+            F("loopcnt",  &KVAppPlan::loopcnt),
+            F("priority", &KVAppPlan::priority),
+            F("plan_beg", &KVAppPlan::plan_begin).Optional(),
+            F("plan_end", &KVAppPlan::plan_end).Optional()
+        });
+        return table;
+    }
+
+    /*!
+     * @brief 计划是否采用赤道坐标
+     */
+    bool EquatorialCoord() const {
+        return coorsys == 0;
+    }
+
+    /*!
+     * @brief 计划是否采用地平坐标
+     */
+    bool HorizonCoord() const {
+        return coorsys == 1;
+    }
+
+    /*!
+     * @brief 计划是否采用TLE
+     */
+    bool OrbitCoord() const {
+        return coorsys != 0 && coorsys != 1;
+    }
+
+    /*!
+     * @brief 转换为转台指向的坐标系编号COORSYS_*
+     */
+    int SlewCoorsys() const {
+        return EquatorialCoord() ? COORSYS_EQUA : (HorizonCoord() ? COORSYS_ALTAZ : COORSYS_ORBIT);
+    }
 
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
         for (KVVec::const_iterator it = kvs.begin(); it != kvs.end(); ++it) {
-            ss << join_kv(it->keyword, it->value);
+            kv_append(out, it->keyword.c_str(), it->value);
         }
+        out.Append('\n');
+    }
+};
+
+/**
+ * @brief 批量追加观测计划
+ * @note
+ * - 各计划以'&'分隔, 键值对与append_plan相同, 各自携带gid和uid
+ * - 未指定uid的计划由服务器调度
+ * - 单帧长度受接收缓冲区限制, 大量计划分多帧发送
+ */
+struct KVAppBatch : public KVBase {
+    std::vector<boost::shared_ptr<KVAppPlan> > plans; ///< 观测计划
 
-        ss << std::endl;
-        return ss.str();
+public:
+    KVAppBatch() {
+        type = KVTYPE_APPBATCH;
+        typeId = KVID_APPBATCH;
+    }
+
+    void AppendTo(OutBuffer& out) const {
+        const auto& table = KVAppPlan::Fields();
+        out.Append(type).Append(' ');
+        for (auto it = plans.begin(); it != plans.end(); ++it) {
+            const KVAppPlan& plan = **it;
+            if (it != plans.begin()) out.Append('&');
+            if (plan.gid.size()) kv_append(out, "gid", plan.gid);
+            if (plan.uid.size()) kv_append(out, "uid", plan.uid);
+            for (auto field = table.begin(); field != table.end(); ++field) field->Encode(plan, out);
+            for (KVVec::const_iterator kv = plan.kvs.begin(); kv != plan.kvs.end(); ++kv) {
+                kv_append(out, kv->keyword.c_str(), kv->value);
+            }
+        }
+        out.Append('\n');
     }
 };
 
@@ -176,14 +239,20 @@ struct KVCheckPlan : public KVBase {
 public:
     KVCheckPlan() {
         type = KVTYPE_CHKPLAN;
+        typeId = KVID_CHKPLAN;
+    }
+
+    static const auto& Fields() {
+        typedef KVField<KVCheckPlan> F;
+        static constexpr auto table = kv_fields<KVCheckPlan>({
+            F("plan_sn", &KVCheckPlan::plan_sn).Optional()
+        });
+        return table;
     }
 
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        if (plan_sn.size()) ss << join_kv("plan_sn", plan_sn);
-        ss << std::endl;
-        return ss.str();
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
+        out.Append('\n');
     }
 };
 
@@ -193,14 +262,20 @@ struct KVRemovePlan : public KVBase {
 public:
     KVRemovePlan() {
         type = KVTYPE_RMVPLAN;
+        typeId = KVID_RMVPLAN;
+    }
+
+    static const auto& Fields() {
+        typedef KVField<KVRemovePlan> F;
+        static constexpr auto table = kv_fields<KVRemovePlan>({
+            F("plan_sn", &KVRemovePlan::plan_sn).Optional()
+        });
+        return table;
     }
 
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        if (plan_sn.size()) ss << join_kv("plan_sn", plan_sn);
-        ss << std::endl;
-        return ss.str();
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
+        out.Append('\n');
     }
 };
 
@@ -216,17 +291,23 @@ struct KVPlan : public KVBase {
 public:
     KVPlan() {
         type = KVTYPE_PLAN;
+        typeId = KVID_PLAN;
     }
 
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        if (plan_sn.size())  ss << join_kv("plan_sn",  plan_sn);
-        if (tm_start.size()) ss << join_kv("tm_start", tm_start);
-        if (tm_stop.size())  ss << join_kv("tm_stop",  tm_stop);
-        ss << join_kv("state", state);
-        ss << std::endl;
-        return ss.str();
+    static const auto& Fields() {
+        typedef KVField<KVPlan> F;
+        static constexpr auto table = kv_fields<KVPlan>({
+            F("plan_sn",  &KVPlan::plan_sn).Optional(),
+            F("tm_start", &KVPlan::tm_start).Optional(),
+            F("tm_stop",  &KVPlan::tm_stop).Optional(),
+            F("state",    &KVPlan::state)
+        });
+        return table;
+    }
+
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
+        out.Append('\n');
     }
 };
 
@@ -241,13 +322,7 @@ struct KVAbort : public KVBase {
 public:
     KVAbort() {
         type = KVTYPE_ABORT;
-    }
-
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << std::endl;
-        return ss.str();
+        typeId = KVID_ABORT;
     }
 };
 
@@ -264,16 +339,22 @@ struct KVOBSS : public KVBase {
 public:
     KVOBSS() {
         type = KVTYPE_OBSS;
+        typeId = KVID_OBSS;
+    }
+
+    static const auto& Fields() {
+        typedef KVField<KVOBSS> F;
+        static constexpr auto table = kv_fields<KVOBSS>({
+            F("state",  &KVOBSS::state),
+            F("mount",  &KVOBSS::mount),
+            F("camera", &KVOBSS::camera)
+        });
+        return table;
     }
 
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << join_kv("state",  state);
-        ss << join_kv("mount",  mount);
-        ss << join_kv("camera", camera);
-        ss << std::endl;
-        return ss.str();
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
+        out.Append('\n');
     }
 };
 
@@ -283,40 +364,43 @@ public:
  * @brief 控制转台指向位置并在到达位置后转入跟踪或静止
  */
 struct KVSlewto : public KVBase {
-    int    coorsys;     ///< 0: 赤道; 1: 地平; 2: TLE
-    double ra;          ///< 赤经, 角度
-    double dec;         ///< 赤纬, 角度
-    double epoch;       ///< 历元. 0.0=当前历元
-    double azi;         ///< 方位角, 角度, 南零点
-    double ele;         ///< 俯仰角, 角度
+    int    coorsys;     ///< COORSYS_*. 0: 地平; 1: 赤道; 2: TLE
+    double ra    = 0;   ///< 赤经, 角度
+    double dec   = 0;   ///< 赤纬, 角度
+    double epoch = 2000;///< 历元. 0.0=当前历元
+    double azi   = 0;   ///< 方位角, 角度, 南零点
+    double ele   = 0;   ///< 俯仰角, 角度
     string tle1;        ///< 第一行TLE根数
     string tle2;        ///< 第二行TLE根数
 
 public:
     KVSlewto() {
         type = KVTYPE_SLEWTO;
+        typeId = KVID_SLEWTO;
         coorsys   = 0;
     }
 
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << join_kv("coorsys", coorsys);
-        if (coorsys == COORSYS_EQUA) {
-            ss << join_kv("ra",    ra);
-            ss << join_kv("dec",   dec);
-            ss << join_kv("epoch", epoch);
-        }
-        else if (coorsys == COORSYS_ALTAZ) {
-            ss << join_kv("azi",  azi);
-            ss << join_kv("ele",  ele);
-        }
-        else {
-            ss << join_kv("tle1", tle1);
-            ss << join_kv("tle2", tle2);
-        }
-        ss << std::endl;
-        return ss.str();
+    static const auto& Fields() {
+        typedef KVField<KVSlewto> F;
+        constexpr auto equa = [](const KVSlewto& x) { return x.coorsys == COORSYS_EQUA; };
+        constexpr auto altaz = [](const KVSlewto& x) { return x.coorsys == COORSYS_ALTAZ; };
+        constexpr auto orbit = [](const KVSlewto& x) { return x.coorsys != COORSYS_EQUA && x.coorsys != COORSYS_ALTAZ; };
+        static constexpr auto table = kv_fields<KVSlewto>({
+            F("coorsys", &KVSlewto::coorsys).Alias("coor_sys"),
+            F("ra",      &KVSlewto::ra).When(equa),
+            F("dec",     &KVSlewto::dec).When(equa),
+            F("epoch",   &KVSlewto::epoch).Alias("ecoch").When(equa),
+            F("azi",     &KVSlewto::azi).When(altaz),
+            F("ele",     &KVSlewto::ele).When(altaz),
+            F("tle1",    &KVSlewto::tle1).When(orbit),
+            F("tle2",    &KVSlewto::tle2).When(orbit)
+        });
+        return table;
+    }
+
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
+        out.Append('\n');
     }
 };
 
@@ -327,13 +411,7 @@ struct KVPark : public KVBase {
 public:
     KVPark() {
         type = KVTYPE_PARK;
-    }
-
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << std::endl;
-        return ss.str();
+        typeId = KVID_PARK;
     }
 };
 
@@ -349,19 +427,24 @@ struct KVGuide : public KVBase {
 public:
     KVGuide() {
         type = KVTYPE_GUIDE;
+        typeId = KVID_GUIDE;
+    }
+
+    static const auto& Fields() {
+        typedef KVField<KVGuide> F;
+        constexpr auto offset = [](const KVGuide& x) { return x.ra != 0 || x.dec != 0; };
+        static constexpr auto table = kv_fields<KVGuide>({
+            F("result", &KVGuide::result),
+            F("op",     &KVGuide::op),
+            F("ra",     &KVGuide::ra).When(offset),
+            F("dec",    &KVGuide::dec).When(offset)
+        });
+        return table;
     }
 
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-		ss << join_kv("result", result);
-		ss << join_kv("op",     op);
-		if (fabs(ra) > 0 || fabs(dec) > 0) {
-	        ss << join_kv("ra",     ra);
-	        ss << join_kv("dec",    dec);
-		}
-        ss << std::endl;
-        return ss.str();
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
+        out.Append('\n');
     }
 };
 
@@ -372,13 +455,7 @@ struct KVHome : public KVBase {
 public:
     KVHome() {
         type = KVTYPE_HOME;
-    }
-
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << std::endl;
-        return ss.str();
+        typeId = KVID_HOME;
     }
 };
 
@@ -393,16 +470,22 @@ struct KVSync : public KVBase {
 public:
     KVSync() {
         type = KVTYPE_SYNC;
+        typeId = KVID_SYNC;
     }
 
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << join_kv("ra",    ra);
-        ss << join_kv("dec",   dec);
-        ss << join_kv("epoch", epoch);
-        ss << std::endl;
-        return ss.str();
+    static const auto& Fields() {
+        typedef KVField<KVSync> F;
+        static constexpr auto table = kv_fields<KVSync>({
+            F("ra",    &KVSync::ra),
+            F("dec",   &KVSync::dec),
+            F("epoch", &KVSync::epoch).Alias("ecoch")
+        });
+        return table;
+    }
+
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
+        out.Append('\n');
     }
 };
 
@@ -413,14 +496,8 @@ struct KVTrack : public KVBase {
 public:
 	KVTrack() {
 		type = KVTYPE_TRACK;
+		typeId = KVID_TRACK;
 	}
-
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << std::endl;
-        return ss.str();
-    }
 };
 
 /**
@@ -433,15 +510,21 @@ struct KVTrackVel : public KVBase {
 public:
 	KVTrackVel() {
 		type = KVTYPE_TRACKVEL;
+		typeId = KVID_TRACKVEL;
 	}
 
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << join_kv("ra",      ra);
-        ss << join_kv("dec",     dec);
-        ss << std::endl;
-        return ss.str();
+    static const auto& Fields() {
+        typedef KVField<KVTrackVel> F;
+        static constexpr auto table = kv_fields<KVTrackVel>({
+            F("ra",  &KVTrackVel::ra),
+            F("dec", &KVTrackVel::dec)
+        });
+        return table;
+    }
+
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
+        out.Append('\n');
     }
 };
 
@@ -466,25 +549,31 @@ struct KVMount : public KVBase {
 public:
     KVMount() {
         type  = KVTYPE_MOUNT;
+        typeId = KVID_MOUNT;
 		state = MOUNT_ERROR;
 		errcode = 1;
     }
 
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << join_kv("state",   state);
-        ss << join_kv("errcode", errcode);
-        ss << join_kv("mjd",     mjd);
-        ss << join_kv("lst",     lst);
-        ss << join_kv("ra",      ra);
-        ss << join_kv("dec",     dec);
-        ss << join_kv("ra2k",    ra2k);
-        ss << join_kv("dec2k",   dec2k);
-        ss << join_kv("azi",     azi);
-        ss << join_kv("ele",     ele);
-        ss << std::endl;
-        return ss.str();
+    static const auto& Fields() {
+        typedef KVField<KVMount> F;
+        static constexpr auto table = kv_fields<KVMount>({
+            F("state",   &KVMount::state),
+            F("errcode", &KVMount::errcode),
+            F("mjd",     &KVMount::mjd),
+            F("lst",     &KVMount::lst),
+            F("ra",      &KVMount::ra),
+            F("dec",     &KVMount::dec),
+            F("ra2k",    &KVMount::ra2k),
+            F("dec2k",   &KVMount::dec2k),
+            F("azi",     &KVMount::azi),
+            F("ele",     &KVMount::ele)
+        });
+        return table;
+    }
+
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
+        out.Append('\n');
     }
 };
 // 转台
@@ -498,10 +587,7 @@ struct KVTakeImage : public KVAppPlan {
 public:
     KVTakeImage() {
         type = KVTYPE_TKIMG;
-    }
-
-    string ToString() const {
-        return KVAppPlan::ToString();
+        typeId = KVID_TKIMG;
     }
 };
 
@@ -516,18 +602,24 @@ struct KVExpose : public KVBase {
 public:
     KVExpose() {
         type   = KVTYPE_EXPOSE;
+        typeId = KVID_EXPOSE;
 		frmno  = 0;
 		loopno = 1;
     }
 
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << join_kv("command", command);
-		ss << join_kv("frmno",   frmno);
-		ss << join_kv("loopno",  loopno);
-        ss << std::endl;
-        return ss.str();
+    static const auto& Fields() {
+        typedef KVField<KVExpose> F;
+        static constexpr auto table = kv_fields<KVExpose>({
+            F("command", &KVExpose::command),
+            F("frmno",   &KVExpose::frmno),
+            F("loopno",  &KVExpose::loopno)
+        });
+        return table;
+    }
+
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
+        out.Append('\n');
     }
 };
 
@@ -555,32 +647,36 @@ struct KVCamSet : public KVBase {
 public:
     KVCamSet() {
         type   = KVTYPE_CAMSET;
+        typeId = KVID_CAMSET;
         opType = -1;
     }
 
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << join_kv("optype", opType);
-        if (opType) {
-            if (opType == 2) {
-                ss << join_kv("bitDepth",  bitDepth);
-                ss << join_kv("iADC",      iADC);
-                ss << join_kv("iReadPort", iReadPort);
-                ss << join_kv("iReadRate", iReadRate);
-                ss << join_kv("iVSRate",   iVSRate);
-                ss << join_kv("iGain",     iGain);
-                ss << join_kv("coolSet",   coolSet);
-            }
-            ss << join_kv("bitPixel", bitPixel);
-            ss << join_kv("ADC",      ADC);
-            ss << join_kv("readPort", readPort);
-            ss << join_kv("readRate", readRate);
-            ss << join_kv("vsRate",   vsRate);
-            ss << join_kv("gain",     gain);
-        }
-        ss << std::endl;
-        return ss.str();
+    static const auto& Fields() {
+        typedef KVField<KVCamSet> F;
+        constexpr auto modify = [](const KVCamSet& x) { return x.opType == 2; };
+        constexpr auto status = [](const KVCamSet& x) { return x.opType != 0; };
+        static constexpr auto table = kv_fields<KVCamSet>({
+            F("optype",    &KVCamSet::opType),
+            F("bitDepth",  &KVCamSet::bitDepth).When(modify),
+            F("iADC",      &KVCamSet::iADC).When(modify),
+            F("iReadPort", &KVCamSet::iReadPort).When(modify),
+            F("iReadRate", &KVCamSet::iReadRate).When(modify),
+            F("iVSRate",   &KVCamSet::iVSRate).When(modify),
+            F("iGain",     &KVCamSet::iGain).When(modify),
+            F("coolSet",   &KVCamSet::coolSet).When(modify),
+            F("bitPixel",  &KVCamSet::bitPixel).When(status),
+            F("ADC",       &KVCamSet::ADC).When(status),
+            F("readPort",  &KVCamSet::readPort).When(status),
+            F("readRate",  &KVCamSet::readRate).When(status),
+            F("vsRate",    &KVCamSet::vsRate).When(status),
+            F("gain",      &KVCamSet::gain).When(status)
+        });
+        return table;
+    }
+
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
+        out.Append('\n');
     }
 };
 
@@ -604,25 +700,31 @@ struct KVCamera : public KVBase {
 public:
     KVCamera() {
         type = KVTYPE_CAMERA;
-    }
-
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << join_kv("state",    state);
-        ss << join_kv("errcode",  errcode);
-        ss << join_kv("left",     left);
-        ss << join_kv("percent",  percent);
-        ss << join_kv("coolget",  coolget);
-        ss << join_kv("imgtype",  imgtype);
-        ss << join_kv("filter",   filter);
-        ss << join_kv("freedisk", freedisk);
-        ss << join_kv("plan_sn",  plan_sn);
-        ss << join_kv("loopno",   loopno);
-        ss << join_kv("frmno",    frmno);
-        ss << join_kv("filename", fileName);
-        ss << std::endl;
-        return ss.str();
+        typeId = KVID_CAMERA;
+    }
+
+    static const auto& Fields() {
+        typedef KVField<KVCamera> F;
+        static constexpr auto table = kv_fields<KVCamera>({
+            F("state",    &KVCamera::state),
+            F("errcode",  &KVCamera::errcode),
+            F("left",     &KVCamera::left),
+            F("percent",  &KVCamera::percent),
+            F("coolget",  &KVCamera::coolget),
+            F("imgtype",  &KVCamera::imgtype),
+            F("filter",   &KVCamera::filter),
+            F("freedisk", &KVCamera::freedisk),
+            F("plan_sn",  &KVCamera::plan_sn),
+            F("loopno",   &KVCamera::loopno),
+            F("frmno",    &KVCamera::frmno),
+            F("filename", &KVCamera::fileName)
+        });
+        return table;
+    }
+
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
+        out.Append('\n');
     }
 };
 // 相机
@@ -642,22 +744,26 @@ struct KVFocus : public KVBase {
 public:
     KVFocus() {
         type   = KVTYPE_FOCUS;
+        typeId = KVID_FOCUS;
     }
 
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << join_kv("optype", opType);
-        if (opType == 0) {
-			ss << join_kv("state",    state);
-            ss << join_kv("pos",      pos);
-            ss << join_kv("posTar",   posTar);
-        }
-        else if (opType == 1) {
-            ss << join_kv("relpos",   relPos);
-        }
-        ss << std::endl;
-        return ss.str();
+    static const auto& Fields() {
+        typedef KVField<KVFocus> F;
+        constexpr auto position = [](const KVFocus& x) { return x.opType == 0; };
+        constexpr auto control = [](const KVFocus& x) { return x.opType == 1; };
+        static constexpr auto table = kv_fields<KVFocus>({
+            F("optype", &KVFocus::opType),
+            F("state",  &KVFocus::state).When(position),
+            F("pos",    &KVFocus::pos).When(position),
+            F("posTar", &KVFocus::posTar).When(position),
+            F("relpos", &KVFocus::relPos).When(control)
+        });
+        return table;
+    }
+
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
+        out.Append('\n');
     }
 };
 
@@ -668,14 +774,8 @@ struct KVFocusSync : public KVBase {
 public:
 	KVFocusSync() {
 		type = KVTYPE_FOCUS_SYNC;
+		typeId = KVID_FOCUS_SYNC;
 	};
-
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << std::endl;
-        return ss.str();
-	}
 };
 
 struct KVFWHM : public KVBase {
@@ -685,15 +785,21 @@ struct KVFWHM : public KVBase {
 public:
     KVFWHM() {
         type = KVTYPE_FWHM;
+        typeId = KVID_FWHM;
+    }
+
+    static const auto& Fields() {
+        typedef KVField<KVFWHM> F;
+        static constexpr auto table = kv_fields<KVFWHM>({
+            F("value", &KVFWHM::value),
+            F("tmimg", &KVFWHM::tmimg)
+        });
+        return table;
     }
 
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << join_kv("value", value);
-        ss << join_kv("tmimg", tmimg);
-        ss << std::endl;
-        return ss.str();
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
+        out.Append('\n');
     }
 };
 // 调焦
@@ -710,24 +816,28 @@ struct KVDerot : public KVBase {
 public:
     KVDerot() {
         type = KVTYPE_DEROT;
+        typeId = KVID_DEROT;
         opType = -1;
         command= -1;
     }
 
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << join_kv("optype",  opType);
-        if (opType == 0) {
-            ss << join_kv("state",   state);
-            ss << join_kv("pos",     pos);
-        }
-        else if (opType == 1) {
-            ss << join_kv("command", command);
-            ss << join_kv("postar",  posTar);
-        }
-        ss << std::endl;
-        return ss.str();
+    static const auto& Fields() {
+        typedef KVField<KVDerot> F;
+        constexpr auto position = [](const KVDerot& x) { return x.opType == 0; };
+        constexpr auto control = [](const KVDerot& x) { return x.opType == 1; };
+        static constexpr auto table = kv_fields<KVDerot>({
+            F("optype",  &KVDerot::opType),
+            F("state",   &KVDerot::state).When(position),
+            F("pos",     &KVDerot::pos).When(position),
+            F("command", &KVDerot::command).When(control),
+            F("postar",  &KVDerot::posTar).When(control)
+        });
+        return table;
+    }
+
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
+        out.Append('\n');
     }
 };
 // 消旋器
@@ -746,26 +856,30 @@ struct KVDome : public KVBase {
 public:
     KVDome() {
         type = KVTYPE_DOME;
+        typeId = KVID_DOME;
         opType = -1;
         command= -1;
     }
 
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << join_kv("optype",  opType);
-        if (opType == 0) {
-            ss << join_kv("state",   state);
-            ss << join_kv("azi",     azi);
-            ss << join_kv("ele",     ele);
-        }
-        else if (opType == 1) {
-            ss << join_kv("command", command);
-        }
-        ss << join_kv("aziobj",     aziObj);
-        ss << join_kv("eleobj",     eleObj);
-        ss << std::endl;
-        return ss.str();
+    static const auto& Fields() {
+        typedef KVField<KVDome> F;
+        constexpr auto position = [](const KVDome& x) { return x.opType == 0; };
+        constexpr auto control = [](const KVDome& x) { return x.opType == 1; };
+        static constexpr auto table = kv_fields<KVDome>({
+            F("optype",  &KVDome::opType),
+            F("state",   &KVDome::state).When(position),
+            F("azi",     &KVDome::azi).When(position),
+            F("ele",     &KVDome::ele).When(position),
+            F("command", &KVDome::command).When(control),
+            F("aziobj",  &KVDome::aziObj),
+            F("eleobj",  &KVDome::eleObj)
+        });
+        return table;
+    }
+
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
+        out.Append('\n');
     }
 };
 // 圆顶
@@ -780,22 +894,26 @@ struct KVMirrCover : public KVBase {
 public:
     KVMirrCover() {
         type = KVTYPE_MCOVER;
+        typeId = KVID_MCOVER;
         opType = -1;
         command= -1;
     }
 
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << join_kv("optype",  opType);
-        if (opType == 0) {
-            ss << join_kv("state",   state);
-        }
-        else if (opType == 1) {
-            ss << join_kv("command", command);
-        }
-        ss << std::endl;
-        return ss.str();
+    static const auto& Fields() {
+        typedef KVField<KVMirrCover> F;
+        constexpr auto position = [](const KVMirrCover& x) { return x.opType == 0; };
+        constexpr auto control = [](const KVMirrCover& x) { return x.opType == 1; };
+        static constexpr auto table = kv_fields<KVMirrCover>({
+            F("optype",  &KVMirrCover::opType),
+            F("state",   &KVMirrCover::state).When(position),
+            F("command", &KVMirrCover::command).When(control)
+        });
+        return table;
+    }
+
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
+        out.Append('\n');
     }
 };
 // 镜盖
@@ -809,16 +927,22 @@ struct KVFilter : public KVBase {
 public:
     KVFilter() {
         type   = KVTYPE_FILTER;
+        typeId = KVID_FILTER;
         opType = -1;
     }
 
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << join_kv("optype", opType);
-        ss << join_kv("name",   name);
-        ss << std::endl;
-        return ss.str();
+    static const auto& Fields() {
+        typedef KVField<KVFilter> F;
+        static constexpr auto table = kv_fields<KVFilter>({
+            F("optype", &KVFilter::opType),
+            F("name",   &KVFilter::name)
+        });
+        return table;
+    }
+
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
+        out.Append('\n');
     }
 };
 // 滤光片
@@ -835,27 +959,33 @@ struct KVGeoSite : public KVBase {
 public:
     KVGeoSite() {
         type   = KVTYPE_GEOSITE;
+        typeId = KVID_GEOSITE;
         opType = -1;
     }
 
-    string ToString() const {
-        std::stringstream ss;
-        ss << KVBase::ToString();
-        ss << join_kv("optype", opType);
-        if (opType) {
-            ss << join_kv("name",   name);
-            ss << join_kv("lon",    lon);
-            ss << join_kv("lat",    lat);
-            ss << join_kv("alt",    alt);
-        }
-        ss << std::endl;
-        return ss.str();
+    static const auto& Fields() {
+        typedef KVField<KVGeoSite> F;
+        constexpr auto status = [](const KVGeoSite& x) { return x.opType != 0; };
+        static constexpr auto table = kv_fields<KVGeoSite>({
+            F("optype", &KVGeoSite::opType),
+            F("name",   &KVGeoSite::name).When(status),
+            F("lon",    &KVGeoSite::lon).When(status),
+            F("lat",    &KVGeoSite::lat).When(status),
+            F("alt",    &KVGeoSite::alt).When(status)
+        });
+        return table;
+    }
+
+    void AppendTo(OutBuffer& out) const {
+        kv_encode(*this, Fields(), out);
+        out.Append('\n');
     }
 };
 // 测站位置
 //////////////////////////////////////////////////////////////////////////////
 
 typedef boost::shared_ptr<KVAppPlan>    KVAppPlanPtr;
+typedef boost::shared_ptr<KVAppBatch>   KVAppBatchPtr;
 typedef boost::shared_ptr<KVCheckPlan>  KVChkPlanPtr;
 typedef boost::shared_ptr<KVRemovePlan> KVRmvPlanPtr;
 typedef boost::shared_ptr<KVPlan>       KVPlanPtr;
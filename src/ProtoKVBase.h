@@ -28,20 +28,18 @@
 #ifndef PROTO_KV_BASE_H
 #define PROTO_KV_BASE_H
 
+#include <stdint.h>
+#include <charconv>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
-#include <sstream>
 #include <boost/smart_ptr/shared_ptr.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include "ProtoNumber.h"
 
 using std::string;
 
-template <class T> string join_kv(const string& key, const T& val) {
-    std::stringstream ss;
-    ss << key << "=" << val << ",";
-    return ss.str();
-}
-
 /**
  * @brief 定义键-值对
  *
@@ -59,6 +57,261 @@ public:
 };
 typedef std::vector<KeyValPair> KVVec;
 
+/*!
+ * @brief 关键字散列: 大小写无关的64位FNV-1a
+ * @note
+ * - 编译期可求值, 协议类型和关键字以散列值作为switch分支
+ * - 同一switch中两个关键字散列冲突时, case重复, 编译失败
+ */
+constexpr uint64_t kv_hash(std::string_view str) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (char c : str) {
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        h = (h ^ (unsigned char) c) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/**
+ * @brief 协议类型编号, 与ProtoKV.h中KVTYPE_*一一对应
+ */
+enum KVTypeId {
+    KVID_UNKNOWN,   ///< 未知类型
+    KVID_APPGWAC,
+    KVID_APPPLAN,
+    KVID_APPBATCH,
+    KVID_CHKPLAN,
+    KVID_RMVPLAN,
+    KVID_PLAN,
+    KVID_ABORT,
+    KVID_OBSS,
+    KVID_SLEWTO,
+    KVID_PARK,
+    KVID_GUIDE,
+    KVID_HOME,
+    KVID_SYNC,
+    KVID_TRACK,
+    KVID_TRACKVEL,
+    KVID_MOUNT,
+    KVID_TKIMG,
+    KVID_EXPOSE,
+    KVID_CAMSET,
+    KVID_CAMERA,
+    KVID_FOCUS,
+    KVID_FOCUS_SYNC,
+    KVID_FWHM,
+    KVID_DEROT,
+    KVID_DOME,
+    KVID_MCOVER,
+    KVID_FILTER,
+    KVID_GEOSITE
+};
+
+/**
+ * @brief 协议编码缓冲区
+ * @note
+ * - 清空时保留容量, 重复使用时不再申请内存
+ * - 数值采用std::to_chars编码. 浮点数采用通用格式, 6位有效数字, 与std::ostream缺省格式一致
+ * - Local()返回线程专属实例, 适用于编码后立即发送的场合. 发送前不可再次调用Local()
+ */
+class OutBuffer {
+public:
+    explicit OutBuffer(size_t capacity = 512) {
+        buff_.reserve(capacity);
+    }
+
+    /*!
+     * @brief 查看线程专属缓冲区, 已清空
+     */
+    static OutBuffer& Local() {
+        thread_local OutBuffer buff(4096);
+        buff.Clear();
+        return buff;
+    }
+
+    void Clear()             { buff_.clear(); }
+    const char* Data() const { return buff_.data(); }
+    size_t Size() const      { return buff_.size(); }
+    std::string_view View() const { return std::string_view(buff_); }
+    /*!
+     * @brief 取出编码结果, 缓冲区随之失去容量
+     */
+    string Release()         { return std::move(buff_); }
+
+    OutBuffer& Append(char ch)              { buff_ += ch;  return *this; }
+    OutBuffer& Append(const char* str)      { buff_ += str; return *this; }
+    OutBuffer& Append(const string& str)    { buff_ += str; return *this; }
+    OutBuffer& Append(const char* str, size_t n) { buff_.append(str, n); return *this; }
+
+    OutBuffer& Append(int val) {
+        char buff[16];
+        std::to_chars_result rslt = std::to_chars(buff, buff + sizeof(buff), val);
+        buff_.append(buff, rslt.ptr - buff);
+        return *this;
+    }
+
+    OutBuffer& Append(double val) {
+        char buff[32];
+        std::to_chars_result rslt = std::to_chars(buff, buff + sizeof(buff), val, std::chars_format::general, 6);
+        buff_.append(buff, rslt.ptr - buff);
+        return *this;
+    }
+
+protected:
+    string buff_;   ///< 编码结果
+};
+
+/*!
+ * @brief 编码一个键值对: key=val,
+ */
+template <class T> void kv_append(OutBuffer& out, const char* key, const T& val) {
+    out.Append(key).Append('=').Append(val).Append(',');
+}
+
+/**
+ * @brief 字段描述: 关键字与成员指针. 同一张字段表驱动解析与编码
+ * @note
+ * - Optional(): 字符串为空时不编码
+ * - Alias():    解析时额外接受的关键字, 用于兼容既有拼写
+ * - When():     编码条件, 例如依赖optype的字段
+ */
+template <class T> struct KVField {
+    enum {
+        KIND_NONE,
+        KIND_INT,
+        KIND_DOUBLE,
+        KIND_STRING
+    };
+
+    const char* key   = nullptr;    ///< 关键字
+    const char* alias = nullptr;    ///< 别名, 只用于解析
+    uint64_t hash      = 0;         ///< 关键字散列
+    uint64_t hashAlias = 0;         ///< 别名散列
+    int kind = KIND_NONE;           ///< 数据类型
+    int    T::* ival = nullptr;     ///< 成员: 整数
+    double T::* dval = nullptr;     ///< 成员: 浮点数
+    string T::* sval = nullptr;     ///< 成员: 字符串
+    bool optional = false;          ///< 空字符串不编码
+    bool (*when)(const T&) = nullptr;   ///< 编码条件. 空指针: 总是编码
+
+public:
+    constexpr KVField() = default;
+    constexpr KVField(const char* k, int T::* m)
+        : key(k), hash(kv_hash(k)), kind(KIND_INT), ival(m) {}
+    constexpr KVField(const char* k, double T::* m)
+        : key(k), hash(kv_hash(k)), kind(KIND_DOUBLE), dval(m) {}
+    constexpr KVField(const char* k, string T::* m)
+        : key(k), hash(kv_hash(k)), kind(KIND_STRING), sval(m) {}
+
+    constexpr KVField Alias(const char* k) const {
+        KVField field(*this);
+        field.alias     = k;
+        field.hashAlias = kv_hash(k);
+        return field;
+    }
+
+    constexpr KVField Optional() const {
+        KVField field(*this);
+        field.optional = true;
+        return field;
+    }
+
+    constexpr KVField When(bool (*fn)(const T&)) const {
+        KVField field(*this);
+        field.when = fn;
+        return field;
+    }
+
+    /*!
+     * @brief 解析字段. 数值无效时记录在num中, 成员保持原值
+     */
+    void Decode(T& obj, std::string_view k, std::string_view val, NumFieldStatus& num) const {
+        if      (kind == KIND_INT)    num.Parse(k, val, obj.*ival);
+        else if (kind == KIND_DOUBLE) num.Parse(k, val, obj.*dval);
+        else if (kind == KIND_STRING) (obj.*sval).assign(val.data(), val.size());
+    }
+
+    /*!
+     * @brief 交换两个实例的字段, 不复制字符串
+     */
+    void Swap(T& a, T& b) const {
+        if      (kind == KIND_INT)    std::swap(a.*ival, b.*ival);
+        else if (kind == KIND_DOUBLE) std::swap(a.*dval, b.*dval);
+        else if (kind == KIND_STRING) (a.*sval).swap(b.*sval);
+    }
+
+    /*!
+     * @brief 编码字段, 追加至out
+     */
+    void Encode(const T& obj, OutBuffer& out) const {
+        if (when && !when(obj)) return;
+        if      (kind == KIND_INT)    kv_append(out, key, obj.*ival);
+        else if (kind == KIND_DOUBLE) kv_append(out, key, obj.*dval);
+        else if (kind == KIND_STRING && !(optional && (obj.*sval).empty())) kv_append(out, key, obj.*sval);
+    }
+};
+
+/**
+ * @brief 字段表: 按编码顺序存储字段, 并以开放寻址散列查找关键字
+ * @note
+ * 散列槽在编译期构建. 两个关键字或别名散列相同时, 编译失败
+ */
+template <class T, size_t N> struct KVFieldTable {
+    enum {
+        SLOTS = 64  ///< 散列槽数量
+    };
+    static_assert(N <= SLOTS / 2, "too many fields");
+    typedef const KVField<T>* const_iterator;
+
+    KVField<T> fields[N ? N : 1];   ///< 字段, 编码顺序
+    uint8_t slots[SLOTS] = {};      ///< 散列槽. 0: 空; 其它: 字段序号+1
+
+public:
+    constexpr KVFieldTable() = default;
+    constexpr KVFieldTable(const KVField<T> (&list)[N]) {
+        for (size_t i = 0; i < N; ++i) {
+            fields[i] = list[i];
+            insert(list[i].hash, i);
+            if (list[i].alias) insert(list[i].hashAlias, i);
+        }
+    }
+
+    const_iterator begin() const { return fields; }
+    const_iterator end() const   { return fields + N; }
+
+    /*!
+     * @brief 按关键字散列查找字段
+     * @return 字段地址. 未登记的关键字返回空指针
+     */
+    const KVField<T>* Find(uint64_t hash) const {
+        for (size_t i = hash % SLOTS; slots[i]; i = (i + 1) % SLOTS) {
+            const KVField<T>& field = fields[slots[i] - 1];
+            if (field.hash == hash || (field.alias && field.hashAlias == hash)) return &field;
+        }
+        return nullptr;
+    }
+
+private:
+    constexpr void insert(uint64_t hash, size_t index) {
+        size_t i = hash % SLOTS;
+        for (; slots[i]; i = (i + 1) % SLOTS) {
+            const KVField<T>& field = fields[slots[i] - 1];
+            if (field.hash == hash || (field.alias && field.hashAlias == hash))
+                throw "duplicate keyword in KVFieldTable";
+        }
+        slots[i] = uint8_t(index + 1);
+    }
+};
+
+/*!
+ * @brief 构建字段表
+ * @note
+ * 以static constexpr变量保存, 在编译期完成构建
+ */
+template <class T, size_t N> constexpr KVFieldTable<T, N> kv_fields(const KVField<T> (&list)[N]) {
+    return KVFieldTable<T, N>(list);
+}
+
 /**
  * @brief 定义键值对协议公共父类
  */
@@ -66,6 +319,7 @@ struct KVBase
 {
     // 成员变量
     string  type;   ///< 指令类型
+    KVTypeId typeId = KVID_UNKNOWN; ///< 指令类型编号. 解析时确定, 其后按编号分支
     string  utc;    ///< 时间戳. 格式: YYYY-MM-DDThh:mm:ss
     string  gid;    ///< 组标志
     string  uid;    ///< 单元标志
@@ -89,16 +343,60 @@ public:
 		utc = POSIX_TIME::to_iso_extended_string(POSIX_TIME::second_clock::universal_time());
 	}
 
-    virtual string ToString() const {
-        std::stringstream ss;
-        ss << type << " ";
-        if (utc.size()) ss << join_kv("utc", utc);
-        if (gid.size()) ss << join_kv("gid", gid);
-        if (uid.size()) ss << join_kv("uid", uid);
-        if (cid.size()) ss << join_kv("cid", cid);
-        return ss.str();
+    /*!
+     * @brief 字段表. 仅有公共键值的协议使用空表
+     */
+    static const KVFieldTable<KVBase, 0>& Fields() {
+        static constexpr KVFieldTable<KVBase, 0> table;
+        return table;
+    }
+
+    /*!
+     * @brief 编码协议, 追加至out
+     */
+    virtual void AppendTo(OutBuffer& out) const {
+        AppendHead(out);
+        out.Append('\n');
+    }
+
+    /*!
+     * @brief 编码协议类型和公共键值
+     */
+    void AppendHead(OutBuffer& out) const {
+        out.Append(type).Append(' ');
+        if (utc.size()) kv_append(out, "utc", utc);
+        if (gid.size()) kv_append(out, "gid", gid);
+        if (uid.size()) kv_append(out, "uid", uid);
+        if (cid.size()) kv_append(out, "cid", cid);
+    }
+
+    string ToString() const {
+        OutBuffer out(256);
+        AppendTo(out);
+        return out.Release();
     }
 };
+
+/*!
+ * @brief 按字段表编码协议: 类型, 公共键值, 字段表中的键值对
+ */
+template <class T, class Table> void kv_encode(const T& proto, const Table& table, OutBuffer& out) {
+    proto.AppendHead(out);
+    for (auto it = table.begin(); it != table.end(); ++it) it->Encode(proto, out);
+}
+
+/*!
+ * @brief 按字段表交换协议: 公共键值, 字段表中的键值对
+ * @note
+ * 用于以解析结果替换状态实例. 交换字符串不申请内存, 旧缓冲区随解析实例回收复用
+ */
+template <class T, class Table> void kv_swap(T& a, T& b, const Table& table) {
+    a.utc.swap(b.utc);
+    a.gid.swap(b.gid);
+    a.uid.swap(b.uid);
+    a.cid.swap(b.cid);
+    for (auto it = table.begin(); it != table.end(); ++it) it->Swap(a, b);
+}
 typedef boost::shared_ptr<KVBase> KVBasePtr;
 //////////////////////////////////////////////////////////////////////////////
 /*!
@@ -0,0 +1,94 @@
+/**
+ * @file ProtoNumber.h 通信协议数值字段解析
+ * @brief
+ * - 基于std::from_chars, 不申请内存, 不抛出异常
+ * - 解析结果以错误码返回, 由调用者决定丢弃整帧或忽略字段
+ * - 数值须占据完整字段: 允许一个前导'+', 不允许空白和尾随字符
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#ifndef PROTO_NUMBER_H
+#define PROTO_NUMBER_H
+
+#include <charconv>
+#include <type_traits>
+#include <string_view>
+#include <system_error>
+
+/**
+ * @brief 数值字段解析错误码
+ */
+enum NumError {
+	NUMERR_OK,		///< 成功
+	NUMERR_EMPTY,	///< 空字段
+	NUMERR_INVALID,	///< 非数值
+	NUMERR_TRAILING,///< 数值后有多余字符
+	NUMERR_RANGE	///< 超出类型范围
+};
+
+/*!
+ * @brief 查看错误码说明
+ */
+inline const char* num_error_desc(NumError code) {
+	static const char* desc[] = {
+		"ok",
+		"empty field",
+		"not a number",
+		"trailing characters",
+		"out of range"
+	};
+	return desc[code];
+}
+
+/*!
+ * @brief 解析数值字段
+ * @param str  字段文本
+ * @param val  解析结果. 失败时保持原值
+ * @return
+ * 错误码
+ */
+template <class T> NumError parse_number(std::string_view str, T& val) {
+	const char* first = str.data();
+	const char* last  = first + str.size();
+	if (first == last) return NUMERR_EMPTY;
+	if (*first == '+' && last - first > 1 && first[1] != '-' && first[1] != '+') ++first;
+
+	T tmp;
+	std::from_chars_result rslt;
+	if constexpr (std::is_floating_point<T>::value) rslt = std::from_chars(first, last, tmp, std::chars_format::general);
+	else rslt = std::from_chars(first, last, tmp, 10);
+
+	if (rslt.ec == std::errc::invalid_argument) return NUMERR_INVALID;
+	if (rslt.ec == std::errc::result_out_of_range) return NUMERR_RANGE;
+	if (rslt.ptr != last) return NUMERR_TRAILING;
+	val = tmp;
+	return NUMERR_OK;
+}
+
+/**
+ * @brief 逐字段解析时的状态: 记录首个出错的字段
+ * @note
+ * 解析全部字段后检查一次Failed(), 避免在每个字段分支中处理错误
+ */
+struct NumFieldStatus {
+	NumError code = NUMERR_OK;	///< 首个错误
+	std::string_view key;		///< 出错字段的关键字
+	std::string_view value;		///< 出错字段的文本
+
+public:
+	template <class T> bool Parse(std::string_view k, std::string_view v, T& val) {
+		NumError rc = parse_number(v, val);
+		if (rc != NUMERR_OK && code == NUMERR_OK) {
+			code  = rc;
+			key   = k;
+			value = v;
+		}
+		return rc == NUMERR_OK;
+	}
+
+	bool Failed() const {
+		return code != NUMERR_OK;
+	}
+};
+
+#endif
@@ -0,0 +1,90 @@
+/**
+ * @file ProtoPool.h 通信协议实例对象池
+ * @brief
+ * - 解析协议时从池中取出实例, 最后一个引用释放时实例回收到池中
+ * - 回收的实例保留字符串容量, 稳态下解析遥测协议不申请堆内存
+ * - shared_ptr控制块由fast_pool_allocator分配, 同样循环使用
+ * @version 0.1
+ * @date 2026-10-17
+ */
+#ifndef PROTO_POOL_H
+#define PROTO_POOL_H
+
+#include <vector>
+#include <boost/pool/pool_alloc.hpp>
+#include "BoostInclude.h"
+
+/**
+ * @brief 协议实例对象池
+ * @note
+ * - 每个协议类型一个池, 进程内常驻, 不析构
+ * - 取出时以缺省实例赋值复位, 赋值复用已有字符串缓冲区
+ * - 池中空闲实例数量超过CAPACITY时, 回收的实例直接释放
+ */
+template <class T> class ProtoPool {
+public:
+	enum {
+		CAPACITY = 64	///< 空闲实例最大数量
+	};
+	typedef boost::shared_ptr<T> Pointer;
+
+protected:
+	boost::mutex mtx_;		///< 互斥锁: 空闲实例
+	std::vector<T*> free_;	///< 空闲实例
+
+protected:
+	/*!
+	 * @brief 回收器: 作为shared_ptr的删除器
+	 */
+	struct Recycler {
+		void operator()(T* obj) const {
+			Instance().release(obj);
+		}
+	};
+
+public:
+	/*!
+	 * @brief 取出复位后的实例
+	 */
+	static Pointer Acquire() {
+		static const T blank;
+		T* obj = Instance().acquire();
+		*obj = blank;
+		return Pointer(obj, Recycler(), boost::fast_pool_allocator<T>());
+	}
+
+	/*!
+	 * @brief 查看空闲实例数量
+	 */
+	static size_t Idle() {
+		ProtoPool& pool = Instance();
+		MtxLck lck(pool.mtx_);
+		return pool.free_.size();
+	}
+
+protected:
+	ProtoPool() {
+		free_.reserve(CAPACITY);
+	}
+
+	static ProtoPool& Instance() {
+		static ProtoPool* pool = new ProtoPool; // 不析构: 退出时仍可能有实例被回收
+		return *pool;
+	}
+
+	T* acquire() {
+		MtxLck lck(mtx_);
+		if (free_.empty()) return new T;
+		T* obj = free_.back();
+		free_.pop_back();
+		return obj;
+	}
+
+	void release(T* obj) {
+		MtxLck lck(mtx_);
+		if (free_.size() < CAPACITY) free_.push_back(obj);
+		else delete obj;
+	}
+};
+
+#endif
@@ -0,0 +1,220 @@
+/*!
+ * @file framebench.cpp 微基准: TcpClient分帧
+ * @brief
+ * - 经本机回环连接向TcpClient发送n条协议信息(缺省10000条), 在接收回调中以DrainFrames()逐条取出
+ * - 按指定长度分段发送. 分段越短、信息越长, 未完整信息被重复通知的次数越多, 用于检验续扫
+ * - 对同一数据按"每次收到数据后从信息起点重新查找结束符"的方式分帧, 作为参照
+ * - 输出各轮最短耗时、每条信息耗时及吞吐率
+ * @note
+ * Usage: gtoaes_framebench [-n lines] [-l length] [-s segment] [-r rounds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/chrono/chrono.hpp>
+#include "AsioTCP.h"
+#include "GLog.h"
+
+using namespace boost::asio;
+using namespace boost::chrono;
+using namespace boost::placeholders;
+using std::string;
+
+GLog _gLog(stdout);
+
+/**
+ * @brief 接收方: 在接收回调中取出全部完整信息
+ */
+struct Receiver {
+	boost::mutex mtx;
+	boost::condition_variable cv;	///< 事件: 收到信息
+	boost::atomic<int> frames;		///< 已取出信息数量
+	boost::atomic<uint64_t> bytes;	///< 已取出信息长度, 不含结束符
+	int oversize = 0;				///< 超过最大长度的次数
+
+public:
+	Receiver() : frames(0), bytes(0) {}
+
+	void on_read(TcpClient* client, const boost::system::error_code& ec) {
+		if (ec) return;
+		int n = client->DrainFrames("\n", 1, [this](std::string_view frame) -> bool {
+			bytes += frame.size();
+			return true;
+		});
+		if (n < 0) ++oversize;
+		else if (n > 0) {
+			MtxLck lck(mtx);
+			frames += n;
+			cv.notify_one();
+		}
+	}
+
+	/*!
+	 * @brief 等待取出指定数量的信息
+	 * @return
+	 * 是否在超时前完成
+	 */
+	bool wait(int n, int seconds = 30) {
+		MtxLck lck(mtx);
+		boost::chrono::steady_clock::time_point tmEnd = boost::chrono::steady_clock::now() + boost::chrono::seconds(seconds);
+		while (frames < n) {
+			if (cv.wait_until(lck, tmEnd) == boost::cv_status::timeout) return false;
+		}
+		return true;
+	}
+};
+
+/*!
+ * @brief 生成n条协议信息: 相机、转台、观测计划及GWAC转台
+ * @param n    信息数量
+ * @param pad  键值协议的最小长度, 不足时以comment键值补足
+ */
+static string make_lines(int n, int pad) {
+	string data;
+	char line[512];
+	int len;
+	for (int i = 0; i < n; ++i) {
+		switch (i % 4) {
+		case 0:
+			len = snprintf(line, sizeof(line), "camera utc=2024-03-29T13:07:26.%06d,gid=002,uid=%03d,cid=%03d,state=2,"
+				"errcode=0,left=%.1f,percent=%.1f,coolget=-40,imgtype=OBJECT,filter=R,freedisk=1000,"
+				"plan_sn=%06d,loopno=1,frmno=%d,filename=G021_mon_objt_240329T130726000.fit\n",
+				i % 1000000, i % 10 + 1, i % 100 + 11, (i % 100) * 0.1, (i % 100) * 1.0, i, i % 50);
+			break;
+		case 1:
+			len = snprintf(line, sizeof(line), "mount utc=2024-03-29T13:07:26.%06d,gid=100,uid=%03d,state=%d,errcode=0,"
+				"ra=%.4f,dec=%.4f,azi=%.4f,ele=%.4f\n", i % 1000000, i % 10 + 1, i % 6, (i % 360) * 1.0, (i % 180) - 90.0,
+				(i % 360) * 1.0, (i % 90) * 1.0);
+			break;
+		case 2:
+			len = snprintf(line, sizeof(line), "append_plan gid=100,uid=%03d,plan_sn=%06d,objid=obj%d,coor_sys=0,"
+				"ra=%.4f,dec=%.4f,epoch=2000,imgtype=OBJECT,filter=R|V|B,exptime=10,frmcnt=5,loopcnt=1,priority=%d,"
+				"plan_beg=2024-03-29T13:00:00,plan_end=2024-03-29T14:00:00\n",
+				i % 10 + 1, i, i, (i % 360) * 1.0, (i % 180) - 90.0, i % 100);
+			break;
+		default:
+			len = snprintf(line, sizeof(line), "g#002status%s%%2024-03-29%%13:07:26%%%05d%%\n",
+				"0000555755", i % 100000);
+			break;
+		}
+		if (len < pad && i % 4 != 3) {
+			data.append(line, len - 1).append(",comment=").append(pad - len - 9, 'x').append(1, '\n');
+		}
+		else data.append(line, len);
+	}
+	return data;
+}
+
+/*!
+ * @brief 参照: 每次收到数据后自信息起点重新查找结束符
+ * @return
+ * 取出的信息数量
+ */
+static int rescan_frames(const string& data, int segment, uint64_t& bytes) {
+	string buff;
+	size_t head(0), pos;
+	int frames(0);
+	for (size_t sent = 0; sent < data.size(); sent += segment) {
+		buff.append(data, sent, segment);
+		while ((pos = buff.find('\n', head)) != string::npos) {
+			bytes += pos - head;
+			head = pos + 1;
+			++frames;
+		}
+		if (head > buff.size() / 2) {// 与接收缓冲区相同, 定期整理已读出数据
+			buff.erase(0, head);
+			head = 0;
+		}
+	}
+	return frames;
+}
+
+static double elapsed_ms(const steady_clock::time_point& tmStart) {
+	return duration_cast<microseconds>(steady_clock::now() - tmStart).count() * 1E-3;
+}
+
+static void usage() {
+	printf("Usage: gtoaes_framebench [-n lines] [-l length] [-s segment] [-r rounds]\n");
+	printf("  -n  number of protocol lines, default: 10000\n");
+	printf("  -l  minimum length of key-value lines, at most 60000. default: 0\n");
+	printf("  -s  bytes per send, 0: send all at once. default: 0\n");
+	printf("  -r  rounds, default: 5\n");
+}
+
+int main(int argc, char** argv) {
+	int lines(10000), pad(0), segment(0), rounds(5);
+	for (int i = 1; i < argc; ++i) {
+		if (i + 1 < argc && !strcmp(argv[i], "-n")) lines = atoi(argv[++i]);
+		else if (i + 1 < argc && !strcmp(argv[i], "-l")) pad = atoi(argv[++i]);
+		else if (i + 1 < argc && !strcmp(argv[i], "-s")) segment = atoi(argv[++i]);
+		else if (i + 1 < argc && !strcmp(argv[i], "-r")) rounds = atoi(argv[++i]);
+		else {
+			usage();
+			return 1;
+		}
+	}
+	if (lines <= 0 || pad < 0 || pad > 60000 || segment < 0 || rounds <= 0) {
+		usage();
+		return 1;
+	}
+
+	string data = make_lines(lines, pad);
+	uint64_t bytesExpected = data.size() - lines;
+	if (!segment) segment = int(data.size());
+	printf("%d lines, %d bytes, %d bytes per send\n", lines, int(data.size()), segment);
+
+	// 回环连接: 本地套接字发送, TcpClient接收
+	BoostAsioPool::Instance(1);
+	io_service ios;
+	ip::tcp::acceptor acceptor(ios, ip::tcp::endpoint(ip::address_v4::loopback(), 0));
+	ip::tcp::socket peer(ios);
+	Receiver rcv;
+	TcpCPtr client = TcpClient::Create();
+	client->RegisterRead(boost::bind(&Receiver::on_read, &rcv, _1, _2));
+	client->SetMaxFrame(pad + TCP_PACK_SIZE);
+	if (!client->Connect("127.0.0.1", acceptor.local_endpoint().port(), false)) return 1;
+	acceptor.accept(peer);
+	peer.set_option(ip::tcp::no_delay(true));
+
+	double best(1E30), bestRef(1E30), ms;
+	int failed(0);
+	for (int r = 0; r < rounds; ++r) {
+		rcv.bytes = 0;
+		steady_clock::time_point tmStart = steady_clock::now();
+		boost::system::error_code ec;
+		for (size_t sent = 0; sent < data.size() && !ec; sent += segment)
+			write(peer, buffer(data.data() + sent, std::min(size_t(segment), data.size() - sent)), ec);
+		if (ec || !rcv.wait(lines * (r + 1))) {
+			printf("round %d: only %d of %d lines are received\n", r + 1, rcv.frames - lines * r, lines);
+			++failed;
+			break;
+		}
+		if ((ms = elapsed_ms(tmStart)) < best) best = ms;
+		if (rcv.bytes != bytesExpected) ++failed;
+
+		uint64_t bytes(0);
+		tmStart = steady_clock::now();
+		if (rescan_frames(data, segment, bytes) != lines || bytes != bytesExpected) ++failed;
+		if ((ms = elapsed_ms(tmStart)) < bestRef) bestRef = ms;
+	}
+	client->Close();
+	BoostAsioPool::Instance().Stop();
+	if (rcv.oversize) printf("%d frames are over the maximum length\n", rcv.oversize);
+	if (failed) {
+		printf("FAIL: frames are lost or corrupted\n");
+		return 1;
+	}
+
+	printf("DrainFrames: %8.3f ms, %7.1f ns/line, %7.1f MB/s (loopback included)\n",
+		best, best * 1E6 / lines, data.size() / best * 1E-3);
+	printf("rescan:      %8.3f ms, %7.1f ns/line, %7.1f MB/s (scan only)\n",
+		bestRef, bestRef * 1E6 / lines, data.size() / bestRef * 1E-3);
+	return 0;
+}
@@ -0,0 +1,198 @@
+/*!
+ * @file kvbench.cpp 基准: 键值协议解析
+ * @brief
+ * - 从捕获文件中取出客户端、GFT转台和GFT相机的协议信息, 或采用内置的相机、转台和客户端信息
+ * - 以KVProtocol::Resolve()逐条解析, 按协议类型统计每条信息的耗时和堆内存申请次数
+ * - 捕获文件由Network.Capture生成
+ * @note
+ * Usage: gtoaes_kvbench [capture file] [-r rounds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/unordered_map.hpp>
+#include "globaldef.h"
+#include "GLog.h"
+#include "KVProtocol.h"
+#include "ProtoCapture.h"
+
+using namespace boost::chrono;
+using std::string;
+
+GLog _gLog(stdout);
+
+/////////////////////////////////////////////////////////////////////
+/* 统计堆内存申请次数 */
+static boost::atomic<uint64_t> allocs(0);
+
+void* operator new(size_t size) {
+	++allocs;
+	if (void* ptr = malloc(size ? size : 1)) return ptr;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+	free(ptr);
+}
+/////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief 各协议类型的统计
+ */
+struct TypeStat {
+	uint64_t lines = 0;		///< 信息数量
+	uint64_t bytes = 0;		///< 信息长度
+	uint64_t allocs = 0;	///< 堆内存申请次数
+	uint64_t failed = 0;	///< 解析失败的信息数量
+	double ns = 1E30;		///< 各轮中最短耗时, 纳秒
+};
+
+/*!
+ * @brief 内置信息: 相机、转台和客户端
+ */
+static void sample_lines(std::vector<string>& lines) {
+	const char* samples[] = {
+		"camera utc=2024-03-29T13:07:26.123456,gid=100,uid=001,cid=011,state=2,errcode=0,left=3.5,percent=65.0,"
+			"coolget=-40,imgtype=OBJECT,filter=R,freedisk=1000,plan_sn=000123,loopno=1,frmno=3,"
+			"filename=G011_mon_objt_240329T130726123.fit",
+		"camera utc=2024-03-29T13:07:27.000000,gid=100,uid=002,cid=021,state=1,errcode=0,left=0,percent=0,"
+			"coolget=-39,imgtype=,filter=,freedisk=985,plan_sn=,loopno=0,frmno=0,filename=",
+		"mount utc=2024-03-29T13:07:26.500000,gid=100,uid=001,state=4,errcode=0,ra=123.4567,dec=-12.3456,"
+			"azi=210.1234,ele=45.6789",
+		"mount utc=2024-03-29T13:07:27.500000,gid=100,uid=002,state=2,errcode=0,ra=10.5,dec=20.25,azi=180,ele=70",
+		"append_plan gid=100,uid=001,plan_sn=000124,objid=M31,coor_sys=0,ra=10.6847,dec=41.2687,epoch=2000,"
+			"imgtype=OBJECT,filter=R|V|B,exptime=30,frmcnt=10,loopcnt=2,priority=5,"
+			"plan_beg=2024-03-29T13:00:00,plan_end=2024-03-29T14:00:00",
+		"append_gwac gid=002,uid=006,plan_sn=000125,ra=10.5,dec=20.25,exptime=10,frmcnt=20,priority=1",
+		"check_plan gid=100,uid=001,plan_sn=000124",
+		"abort gid=100,uid=001",
+		"slew gid=100,uid=001,coorsys=1,ra=10.5,dec=20.25,epoch=2000",
+		"take_image gid=100,uid=001,cid=011,objid=flat,imgtype=FLAT,filter=R,exptime=1.5,frmcnt=5",
+		"focus gid=100,uid=001,cid=011,state=0,position=1234",
+		"fwhm gid=100,uid=001,cid=011,value=2.35"
+	};
+	for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); ++i) lines.push_back(samples[i]);
+}
+
+/*!
+ * @brief 从捕获文件中取出键值协议信息
+ * @return
+ * 是否打开捕获文件
+ */
+static bool capture_lines(const string& filepath, std::vector<string>& lines) {
+	CaptureReader reader;
+	if (!reader.Open(filepath)) return false;
+
+	ProtoCapture::Record rec;
+	string data;
+	boost::unordered_map<uint32_t, string> partial;	///< 连接序号-未完整信息
+	size_t pos, head;
+	while (reader.Next(rec, data)) {
+		if (rec.peer != PEER_CLIENT && rec.peer != PEER_MOUNT_GFT && rec.peer != PEER_CAMERA_GFT) continue;
+		if (rec.event != ProtoCapture::CAPEVT_DATA) {
+			partial.erase(rec.conn);
+			continue;
+		}
+		string& buff = partial[rec.conn];
+		buff.append(data);
+		for (head = 0; (pos = buff.find('\n', head)) != string::npos; head = pos + 1) {
+			if (pos > head) lines.push_back(buff.substr(head, pos - head));
+		}
+		buff.erase(0, head);
+	}
+	return true;
+}
+
+static void usage() {
+	printf("Usage: gtoaes_kvbench [capture file] [-r rounds]\n");
+	printf("  capture file  generated by Network.Capture. default: built-in samples\n");
+	printf("  -r            rounds, default: 10\n");
+}
+
+int main(int argc, char** argv) {
+	string pathCapture;
+	int rounds(10);
+	for (int i = 1; i < argc; ++i) {
+		if (i + 1 < argc && !strcmp(argv[i], "-r")) rounds = atoi(argv[++i]);
+		else if (argv[i][0] != '-' && pathCapture.empty()) pathCapture = argv[i];
+		else {
+			usage();
+			return 1;
+		}
+	}
+	if (rounds <= 0) {
+		usage();
+		return 1;
+	}
+
+	std::vector<string> lines;
+	if (pathCapture.empty()) {// 内置信息重复至10000条
+		sample_lines(lines);
+		size_t n = lines.size();
+		for (size_t i = n; i < 10000; ++i) lines.push_back(lines[i % n]);
+	}
+	else if (!capture_lines(pathCapture, lines)) {
+		fprintf(stderr, "failed to open capture file <%s>\n", pathCapture.c_str());
+		return 1;
+	}
+	if (lines.empty()) {
+		printf("no key-value protocol is found\n");
+		return 1;
+	}
+
+	// 按协议类型分组: 类型名称为信息中第一个空格前的部分
+	std::map<string, std::vector<const string*> > groups;
+	for (auto it = lines.begin(); it != lines.end(); ++it) {
+		groups[it->substr(0, it->find(' '))].push_back(&*it);
+	}
+
+	KVProtocol kvproto;
+	std::map<string, TypeStat> stats;
+	TypeStat total;
+	total.ns = 0.0;
+	for (auto it = groups.begin(); it != groups.end(); ++it) {
+		TypeStat& stat = stats[it->first];
+		const std::vector<const string*>& group = it->second;
+		for (int r = 0; r < rounds; ++r) {
+			uint64_t allocStart = allocs;
+			steady_clock::time_point tmStart = steady_clock::now();
+			for (auto line = group.begin(); line != group.end(); ++line) {
+				KVBasePtr proto = kvproto.Resolve((*line)->c_str());
+				if (!r && !proto.use_count()) ++stat.failed;
+			}
+			double ns = double(duration_cast<nanoseconds>(steady_clock::now() - tmStart).count());
+			if (ns < stat.ns) stat.ns = ns;
+			if (r == rounds - 1) stat.allocs = allocs - allocStart; // 对象池已预热
+		}
+		stat.lines = group.size();
+		for (auto line = group.begin(); line != group.end(); ++line) stat.bytes += (*line)->size();
+		total.lines  += stat.lines;
+		total.bytes  += stat.bytes;
+		total.allocs += stat.allocs;
+		total.failed += stat.failed;
+		total.ns     += stat.ns;
+	}
+
+	printf("%-14s %8s %8s %10s %10s %8s\n", "type", "lines", "failed", "ns/line", "MB/s", "allocs");
+	for (auto it = stats.begin(); it != stats.end(); ++it) {
+		const TypeStat& stat = it->second;
+		printf("%-14s %8llu %8llu %10.1f %10.1f %8.2f\n", it->first.c_str(), (unsigned long long) stat.lines,
+			(unsigned long long) stat.failed, stat.ns / stat.lines, stat.bytes / stat.ns * 1E3,
+			double(stat.allocs) / stat.lines);
+	}
+	printf("%-14s %8llu %8llu %10.1f %10.1f %8.2f\n", "total", (unsigned long long) total.lines,
+		(unsigned long long) total.failed, total.ns / total.lines, total.bytes / total.ns * 1E3,
+		double(total.allocs) / total.lines);
+	return 0;
+}
@@ -0,0 +1,213 @@
+/*!
+ * @file msgbench.cpp 基准: 消息队列投递延迟与吞吐率
+ * @brief
+ * - MessageQueue: 进程内多生产者/单消费者环形队列, eventfd唤醒
+ * - 参照: 此前采用的命名boost::interprocess::message_queue, 消息线程以receive()阻塞等待
+ * - 两者均以signals2回调数组分发消息, 响应函数相同
+ * - 延迟: 单一生产者逐条投递, 待响应后投递下一条, 统计投递至响应的时间
+ * - 吞吐率: 多个生产者同时投递, 统计全部消息响应完成的时间
+ * @note
+ * Usage: gtoaes_msgbench [-n messages] [-p producers]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/interprocess/ipc/message_queue.hpp>
+#include "MessageQueue.h"
+#include "GLog.h"
+
+using namespace boost::chrono;
+using namespace boost::placeholders;
+using std::string;
+
+GLog _gLog(stdout);
+
+static long now_ns() {
+	return long(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+/**
+ * @brief 响应统计: 由消息线程更新
+ */
+struct Counter {
+	boost::atomic<long> count;	///< 已响应消息数量
+	std::vector<long> latency;	///< 投递至响应的时间, 纳秒. 仅在延迟测试中记录
+
+public:
+	Counter() : count(0) {}
+
+	void on_message(const long par1, const long) {
+		if (par1) latency.push_back(now_ns() - par1);
+		count.fetch_add(1, boost::memory_order_release);
+	}
+};
+
+/**
+ * @brief 被测队列: MessageQueue
+ */
+class RingQueue : public MessageQueue {
+public:
+	enum {
+		MSG_BENCH = MSG_USER
+	};
+	Counter counter;
+
+public:
+	void Post(long par1) {
+		PostMessage(MSG_BENCH, par1);
+	}
+
+protected:
+	void register_messages() {
+		const CBSlot& slot = boost::bind(&Counter::on_message, &counter, _1, _2);
+		RegisterMessage(MSG_BENCH, slot);
+	}
+};
+
+/**
+ * @brief 参照队列: boost::interprocess::message_queue
+ */
+class IpcQueue {
+protected:
+	typedef boost::interprocess::message_queue MsgQue;
+	typedef boost::signals2::signal<void (const long, const long)> CBF;
+
+	struct Message {
+		long id;
+		long par1, par2;
+	};
+
+	enum {
+		MSG_QUIT,
+		MSG_BENCH
+	};
+
+	string name_;
+	boost::shared_ptr<MsgQue> mq_;
+	CBF funcs_[2];
+	ThrdPtr thrd_;
+
+public:
+	Counter counter;
+
+public:
+	IpcQueue() {
+		char name[64];
+		snprintf(name, sizeof(name), "gtoaes_msgbench_%d", getpid());
+		name_ = name;
+		MsgQue::remove(name);
+		mq_.reset(new MsgQue(boost::interprocess::create_only, name, 1024, sizeof(Message)));
+		funcs_[MSG_BENCH].connect(boost::bind(&Counter::on_message, &counter, _1, _2));
+		thrd_.reset(new boost::thread(boost::bind(&IpcQueue::message_loop, this)));
+	}
+
+	virtual ~IpcQueue() {
+		Message msg = {MSG_QUIT, 0, 0};
+		mq_->send(&msg, sizeof(msg), 10);
+		thrd_->join();
+		MsgQue::remove(name_.c_str());
+	}
+
+	void Post(long par1) {
+		Message msg = {MSG_BENCH, par1, 0};
+		mq_->send(&msg, sizeof(msg), 1);
+	}
+
+protected:
+	void message_loop() {
+		Message msg;
+		MsgQue::size_type szRcv;
+		unsigned int priority;
+		do {
+			mq_->receive(&msg, sizeof(msg), szRcv, priority);
+			if (msg.id == MSG_BENCH) funcs_[msg.id](msg.par1, msg.par2);
+		} while (msg.id != MSG_QUIT);
+	}
+};
+
+/*!
+ * @brief 延迟: 逐条投递, 待响应后投递下一条
+ */
+template <class Queue> static void bench_latency(Queue& que, const char* name, int n) {
+	que.counter.latency.reserve(n);
+	for (long i = 0; i < n; ++i) {
+		que.Post(now_ns());
+		while (que.counter.count.load(boost::memory_order_acquire) <= i) boost::this_thread::yield();
+	}
+	std::vector<long>& lat = que.counter.latency;
+	std::sort(lat.begin(), lat.end());
+	double sum(0.0);
+	for (auto it = lat.begin(); it != lat.end(); ++it) sum += *it;
+	printf("%-12s latency: mean %7.2f us, p50 %7.2f us, p99 %7.2f us, max %8.2f us\n", name,
+		sum / lat.size() * 1E-3, lat[lat.size() / 2] * 1E-3, lat[lat.size() * 99 / 100] * 1E-3, lat.back() * 1E-3);
+}
+
+/*!
+ * @brief 吞吐率: 多个生产者同时投递
+ */
+template <class Queue> static void bench_throughput(Queue& que, const char* name, int n, int producers) {
+	long base = que.counter.count;
+	int per = n / producers;
+	std::vector<ThrdPtr> thrds;
+	steady_clock::time_point tmStart = steady_clock::now();
+	for (int i = 0; i < producers; ++i) {
+		thrds.push_back(ThrdPtr(new boost::thread([&que, per]() {
+			for (int j = 0; j < per; ++j) que.Post(0);
+		})));
+	}
+	for (auto it = thrds.begin(); it != thrds.end(); ++it) (*it)->join();
+	while (que.counter.count.load(boost::memory_order_acquire) < base + long(per) * producers)
+		boost::this_thread::yield();
+	double sec = duration_cast<microseconds>(steady_clock::now() - tmStart).count() * 1E-6;
+	printf("%-12s throughput: %d producers, %ld messages in %.3f s, %.2f M msg/s\n", name, producers,
+		long(per) * producers, sec, per * producers / sec * 1E-6);
+}
+
+static void usage() {
+	printf("Usage: gtoaes_msgbench [-n messages] [-p producers]\n");
+	printf("  -n  messages per test, default: 1000000\n");
+	printf("  -p  producers in throughput test, default: 4\n");
+}
+
+int main(int argc, char** argv) {
+	int n(1000000), producers(4);
+	for (int i = 1; i < argc; ++i) {
+		if (i + 1 < argc && !strcmp(argv[i], "-n")) n = atoi(argv[++i]);
+		else if (i + 1 < argc && !strcmp(argv[i], "-p")) producers = atoi(argv[++i]);
+		else {
+			usage();
+			return 1;
+		}
+	}
+	if (n < 100 || producers <= 0) {
+		usage();
+		return 1;
+	}
+	int nlat = std::min(n, 100000);
+
+	{
+		RingQueue que;
+		if (!que.Start("msgbench")) return 1;
+		bench_latency(que, "MessageQueue", nlat);
+		bench_throughput(que, "MessageQueue", n, producers);
+		que.Stop();
+	}
+	try {
+		IpcQueue que;
+		bench_latency(que, "interprocess", nlat);
+		bench_throughput(que, "interprocess", n, producers);
+	}
+	catch (boost::interprocess::interprocess_exception& ex) {
+		printf("interprocess message_queue: %s\n", ex.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,307 @@
+/*!
+ * @file nonkvbench.cpp 基准与模糊测试: GWAC转台/调焦协议解析
+ * @brief
+ * - 语料目录中的文本文件每行一条协议帧, '#'开头的行为注释
+ *   valid*.txt中的协议帧须被解析, invalid*.txt中的协议帧须被丢弃
+ * - 吞吐率: 按协议类型重复解析有效协议帧, 对比当前解码器与此前逐字符查找的解码器的每帧耗时
+ * - 模糊测试: 对语料随机插入、删除、替换字符或截断后解析, 检查解析结果的约束
+ * @note
+ * Usage: gtoaes_nonkvbench [-d corpus] [-r rounds] [-f iterations] [-s seed]
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include <boost/algorithm/string.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/utility/string_ref.hpp>
+#include "GLog.h"
+#include "NonKVProtocol.h"
+#include "ProtoPool.h"
+
+using namespace boost::chrono;
+namespace fs = boost::filesystem;
+using std::string;
+
+GLog _gLog(fopen("/dev/null", "w")); // 丢弃解析失败的日志
+
+typedef std::vector<string> FrameVec;
+
+/////////////////////////////////////////////////////////////////////
+/*--------------------- 参照: 此前的解码器 ---------------------*/
+/*
+ * 自固定版式分段解码之前的NonKVProtocol::Resolve()复制而来:
+ * 以find()查找协议类型, 逐字符追加gid/uid/utc
+ */
+static int baseline_focus(std::string_view id) {
+	if (boost::iequals(id, "es")) return 0;
+	if (boost::iequals(id, "ws")) return 1;
+	if (boost::iequals(id, "wn")) return 2;
+	if (boost::iequals(id, "en")) return 3;
+	if (boost::iequals(id, "mid")) return 4;
+	return -1;
+}
+
+static NonKVBasePtr baseline_resolve(const char* rcvd) {
+	using boost::string_ref;
+	NonKVBasePtr proto;
+	string_ref sref(rcvd);
+	string prefix("g#");				// 定义引导符
+	string suffix("%");					// 定义结束符: 同时还是中间符!!!
+	string type_state(NONKVTYPE_STATE);	// 定义协议: status
+	string type_pos(NONKVTYPE_POS);		// 定义协议: currentpos
+	string type_focus(NONKVTYPE_FOCUS);	// 定义协议: focus
+
+	char sep = '%';			// 数据间分隔符
+	int group_len = 3;		// 约定: 组标志长度为3字节
+	int unit_len = 3;		// 约定: 单元标志长度为3字节
+	int rsp_len = 3;		// 约定: 回馈指令特征字"Rec"长度为3字节
+	int n(sref.length() - suffix.length()), pos, i(0), j;
+	char ch;
+	NumError rc(NUMERR_OK);	// 数值字段解析结果
+
+	if (!sref.starts_with(prefix) || !sref.ends_with(suffix)) {
+		_gLog.Write(LOG_FAULT, "baseline, illegal protocol[%s]", rcvd);
+	}
+	else if ((pos = sref.find("Rec")) > 0) {// 指令回馈
+		boost::shared_ptr<NonKVResponse> body = ProtoPool<NonKVResponse>::Acquire();
+		for (i = prefix.length(), j = 0; j < group_len; ++i, ++j) body->gid += sref.at(i);
+		for (j = 0; j < unit_len; ++i, ++j) body->uid += sref.at(i);
+		i = pos + rsp_len;
+		if (sref.at(i) != sep) --i;
+		proto = boost::static_pointer_cast<NonKVBase>(body);
+	}
+	else if ((pos = sref.find("finished")) > 0) {// 指令回馈: 调焦到位
+	}
+	else if ((pos = sref.find(type_state)) > 0) {// state
+		boost::shared_ptr<NonKVStatus> body = ProtoPool<NonKVStatus>::Acquire();
+		for (i = prefix.length(); i < pos; ++i) body->gid += sref.at(i);
+		for (i = pos + type_state.length(), j = 0; i < n && sref.at(i) != sep; ++i, ++j) {
+			if (j < int(sizeof(body->state))) body->state[body->n++] = sref.at(i) - '0';
+		}
+		proto = boost::static_pointer_cast<NonKVBase>(body);
+	}
+	else if ((pos = sref.find(type_pos)) > 0) {// currentpos
+		boost::shared_ptr<NonKVPosition> body = ProtoPool<NonKVPosition>::Acquire();
+		int ra, dec;	// 量纲: 1E-4角度
+		pos -= unit_len;
+		for (i = prefix.length(); i < pos; ++i) body->gid += sref.at(i);
+		pos += unit_len;
+		for (; i < pos; ++i) body->uid += sref.at(i);
+		for (i = j = pos + type_pos.length(); i < n && sref.at(i) != sep; ++i);
+		rc = parse_number(std::string_view(rcvd + j, i - j), ra);
+		for (j = ++i; i < n && sref.at(i) != sep; ++i);
+		if (rc == NUMERR_OK) rc = parse_number(std::string_view(rcvd + j, i - j), dec);
+		if (rc == NUMERR_OK) {
+			body->ra  = ra * 1E-4;
+			body->dec = dec * 1E-4;
+			proto = boost::static_pointer_cast<NonKVBase>(body);
+		}
+	}
+	else if ((pos = sref.find(type_focus)) > 0) {// focus
+		boost::shared_ptr<NonKVFocus> body = ProtoPool<NonKVFocus>::Acquire();
+		int idb(-1), nb(-1), index(-1);	// 焦点标志起始位置, 数值起始位置, 焦点序号
+		pos -= unit_len;
+		for (i = prefix.length(); i < pos; ++i) body->gid += sref.at(i);
+		pos += unit_len;
+		for (; i < pos; ++i) body->uid += sref.at(i);
+		for (i = pos + type_focus.length(); i < n; ++i) {
+			ch = sref.at(i);
+			bool alpha = isalpha(ch);
+			if (ch == sep || (alpha && nb >= 0)) {// 一组焦点位置结束
+				if (idb >= 0 && nb >= 0) {
+					index = baseline_focus(std::string_view(rcvd + idb, nb - idb));
+					if (index < 0) break;
+					rc = parse_number(std::string_view(rcvd + nb, i - nb), body->pos[index]);
+					if (rc != NUMERR_OK) break;
+				}
+				if (ch == sep) break;
+				idb = nb = -1;
+			}
+			if (alpha) {
+				if (idb < 0) idb = i;
+			}
+			else if (nb < 0) nb = i;
+		}
+		if (index >= 0 && rc == NUMERR_OK) proto = boost::static_pointer_cast<NonKVBase>(body);
+	}
+
+	if (proto.unique()) {
+		if (int(proto->gid.size()) != group_len || (proto->uid.size() && int(proto->uid.size()) != unit_len))
+			proto.reset();
+		else {
+			for (++i; i < n && sref.at(i) != sep; ++i) proto->utc += sref.at(i);
+			proto->utc += "T";
+			for (++i; i < n && sref.at(i) != sep; ++i) proto->utc += sref.at(i);
+			for (j = ++i; i < n && sref.at(i) != sep; ++i);
+			rc = parse_number(std::string_view(rcvd + j, i - j), proto->sn);
+			if (rc != NUMERR_OK) proto.reset();
+		}
+	}
+	if (rc != NUMERR_OK) _gLog.Write(LOG_WARN, "baseline, %s[%s]", num_error_desc(rc), rcvd);
+	return proto;
+}
+/////////////////////////////////////////////////////////////////////
+
+/*!
+ * @brief 读取语料目录
+ * @return
+ * 语料是否有效
+ */
+static bool load_corpus(const string& dir, FrameVec& valid, FrameVec& invalid) {
+	boost::system::error_code ec;
+	for (fs::directory_iterator it(dir, ec), end; !ec && it != end; ++it) {
+		string name = it->path().filename().string();
+		if (it->path().extension() != ".txt") continue;
+		FrameVec* frames = boost::starts_with(name, "valid") ? &valid
+			: (boost::starts_with(name, "invalid") ? &invalid : NULL);
+		if (!frames) continue;
+		std::ifstream ifs(it->path().string());
+		string line;
+		while (std::getline(ifs, line)) {
+			if (line.size() && line.back() == '\r') line.pop_back();
+			if (line.size() && line[0] != '#') frames->push_back(line);
+		}
+	}
+	if (ec) fprintf(stderr, "failed to read corpus <%s>: %s\n", dir.c_str(), ec.message().c_str());
+	return !ec && valid.size();
+}
+
+/*!
+ * @brief 检查解析结果的约束
+ * @return
+ * 违反的约束. NULL: 满足约束
+ */
+static const char* violation(const NonKVBasePtr& proto) {
+	if (proto->gid.size() != 3) return "gid is not 3 characters";
+	if (proto->uid.size() > 3)  return "uid is longer than 3 characters";
+	if (proto->utc.find('T') == string::npos) return "utc has no 'T'";
+	if (proto->type == NONKVTYPE_STATE) {
+		const NonKVStatus* body = static_cast<const NonKVStatus*>(proto.get());
+		if (body->n < 0 || body->n > int(sizeof(body->state))) return "status count is out of range";
+	}
+	else if (proto->type != NONKVTYPE_POS && proto->type != NONKVTYPE_FOCUS && proto->type != NONKVTYPE_RESPONSE)
+		return "unknown type";
+	return NULL;
+}
+
+/*!
+ * @brief 随机修改协议帧
+ */
+static void mutate(string& frame, std::mt19937& rng) {
+	static const char alphabet[] = "g#%0123456789+-.:TRecfocusstatuscurrentposmidenws";
+	int times = 1 + rng() % 4;
+	for (int i = 0; i < times; ++i) {
+		size_t pos = frame.empty() ? 0 : rng() % (frame.size() + 1);
+		char ch = rng() % 4 ? alphabet[rng() % (sizeof(alphabet) - 1)] : char(1 + rng() % 255);
+		switch (rng() % 5) {
+		case 0: frame.insert(pos, 1, ch); break;	// 插入
+		case 1: if (pos < frame.size()) frame.erase(pos, 1 + rng() % 4); break;	// 删除
+		case 2: if (pos < frame.size()) frame[pos] = ch; break;	// 替换
+		case 3: frame.resize(pos); break;	// 截断
+		default:	// 重复一段
+			if (pos < frame.size()) frame.insert(pos, frame.substr(pos, 1 + rng() % 16));
+			break;
+		}
+	}
+}
+
+static void usage() {
+	printf("Usage: gtoaes_nonkvbench [-d corpus] [-r rounds] [-f iterations] [-s seed]\n");
+	printf("  -d  corpus directory, default: tools/corpus/nonkv\n");
+	printf("  -r  frames decoded per type in throughput test, default: 200000. 0: skip\n");
+	printf("  -f  fuzz iterations, default: 100000. 0: skip\n");
+	printf("  -s  random seed, default: 1\n");
+}
+
+int main(int argc, char** argv) {
+	string dir("tools/corpus/nonkv");
+	int rounds(200000), iterations(100000);
+	unsigned seed(1);
+	for (int i = 1; i < argc; ++i) {
+		if (i + 1 < argc && !strcmp(argv[i], "-d")) dir = argv[++i];
+		else if (i + 1 < argc && !strcmp(argv[i], "-r")) rounds = atoi(argv[++i]);
+		else if (i + 1 < argc && !strcmp(argv[i], "-f")) iterations = atoi(argv[++i]);
+		else if (i + 1 < argc && !strcmp(argv[i], "-s")) seed = strtoul(argv[++i], NULL, 10);
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	FrameVec valid, invalid;
+	if (!load_corpus(dir, valid, invalid)) {
+		printf("FAIL: no valid frame in corpus <%s>\n", dir.c_str());
+		return 1;
+	}
+	printf("corpus: %d valid and %d invalid frames\n", int(valid.size()), int(invalid.size()));
+
+	// 语料: 有效协议帧须被解析, 无效协议帧须被丢弃
+	NonKVProtocol proto;
+	std::map<string, FrameVec> types;
+	int failed(0);
+	for (auto it = valid.begin(); it != valid.end(); ++it) {
+		NonKVBasePtr body = proto.Resolve(it->c_str());
+		const char* what = body ? violation(body) : "rejected";
+		if (what) {
+			printf("FAIL: %s: %s\n", what, it->c_str());
+			++failed;
+		}
+		else types[body->type].push_back(*it);
+	}
+	for (auto it = invalid.begin(); it != invalid.end(); ++it) {
+		if (proto.Resolve(it->c_str())) {
+			printf("FAIL: accepted: %s\n", it->c_str());
+			++failed;
+		}
+	}
+
+	// 吞吐率: 同一语料分别由当前和此前的解码器解析
+	if (rounds > 0) printf("%-12s %8s %16s %16s %8s\n", "type", "frames", "baseline ns/frm", "current ns/frm", "speedup");
+	for (auto it = types.begin(); rounds > 0 && it != types.end(); ++it) {
+		const FrameVec& frames = it->second;
+		size_t n(frames.size());
+		int rejected(0);
+		steady_clock::time_point tmStart = steady_clock::now();
+		for (int i = 0; i < rounds; ++i) {
+			if (!baseline_resolve(frames[i % n].c_str())) ++rejected;
+		}
+		double nsBase = double(duration_cast<nanoseconds>(steady_clock::now() - tmStart).count()) / rounds;
+		tmStart = steady_clock::now();
+		for (int i = 0; i < rounds; ++i) proto.Resolve(frames[i % n].c_str());
+		double ns = double(duration_cast<nanoseconds>(steady_clock::now() - tmStart).count()) / rounds;
+		printf("%-12s %8d %16.1f %16.1f %7.2fx\n", it->first.c_str(), rounds, nsBase, ns, nsBase / ns);
+		if (rejected) printf("  baseline rejects %d of %d %s frames\n", rejected, rounds, it->first.c_str());
+	}
+
+	// 模糊测试
+	if (iterations > 0) {
+		std::mt19937 rng(seed);
+		FrameVec seeds(valid);
+		seeds.insert(seeds.end(), invalid.begin(), invalid.end());
+		int accepted(0);
+		string frame;
+		for (int i = 0; i < iterations; ++i) {
+			frame = seeds[rng() % seeds.size()];
+			mutate(frame, rng);
+			NonKVBasePtr body = proto.Resolve(frame.c_str());
+			if (!body) continue;
+			++accepted;
+			if (const char* what = violation(body)) {
+				printf("FAIL: %s: %s\n", what, frame.c_str());
+				++failed;
+			}
+		}
+		printf("fuzz: %d mutated frames, %d accepted, seed %u\n", iterations, accepted, seed);
+	}
+
+	if (failed) printf("%d checks failed\n", failed);
+	return failed ? 1 : 0;
+}
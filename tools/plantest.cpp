@@ -0,0 +1,208 @@
+/*!
+ * @file plantest.cpp 观测计划流程测试: 中断和删除执行中的计划
+ * @brief
+ * - 以客户端、GWAC转台和相机身份连接运行中的gtoaes
+ * - 检查执行中的计划被abort中断、被remove_plan删除后, 服务器报告对应状态并可启动新计划
+ * - 检查被高优先级计划抢占的计划回到队列, 并在高优先级计划结束后重新执行
+ * - 服务器启用计划日志时, 日志持有未结束计划, 不应影响上述流程
+ * @note
+ * Usage: gtoaes_plantest [-c config] [-h host]
+ * 全部检查通过时返回0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <boost/asio.hpp>
+#include "globaldef.h"
+#include "AstroDeviceDef.h"
+#include "GLog.h"
+#include "Parameter.h"
+#include "KVProtocol.h"
+
+using namespace boost::asio;
+using std::string;
+
+GLog _gLog(stdout);
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief 测试连接: 同步发送, 按行接收
+ */
+class TestLink {
+protected:
+	ip::tcp::socket sock_;	///< 套接字
+	string rcvd_;			///< 未处理的接收数据
+
+public:
+	TestLink(io_service& ios)
+		: sock_(ios) {
+	}
+
+	bool Connect(const string& host, int port) {
+		boost::system::error_code ec;
+		sock_.connect(ip::tcp::endpoint(ip::address::from_string(host), port), ec);
+		return !ec;
+	}
+
+	void Send(const string& line) {
+		boost::system::error_code ec;
+		write(sock_, buffer(line), ec);
+	}
+
+	/*!
+	 * @brief 读取一行
+	 * @param line     信息, 不含换行符
+	 * @param timeout  超时, 毫秒
+	 * @return
+	 * 是否在超时前收到完整信息
+	 */
+	bool ReadLine(string& line, int timeout) {
+		Clock::time_point tmEnd = Clock::now() + std::chrono::milliseconds(timeout);
+		size_t pos;
+		while ((pos = rcvd_.find('\n')) == string::npos) {
+			boost::system::error_code ec;
+			size_t n = sock_.available(ec);
+			if (ec) return false;
+			if (n) {
+				char buff[4096];
+				n = sock_.read_some(buffer(buff, std::min(n, sizeof(buff))), ec);
+				if (ec) return false;
+				rcvd_.append(buff, n);
+			}
+			else if (Clock::now() >= tmEnd) return false;
+			else std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}
+		line = rcvd_.substr(0, pos);
+		rcvd_.erase(0, pos + 1);
+		return true;
+	}
+};
+
+static KVProtocol kvproto;
+
+/*!
+ * @brief 等待计划状态
+ * @return
+ * 是否在超时前收到指定计划的指定状态
+ */
+static bool wait_plan(TestLink& client, const string& plan_sn, int state, int timeout = 3000) {
+	Clock::time_point tmEnd = Clock::now() + std::chrono::milliseconds(timeout);
+	string line;
+	int ms;
+	while ((ms = int(std::chrono::duration_cast<std::chrono::milliseconds>(tmEnd - Clock::now()).count())) > 0
+			&& client.ReadLine(line, ms)) {
+		KVBasePtr proto = kvproto.Resolve(line.c_str());
+		if (!proto.use_count() || proto->typeId != KVID_PLAN) continue;
+		KVPlanPtr plan = boost::static_pointer_cast<KVPlan>(proto);
+		if (plan->plan_sn == plan_sn && plan->state == state) return true;
+	}
+	return false;
+}
+
+static int failed = 0;
+
+static void check(bool rslt, const char* what) {
+	printf("%s: %s\n", rslt ? "PASS" : "FAIL", what);
+	if (!rslt) ++failed;
+}
+
+static string camera_status(int state) {
+	char line[256];
+	snprintf(line, sizeof(line), "camera gid=002,uid=006,cid=021,state=%d,errcode=0,left=0,percent=0,"
+		"coolget=-40,imgtype=OBJECT,filter=,freedisk=100,plan_sn=,loopno=0,frmno=0,filename=x\n", state);
+	return line;
+}
+
+static string append_plan(const char* plan_sn, int priority = 1) {
+	char line[256];
+	snprintf(line, sizeof(line), "append_gwac gid=002,uid=006,plan_sn=%s,ra=10.5,dec=20.25,"
+		"exptime=1,frmcnt=2,priority=%d\n", plan_sn, priority);
+	return line;
+}
+
+static void usage() {
+	printf("Usage: gtoaes_plantest [-c config] [-h host]\n");
+	printf("  -c  configuration file of gtoaes, default: %s\n", CONFIG_PATH);
+	printf("  -h  server address, default: 127.0.0.1\n");
+}
+
+int main(int argc, char** argv) {
+	string pathConfig(CONFIG_PATH), host("127.0.0.1");
+	for (int i = 1; i < argc; ++i) {
+		if (i + 1 == argc || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+			usage();
+			return 1;
+		}
+		const char* val = argv[++i];
+		switch (argv[i - 1][1]) {
+		case 'c': pathConfig = val; break;
+		case 'h': host = val;       break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	Parameter param;
+	if (!param.Load(pathConfig)) printf("using default ports\n");
+
+	io_service ios;
+	TestLink client(ios), mount(ios), camera(ios);
+	if (!client.Connect(host, param.portClient) || !mount.Connect(host, param.portMountGWAC)
+			|| !camera.Connect(host, param.portCameraGWAC)) {
+		printf("FAIL: connect to gtoaes<%s>\n", host.c_str());
+		return 1;
+	}
+	mount.Send("g#002status0000555755%2024-03-29%13:07:26%32846%\n");
+	camera.Send(camera_status(CAMCTL_IDLE));
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+	// 中断执行中的计划
+	client.Send(append_plan("abort_a"));
+	check(wait_plan(client, "abort_a", OBSPLAN_RUNNING), "plan starts");
+	camera.Send(camera_status(CAMCTL_EXPOSING));
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	client.Send("abort gid=002,uid=006\n");
+	check(wait_plan(client, "abort_a", OBSPLAN_INTERRUPTED), "abort interrupts running plan");
+	camera.Send(camera_status(CAMCTL_IDLE));
+
+	// 中断后可启动新计划
+	client.Send(append_plan("abort_b"));
+	check(wait_plan(client, "abort_b", OBSPLAN_RUNNING), "next plan starts after abort");
+	camera.Send(camera_status(CAMCTL_EXPOSING));
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+	// 删除执行中的计划
+	client.Send("remove_plan gid=002,uid=006,plan_sn=abort_b\n");
+	check(wait_plan(client, "abort_b", OBSPLAN_DELETED), "remove_plan deletes running plan");
+	camera.Send(camera_status(CAMCTL_IDLE));
+
+	client.Send(append_plan("abort_c"));
+	check(wait_plan(client, "abort_c", OBSPLAN_RUNNING), "next plan starts after remove_plan");
+	client.Send("abort gid=002,uid=006\n");
+	check(wait_plan(client, "abort_c", OBSPLAN_INTERRUPTED), "abort interrupts plan before exposing");
+
+	// 抢占: 被抢占的计划回到队列
+	client.Send(append_plan("preempt_a"));
+	check(wait_plan(client, "preempt_a", OBSPLAN_RUNNING), "low priority plan starts");
+	camera.Send(camera_status(CAMCTL_EXPOSING));
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	client.Send(append_plan("preempt_b", 5));
+	check(wait_plan(client, "preempt_a", OBSPLAN_CATALOGED), "preempted plan returns to queue");
+	camera.Send(camera_status(CAMCTL_IDLE));
+	check(wait_plan(client, "preempt_b", OBSPLAN_RUNNING), "high priority plan starts");
+	camera.Send(camera_status(CAMCTL_EXPOSING));
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	client.Send("abort gid=002,uid=006\n");
+	check(wait_plan(client, "preempt_b", OBSPLAN_INTERRUPTED), "abort interrupts high priority plan");
+	camera.Send(camera_status(CAMCTL_IDLE));
+	check(wait_plan(client, "preempt_a", OBSPLAN_RUNNING), "preempted plan starts again");
+	client.Send("abort gid=002,uid=006\n");
+	check(wait_plan(client, "preempt_a", OBSPLAN_INTERRUPTED), "abort interrupts resumed plan");
+
+	printf("%d checks failed\n", failed);
+	return failed ? 1 : 0;
+}
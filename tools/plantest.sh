@@ -0,0 +1,44 @@
+#!/bin/sh
+# 观测计划流程测试: 在临时目录中启动启用计划日志的gtoaes, 运行gtoaes_plantest,
+# 再次启动gtoaes, 检查已结束的计划不被恢复
+# Usage: plantest.sh <gtoaes> <gtoaes_plantest>
+# 仅适用于调试版本: 读取当前目录的配置文件, 日志输出至标准输出
+DAEMON=$1
+TEST=$2
+PIDFILE=/var/run/gtoaes.pid
+DIR=$(mktemp -d)
+PID=
+trap 'stop_daemon; rm -rf "$DIR"' EXIT
+cd "$DIR" || exit 1
+
+# 守护进程在启动后两次fork, 由PID文件取得进程号
+start_daemon() {
+	"$DAEMON" > "$1" 2>&1
+	sleep 1
+	PID=$(head -n 1 $PIDFILE)
+}
+
+stop_daemon() {
+	[ -n "$PID" ] || return
+	kill -INT $PID 2>/dev/null
+	while kill -0 $PID 2>/dev/null; do sleep 0.1; done
+	PID=
+}
+
+"$DAEMON" -d
+sed -i "s#<Journal path=\"[^\"]*\"#<Journal path=\"$DIR/plan.journal\"#" gtoaes.xml
+
+start_daemon daemon1.log
+"$TEST" -c gtoaes.xml
+RC=$?
+stop_daemon
+[ $RC -eq 0 ] || { cat daemon1.log; exit $RC; }
+
+start_daemon daemon2.log
+stop_daemon
+if ! grep -q " 0 plans are recovered" daemon2.log; then
+	echo "FAIL: ended plans are recovered from journal"
+	cat plan.journal daemon2.log
+	exit 1
+fi
+echo "PASS: ended plans are not recovered"
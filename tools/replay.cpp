@@ -0,0 +1,236 @@
+/*!
+ * @file replay.cpp 回放gtoaes捕获的网络数据, 用于离线负载测试
+ * @brief
+ * - 读取由Network.Capture生成的捕获文件
+ * - 按终端类型连接配置参数中对应的服务端口, 按原样发送各连接接收到的数据
+ * - 回放速度: 1倍、10倍等倍速, 或不等待的最大速度
+ * - 丢弃服务器的回复, 避免其发送队列拥塞
+ * - 结束时输出各终端类型的数据量、吞吐率及落后于时间表的延迟
+ * @note
+ * Usage: gtoaes_replay <capture file> [-c config] [-h host] [-s speed|max]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/unordered_map.hpp>
+#include "globaldef.h"
+#include "AstroDeviceDef.h"
+#include "GLog.h"
+#include "Parameter.h"
+#include "ProtoCapture.h"
+
+using namespace boost::asio;
+using namespace boost::chrono;
+using std::string;
+
+GLog _gLog(stdout);
+
+typedef ip::tcp::socket TcpSock;
+typedef boost::shared_ptr<TcpSock> TcpSockPtr;
+
+/**
+ * @brief 各终端类型的统计
+ */
+struct PeerStat {
+	const char* name = "";	///< 终端类型名称
+	int port = 0;			///< 服务端口. 0: 不回放
+	uint64_t conns = 0;		///< 连接数量
+	uint64_t records = 0;	///< 数据记录数量
+	uint64_t bytes = 0;		///< 发送数据长度
+};
+
+/**
+ * @brief 回放连接
+ */
+struct Replayer {
+	io_service ios;
+	string host = "127.0.0.1";	///< 服务器地址
+	double speed = 1.0;		///< 回放倍速. <=0: 最大速度
+	PeerStat stats[PEER_LAST];	///< 统计
+	boost::unordered_map<uint32_t, TcpSockPtr> conns;	///< 连接序号-套接字. 空指针: 连接失败
+	char scratch[65536];	///< 丢弃服务器回复的缓冲区
+	uint64_t failed = 0;	///< 无法连接或发送失败的记录数量
+	double lagMax = 0.0;	///< 落后于时间表的最大延迟, 秒
+	double lagSum = 0.0;	///< 落后于时间表的延迟总和, 秒
+	uint64_t lagCount = 0;	///< 延迟统计的记录数量
+
+public:
+	/*!
+	 * @brief 建立连接
+	 */
+	TcpSockPtr open(uint32_t conn, int peer) {
+		TcpSockPtr sock;
+		boost::system::error_code ec;
+		if (peer < PEER_LAST && stats[peer].port) {
+			sock.reset(new TcpSock(ios));
+			sock->connect(ip::tcp::endpoint(ip::address::from_string(host, ec), stats[peer].port), ec);
+			if (ec) {
+				fprintf(stderr, "connection<%u> to %s:%d failed: %s\n", conn, host.c_str(),
+					stats[peer].port, ec.message().c_str());
+				sock.reset();
+			}
+			else ++stats[peer].conns;
+		}
+		conns[conn] = sock;
+		return sock;
+	}
+
+	/*!
+	 * @brief 断开连接
+	 */
+	void close(uint32_t conn) {
+		auto it = conns.find(conn);
+		if (it == conns.end()) return;
+		if (it->second) {
+			boost::system::error_code ec;
+			it->second->close(ec);
+		}
+		conns.erase(it);
+	}
+
+	/*!
+	 * @brief 发送记录数据. 未记录建立连接时补建连接
+	 */
+	void send(uint32_t conn, int peer, const string& data) {
+		auto it = conns.find(conn);
+		TcpSockPtr sock = it != conns.end() ? it->second : open(conn, peer);
+		boost::system::error_code ec;
+		if (sock) write(*sock, buffer(data), ec);
+		if (!sock || ec) ++failed;
+		else {
+			++stats[peer].records;
+			stats[peer].bytes += data.size();
+		}
+	}
+
+	/*!
+	 * @brief 读出并丢弃服务器的回复
+	 */
+	void drain() {
+		boost::system::error_code ec;
+		for (auto it = conns.begin(); it != conns.end(); ++it) {
+			if (!it->second) continue;
+			while (it->second->available(ec) > 0 && !ec)
+				it->second->read_some(buffer(scratch), ec);
+		}
+	}
+
+	/*!
+	 * @brief 等待至计划时间. 等待期间丢弃服务器回复
+	 */
+	void wait_until(const steady_clock::time_point& tm) {
+		while (steady_clock::now() < tm) {
+			drain();
+			steady_clock::duration left = tm - steady_clock::now();
+			if (left > milliseconds(1)) left = milliseconds(1);
+			if (left > steady_clock::duration::zero()) boost::this_thread::sleep_for(left);
+		}
+	}
+};
+
+static void usage() {
+	printf("Usage: gtoaes_replay <capture file> [-c config] [-h host] [-s speed|max]\n");
+	printf("  -c  configuration file, default: %s\n", CONFIG_PATH);
+	printf("  -h  server address, default: 127.0.0.1\n");
+	printf("  -s  replay speed: 1, 10, ... or max, default: 1\n");
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2 || argv[1][0] == '-') {
+		usage();
+		return 1;
+	}
+
+	Replayer rp;
+	string pathCapture(argv[1]), pathConfig(CONFIG_PATH);
+	for (int i = 2; i < argc; ++i) {
+		if (i + 1 < argc && !strcmp(argv[i], "-c")) pathConfig = argv[++i];
+		else if (i + 1 < argc && !strcmp(argv[i], "-h")) rp.host = argv[++i];
+		else if (i + 1 < argc && !strcmp(argv[i], "-s")) {
+			++i;
+			rp.speed = strcmp(argv[i], "max") ? atof(argv[i]) : 0.0;
+		}
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	Parameter param;
+	if (!param.Load(pathConfig)) printf("using default ports\n");
+	const struct {
+		int peer;
+		const char* name;
+		int port;
+	} peers[] = {
+		{PEER_CLIENT,      "client",      param.portClient},
+		{PEER_MOUNT_GWAC,  "mount-gwac",  param.portMountGWAC},
+		{PEER_CAMERA_GWAC, "camera-gwac", param.portCameraGWAC},
+		{PEER_FOCUS,       "focus",       param.portFocusGWAC},
+		{PEER_MOUNT_GFT,   "mount-gft",   param.portMountGFT},
+		{PEER_CAMERA_GFT,  "camera-gft",  param.portCameraGFT}
+	};
+	for (auto& peer : peers) {
+		rp.stats[peer.peer].name = peer.name;
+		rp.stats[peer.peer].port = peer.port;
+	}
+
+	CaptureReader reader;
+	if (!reader.Open(pathCapture)) {
+		fprintf(stderr, "failed to open capture file <%s>\n", pathCapture.c_str());
+		return 1;
+	}
+
+	ProtoCapture::Record rec;
+	string data;
+	uint64_t count(0), usecLast(0);
+	steady_clock::time_point tmStart = steady_clock::now();
+	while (reader.Next(rec, data)) {
+		if (rec.peer >= PEER_LAST) continue;
+		if (rp.speed > 0.0) {// 按时间表发送
+			steady_clock::time_point tm = tmStart + duration_cast<steady_clock::duration>(
+				microseconds(int64_t(rec.usec / rp.speed)));
+			rp.wait_until(tm);
+			double lag = duration<double>(steady_clock::now() - tm).count();
+			rp.lagSum += lag;
+			++rp.lagCount;
+			if (lag > rp.lagMax) rp.lagMax = lag;
+		}
+		else if (++count % 64 == 0) rp.drain();
+
+		if (rec.event == ProtoCapture::CAPEVT_OPEN) rp.open(rec.conn, rec.peer);
+		else if (rec.event == ProtoCapture::CAPEVT_CLOSE) rp.close(rec.conn);
+		else rp.send(rec.conn, rec.peer, data);
+		usecLast = rec.usec;
+	}
+	double elapsed = duration<double>(steady_clock::now() - tmStart).count();
+	while (!rp.conns.empty()) rp.close(rp.conns.begin()->first);
+
+	// 统计
+	uint64_t records(0), bytes(0);
+	printf("%-12s %8s %10s %12s\n", "peer", "conns", "records", "bytes");
+	for (auto& peer : peers) {
+		const PeerStat& stat = rp.stats[peer.peer];
+		printf("%-12s %8llu %10llu %12llu\n", stat.name, (unsigned long long) stat.conns,
+			(unsigned long long) stat.records, (unsigned long long) stat.bytes);
+		records += stat.records;
+		bytes   += stat.bytes;
+	}
+	printf("captured span: %.3f s, replayed in %.3f s\n", usecLast * 1E-6, elapsed);
+	if (elapsed > 0.0) {
+		printf("throughput: %.1f records/s, %.3f MB/s\n", records / elapsed, bytes / elapsed / 1048576.0);
+	}
+	if (rp.lagCount) {
+		printf("schedule lag: mean %.3f ms, max %.3f ms\n", rp.lagSum / rp.lagCount * 1E3, rp.lagMax * 1E3);
+	}
+	if (rp.failed) printf("failed records: %llu\n", (unsigned long long) rp.failed);
+
+	return 0;
+}
@@ -0,0 +1,1094 @@
+/*!
+ * @file simulator.cpp 仿真转台、相机和调焦器, 用于无硬件条件下的负载测试
+ * @brief
+ * - GWAC转台组: 每组一条连接, 汇总各单元状态, 按单元发送指向位置. 协议: NonKVProtocol
+ * - GWAC调焦器: 每个单元一条连接, 发送所属相机的焦点位置. 协议: NonKVProtocol
+ * - GWAC/GFT相机: 每台相机一条连接. 协议: KVProtocol
+ * - GFT转台: 每台转台一条连接. 协议: KVProtocol
+ * - 响应slew/park/abortslew/track/homera/focus/expose等指令, 按设定耗时切换工作状态
+ * - 可选: 以客户端身份周期性提交观测计划, 统计计划开始执行和开始曝光的延迟
+ * @note
+ * Usage: gtoaes_sim [-c config] [-h host] [options], 见usage()
+ * - 单线程异步I/O, 所有设备共享一个10毫秒的节拍推进状态机
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <chrono>
+#include <deque>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/unordered_map.hpp>
+#include "globaldef.h"
+#include "AstroDeviceDef.h"
+#include "GLog.h"
+#include "Parameter.h"
+#include "KVProtocol.h"
+
+using namespace boost::asio;
+using namespace boost::placeholders;
+using std::string;
+
+GLog _gLog(stdout);
+
+typedef std::chrono::steady_clock Clock;
+typedef Clock::time_point TimePoint;
+
+class Simulator;
+
+/*!
+ * @brief 由秒数构建时长
+ */
+static Clock::duration secs(double sec) {
+	return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(sec));
+}
+
+/*!
+ * @brief GWAC协议时标, 格式: YYYY-MM-DD%hh:mm:ss
+ */
+static const char* gwac_utc() {
+	static time_t last = -1;
+	static char text[64];
+	time_t now = time(NULL);
+	if (now != last) {
+		struct tm tmu;
+		gmtime_r(&now, &tmu);
+		snprintf(text, sizeof(text), "%04d-%02d-%02d%%%02d:%02d:%02d",
+			tmu.tm_year + 1900, tmu.tm_mon + 1, tmu.tm_mday,
+			tmu.tm_hour, tmu.tm_min, tmu.tm_sec);
+		last = now;
+	}
+	return text;
+}
+
+/**
+ * @brief 仿真参数
+ */
+struct SimConfig {
+	string host = "127.0.0.1";	///< 服务器地址
+	int groups     = 1;		///< GWAC转台组数量
+	int units      = 5;		///< 每组转台数量
+	int cameras    = 5;		///< 每台GWAC转台的相机数量, 不超过5
+	int focusers   = 1;		///< 每台GWAC转台是否配置调焦器. 0: 否
+	int gfts       = 0;		///< GFT转台数量
+	int gftCameras = 1;		///< 每台GFT转台的相机数量
+	double rateStatus = 1.0;	///< 状态发送频率, Hz
+	double ratePos    = 1.0;	///< 转台位置发送频率, Hz
+	double slewTime   = 3.0;	///< 指向、复位和找零耗时, 秒
+	double expScale   = 0.1;	///< 曝光时间缩放系数
+	double focusSpeed = 200.0;	///< 调焦速度, 步/秒
+	double planPeriod = 0.0;	///< 各单元提交观测计划的周期, 秒. 0: 不提交
+	double planExptime= 10.0;	///< 观测计划曝光时间, 秒
+	int planFrames    = 2;		///< 观测计划帧数
+	double duration   = 0.0;	///< 运行时长, 秒. 0: 直至Ctrl+C
+};
+
+/**
+ * @brief 观测计划的执行过程
+ */
+struct PlanTrack {
+	TimePoint tmSubmit;		///< 提交时间
+	TimePoint tmRunning;	///< 收到执行状态的时间
+	TimePoint tmExpose;		///< 相机收到开始曝光指令的时间
+	bool running = false;	///< 已开始执行
+	bool exposed = false;	///< 已开始曝光
+	int state = OBSPLAN_MIN;///< 最后收到的计划状态
+};
+
+/**
+ * @brief 各终端类型的统计
+ */
+struct SimStat {
+	uint64_t links  = 0;	///< 已建立连接数量
+	uint64_t failed = 0;	///< 连接失败或中断数量
+	uint64_t sent   = 0;	///< 发送信息数量
+	uint64_t rcvd   = 0;	///< 接收信息数量
+	uint64_t unknown= 0;	///< 无法识别的信息数量
+};
+
+/////////////////////////////////////////////////////////////////////
+/**
+ * @brief 仿真连接: 按行接收, 排队发送
+ */
+class SimLink {
+protected:
+	Simulator& sim_;	///< 仿真器
+	int peer_;			///< 终端类型
+	string name_;		///< 设备名称, 用于输出
+	ip::tcp::socket sock_;	///< 套接字
+	streambuf rdbuf_;		///< 接收缓冲区
+	string line_;			///< 单条信息
+	std::deque<string> wrque_;	///< 发送队列
+	bool open_ = false;		///< 连接状态
+
+public:
+	SimLink(Simulator& sim, int peer, const string& name);
+	virtual ~SimLink() = default;
+	/*!
+	 * @brief 异步连接服务器
+	 */
+	void Connect(const ip::tcp::endpoint& ep);
+	/*!
+	 * @brief 排队发送一条信息
+	 */
+	void Write(const string& frame);
+	void Write(const char* frame, int n) {
+		Write(string(frame, n));
+	}
+	/*!
+	 * @brief 节拍: 推进状态机, 发送周期信息
+	 */
+	virtual void Tick(TimePoint now) = 0;
+
+protected:
+	/*!
+	 * @brief 连接建立后的处理
+	 */
+	virtual void on_open(TimePoint now) {}
+	/*!
+	 * @brief 处理一条信息, 不含结束符
+	 */
+	virtual void on_frame(const char* frame, TimePoint now) = 0;
+
+private:
+	void handle_connect(const boost::system::error_code& ec);
+	void do_read();
+	void handle_read(const boost::system::error_code& ec, size_t n);
+	void handle_write(const boost::system::error_code& ec, size_t n);
+	void close(const boost::system::error_code& ec);
+};
+typedef boost::shared_ptr<SimLink> SimLinkPtr;
+
+/**
+ * @brief 仿真器: 创建设备, 驱动节拍, 汇总统计
+ */
+class Simulator {
+public:
+	io_service ios;		///< I/O服务
+	SimConfig cfg;		///< 仿真参数
+	Parameter param;	///< 服务端口
+	KVProtocol kvproto;	///< 解析键值对协议, 各设备共用
+	SimStat stats[PEER_LAST];	///< 统计
+	boost::unordered_map<string, PlanTrack> plans;	///< 观测计划, 键: plan_sn
+
+protected:
+	std::vector<SimLinkPtr> links_;	///< 仿真设备
+	steady_timer timer_;	///< 节拍定时器
+	signal_set signals_;	///< 中断信号
+	TimePoint tmStart_;		///< 开始时间
+
+public:
+	Simulator();
+	/*!
+	 * @brief 创建设备并运行, 直至超时或中断
+	 */
+	void Run();
+	/*!
+	 * @brief 记录计划状态
+	 */
+	void PlanState(const string& plan_sn, int state, TimePoint now);
+	/*!
+	 * @brief 记录相机收到开始曝光指令
+	 */
+	void PlanExpose(const string& plan_sn, TimePoint now);
+	/*!
+	 * @brief 输出统计结果
+	 */
+	void Report();
+
+protected:
+	void add_link(const SimLinkPtr& link, int port);
+	void handle_tick(const boost::system::error_code& ec);
+};
+
+/////////////////////////////////////////////////////////////////////
+/**
+ * @brief 转台运动: 在设定耗时内由起点线性移动至目标, 结束后切换状态
+ */
+struct MountMotion {
+	int state = MOUNT_PARKED;	///< 工作状态
+	int stateEnd = MOUNT_MIN;	///< 动作结束后的状态. MOUNT_MIN: 无动作
+	double ra  = 0.0;	///< 当前赤经, 角度
+	double dec = 40.0;	///< 当前赤纬, 角度
+	double ra0, dec0;	///< 起点
+	double ra1, dec1;	///< 目标
+	TimePoint tmBegin;	///< 动作开始时间
+	TimePoint tmEnd;	///< 动作结束时间
+
+public:
+	/*!
+	 * @brief 开始动作
+	 * @param moving  动作期间的状态
+	 * @param done    动作结束后的状态
+	 */
+	void Start(TimePoint now, double sec, int moving, int done, double tra, double tdec) {
+		ra0 = ra;
+		dec0 = dec;
+		ra1 = tra;
+		dec1 = tdec;
+		tmBegin = now;
+		tmEnd = now + secs(sec);
+		state = moving;
+		stateEnd = done;
+	}
+	/*!
+	 * @brief 立即切换状态, 取消动作
+	 */
+	void Set(int newState) {
+		state = newState;
+		stateEnd = MOUNT_MIN;
+	}
+	/*!
+	 * @brief 推进动作
+	 * @return 工作状态是否改变
+	 */
+	bool Advance(TimePoint now) {
+		if (stateEnd == MOUNT_MIN) return false;
+		if (now >= tmEnd) {
+			ra = ra1;
+			dec = dec1;
+			Set(stateEnd);
+			return true;
+		}
+		double t = std::chrono::duration<double>(now - tmBegin).count()
+			/ std::chrono::duration<double>(tmEnd - tmBegin).count();
+		ra  = ra0 + (ra1 - ra0) * t;
+		dec = dec0 + (dec1 - dec0) * t;
+		return false;
+	}
+};
+
+/**
+ * @brief GWAC指令: 以'%'切分的首段和序列号
+ */
+struct GwacCmd {
+	std::string_view head;	///< 首段, 不含引导符: <gid><uid><类型><参数>
+	std::string_view arg2;	///< 第二段, 部分指令的参数
+	std::string_view serno;	///< 序列号
+
+public:
+	/*!
+	 * @brief 切分指令. 格式: g#<gid><uid><类型><参数>%[参数%]<YYYY-MM-DD>%<hh:mm:ss>%<序列号>%
+	 */
+	bool Split(const char* frame) {
+		std::string_view str(frame);
+		std::vector<std::string_view> segs;
+		if (str.size() < 9 || str.compare(0, 2, "g#") || str.back() != '%') return false;
+		str = str.substr(2, str.size() - 3);
+		for (size_t pos; (pos = str.find('%')) != std::string_view::npos; str.remove_prefix(pos + 1))
+			segs.push_back(str.substr(0, pos));
+		segs.push_back(str);
+		if (segs.size() < 4 || segs[0].size() < 6) return false;
+		head  = segs[0];
+		arg2  = segs.size() > 4 ? segs[1] : std::string_view();
+		serno = segs.back();
+		return true;
+	}
+	/*!
+	 * @brief 查看指令类型及其后的参数
+	 */
+	bool Is(std::string_view type, std::string_view& arg) const {
+		std::string_view body = head.substr(6);
+		if (body.compare(0, type.size(), type)) return false;
+		arg = body.substr(type.size());
+		return true;
+	}
+};
+
+/**
+ * @brief GWAC设备公共功能: 指令回馈
+ */
+class SimGwacLink : public SimLink {
+protected:
+	int sn_ = 0;	///< 信息序列号
+
+public:
+	using SimLink::SimLink;
+
+protected:
+	/*!
+	 * @brief 回馈指令. 格式: g#<首段>Rec%<YYYY-MM-DD>%<hh:mm:ss>%<序列号>%
+	 */
+	void reply(const GwacCmd& cmd) {
+		char buff[160];
+		int n = snprintf(buff, sizeof(buff), "g#%.*sRec%%%s%%%.*s%%\n",
+			int(cmd.head.size()), cmd.head.data(), gwac_utc(),
+			int(cmd.serno.size()), cmd.serno.data());
+		Write(buff, n);
+	}
+	/*!
+	 * @brief 信息序列号: 00001->99999
+	 */
+	int next_sn() {
+		return sn_ = sn_ == 99999 ? 1 : sn_ + 1;
+	}
+};
+
+/**
+ * @brief GWAC转台组: 各单元共用一条连接
+ */
+class SimMountGWAC : public SimGwacLink {
+protected:
+	struct Unit {
+		string uid;			///< 单元标志
+		MountMotion motion;	///< 运动状态
+		TimePoint tmPos;	///< 下次发送位置的时间
+	};
+
+	string gid_;	///< 组标志
+	int first_;		///< 首个单元在状态中的序号
+	std::vector<Unit> units_;	///< 单元
+	TimePoint tmStatus_;	///< 下次发送状态的时间
+	bool changed_ = true;	///< 状态已改变
+
+public:
+	SimMountGWAC(Simulator& sim, const string& gid, int first, int n);
+
+	void Tick(TimePoint now) override;
+
+protected:
+	void on_frame(const char* frame, TimePoint now) override;
+	void send_status();
+	void send_position(const Unit& unit);
+};
+
+/**
+ * @brief GWAC调焦器: 单元内各相机共用一条连接
+ */
+class SimFocus : public SimGwacLink {
+protected:
+	enum {
+		MAX_FOCUS = 5	///< 单元内最大相机数量
+	};
+
+	string gid_, uid_;	///< 组标志, 单元标志
+	int cid0_;			///< 首台相机的标志
+	int n_;				///< 相机数量
+	double pos_[MAX_FOCUS];	///< 焦点位置
+	int tar_[MAX_FOCUS];	///< 目标位置
+	TimePoint tmLast_;		///< 上次推进的时间
+	TimePoint tmStatus_;	///< 下次发送位置的时间
+
+public:
+	SimFocus(Simulator& sim, const string& gid, const string& uid, int n);
+
+	void Tick(TimePoint now) override;
+
+protected:
+	void on_frame(const char* frame, TimePoint now) override;
+};
+
+/**
+ * @brief 相机: GWAC和GFT共用
+ */
+class SimCamera : public SimLink {
+protected:
+	KVCamera info_;		///< 工作状态
+	string planType_;	///< 计划类型
+	double exptime_ = 0.0;	///< 曝光时间, 秒, 已缩放
+	int frmcnt_ = 1;		///< 总帧数
+	TimePoint tmBegin_;		///< 当前帧开始曝光的时间
+	TimePoint tmEnd_;		///< 当前帧结束曝光的时间
+	TimePoint tmStatus_;	///< 下次发送状态的时间
+	bool changed_ = false;	///< 状态已改变
+
+public:
+	SimCamera(Simulator& sim, int peer, const string& gid, const string& uid, const string& cid);
+
+	void Tick(TimePoint now) override;
+
+protected:
+	void on_open(TimePoint now) override;
+	void on_frame(const char* frame, TimePoint now) override;
+	void start_frame(TimePoint now);
+	void send_status();
+};
+
+/**
+ * @brief GFT转台
+ */
+class SimMountGFT : public SimLink {
+protected:
+	KVMount info_;		///< 工作状态
+	MountMotion motion_;	///< 运动状态
+	TimePoint tmStatus_;	///< 下次发送状态的时间
+	bool changed_ = true;	///< 状态已改变
+
+public:
+	SimMountGFT(Simulator& sim, const string& gid, const string& uid);
+
+	void Tick(TimePoint now) override;
+
+protected:
+	void on_frame(const char* frame, TimePoint now) override;
+};
+
+/**
+ * @brief 客户端: 周期性提交观测计划
+ */
+class SimClient : public SimLink {
+public:
+	struct Unit {
+		string gid, uid;	///< 组标志, 单元标志
+		bool gft;			///< GFT系统
+		int seq = 0;		///< 计划序号
+		TimePoint tmNext;	///< 下次提交计划的时间
+	};
+
+protected:
+	std::vector<Unit> units_;	///< 提交计划的单元
+
+public:
+	SimClient(Simulator& sim, const std::vector<Unit>& units);
+
+	void Tick(TimePoint now) override;
+
+protected:
+	void on_open(TimePoint now) override;
+	void on_frame(const char* frame, TimePoint now) override;
+};
+
+/////////////////////////////////////////////////////////////////////
+SimLink::SimLink(Simulator& sim, int peer, const string& name)
+	: sim_(sim), peer_(peer), name_(name), sock_(sim.ios) {
+}
+
+void SimLink::Connect(const ip::tcp::endpoint& ep) {
+	sock_.async_connect(ep, boost::bind(&SimLink::handle_connect, this, _1));
+}
+
+void SimLink::Write(const string& frame) {
+	if (!open_) return;
+	++sim_.stats[peer_].sent;
+	wrque_.push_back(frame);
+	if (wrque_.size() == 1) {
+		async_write(sock_, buffer(wrque_.front()), boost::bind(&SimLink::handle_write, this, _1, _2));
+	}
+}
+
+void SimLink::handle_connect(const boost::system::error_code& ec) {
+	if (ec) {
+		fprintf(stderr, "%s: connect failed: %s\n", name_.c_str(), ec.message().c_str());
+		++sim_.stats[peer_].failed;
+		return;
+	}
+	open_ = true;
+	++sim_.stats[peer_].links;
+	sock_.set_option(ip::tcp::no_delay(true));
+	on_open(Clock::now());
+	do_read();
+}
+
+void SimLink::do_read() {
+	async_read_until(sock_, rdbuf_, '\n', boost::bind(&SimLink::handle_read, this, _1, _2));
+}
+
+void SimLink::handle_read(const boost::system::error_code& ec, size_t n) {
+	if (ec) {
+		close(ec);
+		return;
+	}
+	std::istream is(&rdbuf_);
+	std::getline(is, line_);
+	if (line_.size() && line_.back() == '\r') line_.pop_back();
+	if (line_.size()) {
+		++sim_.stats[peer_].rcvd;
+		on_frame(line_.c_str(), Clock::now());
+	}
+	do_read();
+}
+
+void SimLink::handle_write(const boost::system::error_code& ec, size_t n) {
+	if (ec) {
+		close(ec);
+		return;
+	}
+	wrque_.pop_front();
+	if (wrque_.size()) {
+		async_write(sock_, buffer(wrque_.front()), boost::bind(&SimLink::handle_write, this, _1, _2));
+	}
+}
+
+void SimLink::close(const boost::system::error_code& ec) {
+	if (!open_) return;
+	if (ec != error::operation_aborted) {
+		fprintf(stderr, "%s: connection closed: %s\n", name_.c_str(), ec.message().c_str());
+		++sim_.stats[peer_].failed;
+	}
+	open_ = false;
+	wrque_.clear();
+	boost::system::error_code ec1;
+	sock_.close(ec1);
+}
+
+/////////////////////////////////////////////////////////////////////
+SimMountGWAC::SimMountGWAC(Simulator& sim, const string& gid, int first, int n)
+	: SimGwacLink(sim, PEER_MOUNT_GWAC, "Mount<" + gid + ">") {
+	gid_ = gid;
+	first_ = first;
+	units_.resize(n);
+	char uid[8];
+	for (int i = 0; i < n; ++i) {
+		snprintf(uid, sizeof(uid), "%03d", first + i);
+		units_[i].uid = uid;
+		units_[i].motion.ra = 30.0 * i;
+	}
+}
+
+void SimMountGWAC::Tick(TimePoint now) {
+	if (!open_) return;
+	for (Unit& unit : units_) {
+		if (unit.motion.Advance(now)) changed_ = true;
+	}
+	if (changed_ || now >= tmStatus_) {// 状态: 改变时立即发送
+		send_status();
+		changed_ = false;
+		tmStatus_ = now + secs(1.0 / sim_.cfg.rateStatus);
+	}
+	for (Unit& unit : units_) {
+		if (now >= unit.tmPos) {
+			send_position(unit);
+			unit.tmPos = now + secs(1.0 / sim_.cfg.ratePos);
+		}
+	}
+}
+
+void SimMountGWAC::on_frame(const char* frame, TimePoint now) {
+	GwacCmd cmd;
+	std::string_view arg;
+	Unit* unit(NULL);
+
+	if (cmd.Split(frame) && !cmd.head.compare(0, 3, gid_)) {
+		for (Unit& x : units_) {
+			if (!cmd.head.compare(3, 3, x.uid)) unit = &x;
+		}
+	}
+	if (!unit) {
+		++sim_.stats[peer_].unknown;
+		return;
+	}
+
+	MountMotion& motion = unit->motion;
+	double slew = sim_.cfg.slewTime;
+	if (cmd.Is("trackvel", arg) || cmd.Is("guide", arg));
+	else if (cmd.Is("track", arg)) motion.Set(MOUNT_TRACKING);
+	else if (cmd.Is("abortslew", arg)) motion.Set(MOUNT_FREEZE);
+	else if (cmd.Is("slew", arg) || cmd.Is("HA", arg)) {
+		motion.Start(now, slew, MOUNT_SLEWING, MOUNT_TRACKING,
+			atoi(string(arg).c_str()) * 1E-4, atoi(string(cmd.arg2).c_str()) * 1E-4);
+	}
+	else if (cmd.Is("sync", arg)) {
+		motion.ra  = atoi(string(arg).c_str()) * 1E-4;
+		motion.dec = atoi(string(cmd.arg2).c_str()) * 1E-4;
+	}
+	else if (cmd.Is("park", arg)) motion.Start(now, slew, MOUNT_PARKING, MOUNT_PARKED, motion.ra, 40.0);
+	else if (cmd.Is("homera", arg)) motion.Start(now, slew, MOUNT_HOMING, MOUNT_HOMED, 0.0, 90.0);
+	else {
+		++sim_.stats[peer_].unknown;
+		return;
+	}
+	changed_ = true;
+	reply(cmd);
+}
+
+void SimMountGWAC::send_status() {
+	char buff[160];
+	int n = snprintf(buff, sizeof(buff), "g#%sstatus", gid_.c_str());
+	for (int i = 0; i < first_; ++i) buff[n++] = '0';
+	for (const Unit& unit : units_) buff[n++] = char('0' + unit.motion.state);
+	n += snprintf(buff + n, sizeof(buff) - n, "%%%s%%%05d%%\n", gwac_utc(), next_sn());
+	Write(buff, n);
+}
+
+void SimMountGWAC::send_position(const Unit& unit) {
+	char buff[160];
+	int n = snprintf(buff, sizeof(buff), "g#%s%scurrentpos%07d%%%+07d%%%s%%%05d%%\n",
+		gid_.c_str(), unit.uid.c_str(),
+		int(unit.motion.ra * 1E4 + 0.5), int(lround(unit.motion.dec * 1E4)),
+		gwac_utc(), next_sn());
+	Write(buff, n);
+}
+
+/////////////////////////////////////////////////////////////////////
+SimFocus::SimFocus(Simulator& sim, const string& gid, const string& uid, int n)
+	: SimGwacLink(sim, PEER_FOCUS, "Focus<" + gid + ":" + uid + ">") {
+	gid_ = gid;
+	uid_ = uid;
+	cid0_ = atoi(uid.c_str()) * 10 + 1;
+	n_ = std::min(n, int(MAX_FOCUS));
+	for (int i = 0; i < MAX_FOCUS; ++i) {
+		pos_[i] = 0.0;
+		tar_[i] = 0;
+	}
+	tmLast_ = Clock::now();
+}
+
+void SimFocus::Tick(TimePoint now) {
+	if (!open_) return;
+	double step = sim_.cfg.focusSpeed * std::chrono::duration<double>(now - tmLast_).count();
+	tmLast_ = now;
+	for (int i = 0; i < n_; ++i) {// 向目标位置移动
+		if (pos_[i] < tar_[i]) pos_[i] = std::min(pos_[i] + step, double(tar_[i]));
+		else if (pos_[i] > tar_[i]) pos_[i] = std::max(pos_[i] - step, double(tar_[i]));
+	}
+	if (n_ && now >= tmStatus_) {
+		// 焦点标志顺序与NonKVProtocol::focus_index()一致
+		static const char* ids[MAX_FOCUS] = {"es", "ws", "wn", "en", "mid"};
+		char buff[160];
+		int n = snprintf(buff, sizeof(buff), "g#%s%sfocus", gid_.c_str(), uid_.c_str());
+		for (int i = 0; i < n_; ++i)
+			n += snprintf(buff + n, sizeof(buff) - n, "%s%+05d", ids[i], int(lround(pos_[i])));
+		n += snprintf(buff + n, sizeof(buff) - n, "%%%s%%%05d%%\n", gwac_utc(), next_sn());
+		Write(buff, n);
+		tmStatus_ = now + secs(1.0 / sim_.cfg.rateStatus);
+	}
+}
+
+void SimFocus::on_frame(const char* frame, TimePoint now) {
+	GwacCmd cmd;
+	std::string_view arg;
+	if (!cmd.Split(frame) || cmd.head.compare(0, 3, gid_) || cmd.head.compare(3, 3, uid_)) {
+		++sim_.stats[peer_].unknown;
+		return;
+	}
+
+	if (cmd.Is("focus", arg) && arg.size() > 3) {// focus<cid><相对位置>, focus<cid>clear
+		int i = atoi(string(arg.substr(0, 3)).c_str()) - cid0_;
+		if (i >= 0 && i < n_) {
+			if (arg.substr(3) == "clear") pos_[i] = tar_[i] = 0;
+			else tar_[i] += atoi(string(arg.substr(3)).c_str());
+		}
+	}
+	else if (!cmd.Is("fwhm", arg)) {
+		++sim_.stats[peer_].unknown;
+		return;
+	}
+	reply(cmd);
+}
+
+/////////////////////////////////////////////////////////////////////
+SimCamera::SimCamera(Simulator& sim, int peer, const string& gid, const string& uid, const string& cid)
+	: SimLink(sim, peer, "Camera<" + gid + ":" + uid + ":" + cid + ">") {
+	info_.gid = gid;
+	info_.uid = uid;
+	info_.cid = cid;
+	info_.state   = CAMCTL_IDLE;
+	info_.errcode = 0;
+	info_.left    = 0.0;
+	info_.percent = 0.0;
+	info_.coolget = -40;
+	info_.imgtype = "bias";
+	info_.freedisk= 1000;
+	info_.loopno  = 0;
+	info_.frmno   = 0;
+}
+
+void SimCamera::Tick(TimePoint now) {
+	if (!open_) return;
+	if (info_.state == CAMCTL_EXPOSING) {
+		if (now >= tmEnd_) {// 曝光结束
+			info_.state = CAMCTL_IMGRDY;
+			info_.left = 0.0;
+			info_.percent = 100.0;
+			info_.fileName = "sim_" + info_.cid + "_" + std::to_string(info_.frmno) + ".fit";
+			changed_ = true;
+		}
+		else {
+			info_.left = std::chrono::duration<double>(tmEnd_ - now).count();
+			info_.percent = exptime_ > 0.0 ? 100.0 * (1.0 - info_.left / exptime_) : 100.0;
+		}
+	}
+	else if (info_.state == CAMCTL_IMGRDY) {// 图像就绪后持续一个节拍
+		if (++info_.frmno < frmcnt_) start_frame(now);
+		else info_.state = CAMCTL_IDLE;
+		changed_ = true;
+	}
+	if (changed_ || now >= tmStatus_) {
+		send_status();
+		changed_ = false;
+		tmStatus_ = now + secs(1.0 / sim_.cfg.rateStatus);
+	}
+}
+
+void SimCamera::on_open(TimePoint now) {
+	send_status();	// 登记相机
+	tmStatus_ = now + secs(1.0 / sim_.cfg.rateStatus);
+}
+
+void SimCamera::on_frame(const char* frame, TimePoint now) {
+	KVBasePtr proto = sim_.kvproto.Resolve(frame);
+	if (!proto) {
+		++sim_.stats[peer_].unknown;
+		return;
+	}
+
+	switch (proto->typeId) {
+	case KVID_APPGWAC:
+	case KVID_APPPLAN: {// 计划描述
+		KVAppPlanPtr plan = boost::static_pointer_cast<KVAppPlan>(proto);
+		info_.plan_sn = plan->plan_sn;
+		info_.imgtype = plan->imgtype;
+		info_.loopno  = 1;
+		exptime_ = plan->exptime * sim_.cfg.expScale;
+		frmcnt_  = std::max(plan->frmcnt, 1) * std::max(plan->loopcnt, 1);
+		break;
+	}
+	case KVID_EXPOSE: {
+		KVExpPtr expose = boost::static_pointer_cast<KVExpose>(proto);
+		if (expose->command == EXP_START) {
+			sim_.PlanExpose(info_.plan_sn, now);
+			info_.frmno = std::max(expose->frmno, 0);
+			if (info_.frmno < frmcnt_) start_frame(now);
+		}
+		else if (expose->command == EXP_STOP) info_.state = CAMCTL_IDLE;
+		else if (expose->command == EXP_PAUSE) info_.state = CAMCTL_PAUSEED;
+		changed_ = true;
+		break;
+	}
+	case KVID_ABORT:
+		info_.state = CAMCTL_IDLE;
+		changed_ = true;
+		break;
+	default:// 调焦、导星等信息不影响工作状态
+		break;
+	}
+}
+
+void SimCamera::start_frame(TimePoint now) {
+	info_.state = CAMCTL_EXPOSING;
+	info_.left = exptime_;
+	info_.percent = 0.0;
+	tmBegin_ = now;
+	tmEnd_ = now + secs(exptime_);
+}
+
+void SimCamera::send_status() {
+	OutBuffer& out = OutBuffer::Local();
+	info_.UpdateUTC();
+	info_.AppendTo(out);
+	Write(out.Data(), out.Size());
+}
+
+/////////////////////////////////////////////////////////////////////
+SimMountGFT::SimMountGFT(Simulator& sim, const string& gid, const string& uid)
+	: SimLink(sim, PEER_MOUNT_GFT, "Mount<" + gid + ":" + uid + ">") {
+	info_.gid = gid;
+	info_.uid = uid;
+	info_.errcode = 0;
+}
+
+void SimMountGFT::Tick(TimePoint now) {
+	if (!open_) return;
+	if (motion_.Advance(now)) changed_ = true;
+	if (changed_ || now >= tmStatus_) {
+		OutBuffer& out = OutBuffer::Local();
+		info_.state = motion_.state;
+		info_.ra  = motion_.ra;
+		info_.dec = motion_.dec;
+		info_.UpdateUTC();
+		info_.AppendTo(out);
+		Write(out.Data(), out.Size());
+		changed_ = false;
+		tmStatus_ = now + secs(1.0 / std::max(sim_.cfg.rateStatus, sim_.cfg.ratePos));
+	}
+}
+
+void SimMountGFT::on_frame(const char* frame, TimePoint now) {
+	KVBasePtr proto = sim_.kvproto.Resolve(frame);
+	double slew = sim_.cfg.slewTime;
+	if (!proto) {
+		++sim_.stats[peer_].unknown;
+		return;
+	}
+
+	switch (proto->typeId) {
+	case KVID_SLEWTO: {
+		KVSlewPtr slewto = boost::static_pointer_cast<KVSlewto>(proto);
+		if (slewto->coorsys == COORSYS_ALTAZ)
+			motion_.Start(now, slew, MOUNT_SLEWING, MOUNT_TRACKING, slewto->azi, slewto->ele);
+		else motion_.Start(now, slew, MOUNT_SLEWING, MOUNT_TRACKING, slewto->ra, slewto->dec);
+		break;
+	}
+	case KVID_PARK:  motion_.Start(now, slew, MOUNT_PARKING, MOUNT_PARKED, motion_.ra, 40.0); break;
+	case KVID_HOME:  motion_.Start(now, slew, MOUNT_HOMING, MOUNT_HOMED, 0.0, 90.0); break;
+	case KVID_ABORT: motion_.Set(MOUNT_FREEZE);   break;
+	case KVID_TRACK: motion_.Set(MOUNT_TRACKING); break;
+	default: return;
+	}
+	changed_ = true;
+}
+
+/////////////////////////////////////////////////////////////////////
+SimClient::SimClient(Simulator& sim, const std::vector<Unit>& units)
+	: SimLink(sim, PEER_CLIENT, "Client") {
+	units_ = units;
+}
+
+void SimClient::on_open(TimePoint now) {
+	// 等待设备登记后开始提交, 各单元均匀错开
+	int n = units_.size();
+	for (int i = 0; i < n; ++i)
+		units_[i].tmNext = now + secs(2.0 + sim_.cfg.planPeriod * i / n);
+}
+
+void SimClient::Tick(TimePoint now) {
+	if (!open_ || sim_.cfg.planPeriod <= 0.0) return;
+	for (Unit& unit : units_) {
+		if (now < unit.tmNext) continue;
+
+		KVAppPlan plan;
+		char sn[32];
+		snprintf(sn, sizeof(sn), "_%05d", ++unit.seq);
+		if (!unit.gft) {
+			plan.type   = KVTYPE_APPGWAC;
+			plan.typeId = KVID_APPGWAC;
+		}
+		plan.gid = unit.gid;
+		plan.uid = unit.uid;
+		plan.plan_sn = "sim" + unit.gid + unit.uid + sn;
+		plan.objid   = "sim";
+		plan.imgtype = "object";
+		plan.ra  = fmod(unit.seq * 7.5 + atoi(unit.uid.c_str()) * 20.0, 360.0);
+		plan.dec = 20.0 + (unit.seq % 4) * 10.0;
+		plan.exptime = sim_.cfg.planExptime;
+		plan.frmcnt  = sim_.cfg.planFrames;
+
+		OutBuffer& out = OutBuffer::Local();
+		plan.UpdateUTC();
+		plan.AppendTo(out);
+		Write(out.Data(), out.Size());
+		sim_.plans[plan.plan_sn].tmSubmit = now;
+		unit.tmNext = now + secs(sim_.cfg.planPeriod);
+	}
+}
+
+void SimClient::on_frame(const char* frame, TimePoint now) {
+	if (strncmp(frame, KVTYPE_PLAN " ", 5)) return;	// 只关注计划状态
+	KVBasePtr proto = sim_.kvproto.Resolve(frame);
+	if (!proto || proto->typeId != KVID_PLAN) {
+		++sim_.stats[peer_].unknown;
+		return;
+	}
+	KVPlanPtr plan = boost::static_pointer_cast<KVPlan>(proto);
+	sim_.PlanState(plan->plan_sn, plan->state, now);
+}
+
+/////////////////////////////////////////////////////////////////////
+Simulator::Simulator()
+	: timer_(ios), signals_(ios, SIGINT, SIGTERM) {
+}
+
+void Simulator::add_link(const SimLinkPtr& link, int port) {
+	boost::system::error_code ec;
+	link->Connect(ip::tcp::endpoint(ip::address::from_string(cfg.host, ec), port));
+	links_.push_back(link);
+}
+
+void Simulator::Run() {
+	std::vector<SimClient::Unit> units;
+	SimClient::Unit unit;
+	char gid[12], uid[12], cid[12]; // 容纳任意int
+
+	// GWAC: 服务器按组标志确定首个单元在状态中的序号
+	for (int g = 1; g <= cfg.groups; ++g) {
+		snprintf(gid, sizeof(gid), "%03d", g);
+		int first = g == 1 ? 1 : 5;
+		int n = std::min(cfg.units, 11 - first);
+		if (n < cfg.units) printf("Mount<%s> is limited to %d units\n", gid, n);
+		add_link(SimLinkPtr(new SimMountGWAC(*this, gid, first, n)), param.portMountGWAC);
+
+		for (int u = first; u < first + n; ++u) {
+			snprintf(uid, sizeof(uid), "%03d", u);
+			int ncam = std::min(cfg.cameras, 5);
+			if (cfg.focusers) add_link(SimLinkPtr(new SimFocus(*this, gid, uid, ncam)), param.portFocusGWAC);
+			for (int c = 0; c < ncam; ++c) {
+				snprintf(cid, sizeof(cid), "%03d", u * 10 + 1 + c);
+				add_link(SimLinkPtr(new SimCamera(*this, PEER_CAMERA_GWAC, gid, uid, cid)), param.portCameraGWAC);
+			}
+			unit.gid = gid;
+			unit.uid = uid;
+			unit.gft = false;
+			units.push_back(unit);
+		}
+	}
+	// GFT
+	for (int u = 1; u <= cfg.gfts; ++u) {
+		snprintf(uid, sizeof(uid), "%03d", u);
+		add_link(SimLinkPtr(new SimMountGFT(*this, "100", uid)), param.portMountGFT);
+		for (int c = 1; c <= cfg.gftCameras; ++c) {
+			snprintf(cid, sizeof(cid), "%03d", c);
+			add_link(SimLinkPtr(new SimCamera(*this, PEER_CAMERA_GFT, "100", uid, cid)), param.portCameraGFT);
+		}
+		unit.gid = "100";
+		unit.uid = uid;
+		unit.gft = true;
+		units.push_back(unit);
+	}
+	// 客户端: 接收计划状态
+	add_link(SimLinkPtr(new SimClient(*this, units)), param.portClient);
+
+	printf("simulating %d GWAC groups, %d GFT mounts, %d links\n", cfg.groups, cfg.gfts, int(links_.size()));
+	signals_.async_wait(boost::bind(&io_service::stop, &ios));
+	tmStart_ = Clock::now();
+	timer_.expires_after(std::chrono::milliseconds(10));
+	timer_.async_wait(boost::bind(&Simulator::handle_tick, this, _1));
+	ios.run();
+	Report();
+}
+
+void Simulator::handle_tick(const boost::system::error_code& ec) {
+	if (ec) return;
+	TimePoint now = Clock::now();
+	if (cfg.duration > 0.0 && now - tmStart_ >= secs(cfg.duration)) {
+		ios.stop();
+		return;
+	}
+	for (auto& link : links_) link->Tick(now);
+	timer_.expires_at(timer_.expiry() + std::chrono::milliseconds(10));
+	timer_.async_wait(boost::bind(&Simulator::handle_tick, this, _1));
+}
+
+void Simulator::PlanState(const string& plan_sn, int state, TimePoint now) {
+	auto it = plans.find(plan_sn);
+	if (it == plans.end()) return;
+	PlanTrack& track = it->second;
+	if (state == OBSPLAN_RUNNING && !track.running) {
+		track.running = true;
+		track.tmRunning = now;
+	}
+	track.state = state;
+}
+
+void Simulator::PlanExpose(const string& plan_sn, TimePoint now) {
+	auto it = plans.find(plan_sn);
+	if (it != plans.end() && !it->second.exposed) {
+		it->second.exposed = true;
+		it->second.tmExpose = now;
+	}
+}
+
+/*!
+ * @brief 输出延迟分布, 毫秒
+ */
+static void print_latency(const char* name, std::vector<double>& lat) {
+	if (lat.empty()) {
+		printf("%-18s n/a\n", name);
+		return;
+	}
+	std::sort(lat.begin(), lat.end());
+	double sum(0.0);
+	for (double x : lat) sum += x;
+	int n = lat.size();
+	printf("%-18s n=%d mean %.1f ms, p50 %.1f ms, p99 %.1f ms, max %.1f ms\n", name, n,
+		sum / n, lat[n / 2], lat[std::min(n - 1, int(n * 0.99))], lat.back());
+}
+
+void Simulator::Report() {
+	static const struct {
+		int peer;
+		const char* name;
+	} peers[] = {
+		{PEER_CLIENT,      "client"},
+		{PEER_MOUNT_GWAC,  "mount-gwac"},
+		{PEER_CAMERA_GWAC, "camera-gwac"},
+		{PEER_FOCUS,       "focus"},
+		{PEER_MOUNT_GFT,   "mount-gft"},
+		{PEER_CAMERA_GFT,  "camera-gft"}
+	};
+	double elapsed = std::chrono::duration<double>(Clock::now() - tmStart_).count();
+
+	printf("%-12s %6s %6s %10s %10s %8s\n", "peer", "links", "failed", "sent", "received", "unknown");
+	for (auto& peer : peers) {
+		const SimStat& stat = stats[peer.peer];
+		printf("%-12s %6llu %6llu %10llu %10llu %8llu\n", peer.name,
+			(unsigned long long) stat.links, (unsigned long long) stat.failed,
+			(unsigned long long) stat.sent, (unsigned long long) stat.rcvd,
+			(unsigned long long) stat.unknown);
+	}
+	printf("elapsed: %.3f s\n", elapsed);
+	if (plans.empty()) return;
+
+	std::vector<double> latRun, latExp;
+	int over(0), interrupted(0);
+	for (auto& x : plans) {
+		const PlanTrack& track = x.second;
+		if (track.running) latRun.push_back(std::chrono::duration<double, std::milli>(track.tmRunning - track.tmSubmit).count());
+		if (track.exposed) latExp.push_back(std::chrono::duration<double, std::milli>(track.tmExpose - track.tmSubmit).count());
+		if (track.state == OBSPLAN_OVER) ++over;
+		else if (track.state == OBSPLAN_INTERRUPTED) ++interrupted;
+	}
+	printf("plans: submitted %d, running %d, exposed %d, over %d, interrupted %d\n",
+		int(plans.size()), int(latRun.size()), int(latExp.size()), over, interrupted);
+	print_latency("submit->running", latRun);
+	print_latency("submit->expose", latExp);
+}
+
+/////////////////////////////////////////////////////////////////////
+static void usage() {
+	printf("Usage: gtoaes_sim [-c config] [-h host] [options]\n");
+	printf("  -c  configuration file, default: %s\n", CONFIG_PATH);
+	printf("  -h  server address, default: 127.0.0.1\n");
+	printf("  -g  GWAC mount groups, default: 1\n");
+	printf("  -u  units per GWAC group, default: 5\n");
+	printf("  -k  cameras per GWAC unit, 0-5, default: 5\n");
+	printf("  -f  focuser per GWAC unit, 0 or 1, default: 1\n");
+	printf("  -m  GFT mounts, default: 0\n");
+	printf("  -K  cameras per GFT mount, default: 1\n");
+	printf("  -r  status rate of mounts, cameras and focusers, Hz, default: 1\n");
+	printf("  -p  position rate of GWAC mounts, Hz, default: 1\n");
+	printf("  -s  seconds to slew, park or find home, default: 3\n");
+	printf("  -x  exposure time scale, default: 0.1\n");
+	printf("  -P  seconds between plans submitted per unit, default: 0, no plan\n");
+	printf("  -d  seconds to run, default: 0, until interrupted\n");
+}
+
+int main(int argc, char** argv) {
+	Simulator sim;
+	SimConfig& cfg = sim.cfg;
+	string pathConfig(CONFIG_PATH);
+	for (int i = 1; i < argc; ++i) {
+		if (i + 1 == argc || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+			usage();
+			return 1;
+		}
+		const char* val = argv[++i];
+		switch (argv[i - 1][1]) {
+		case 'c': pathConfig = val;                  break;
+		case 'h': cfg.host = val;                    break;
+		case 'g': cfg.groups = atoi(val);            break;
+		case 'u': cfg.units = atoi(val);             break;
+		case 'k': cfg.cameras = atoi(val);           break;
+		case 'f': cfg.focusers = atoi(val);          break;
+		case 'm': cfg.gfts = atoi(val);              break;
+		case 'K': cfg.gftCameras = atoi(val);        break;
+		case 'r': cfg.rateStatus = atof(val);        break;
+		case 'p': cfg.ratePos = atof(val);           break;
+		case 's': cfg.slewTime = atof(val);          break;
+		case 'x': cfg.expScale = atof(val);          break;
+		case 'P': cfg.planPeriod = atof(val);        break;
+		case 'd': cfg.duration = atof(val);          break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (cfg.groups < 0 || cfg.groups > 99 || cfg.units < 1 || cfg.gfts < 0 || cfg.gfts > 999
+			|| cfg.rateStatus <= 0.0 || cfg.ratePos <= 0.0 || cfg.slewTime < 0.0 || cfg.expScale < 0.0) {
+		usage();
+		return 1;
+	}
+
+	if (!sim.param.Load(pathConfig)) printf("using default ports\n");
+	sim.Run();
+
+	return 0;
+}
@@ -0,0 +1,157 @@
+/*!
+ * @file soak.cpp 浸泡测试: 连接数量增加时gtoaes的线程数量
+ * @brief
+ * - 按步长逐步增加到运行中gtoaes的空闲连接, 依次轮换客户端、GWAC相机、GFT转台和GFT相机端口
+ * - 每步保持指定时间, 期间丢弃服务器发送的数据, 结束时由/proc/<pid>/status读取线程数量
+ * - 共享I/O线程池的线程数量与连接数量无关. 线程数量超过首次采样值与容差之和时失败
+ * @note
+ * Usage: gtoaes_soak [-c config] [-h host] [-p pid] [-n step] [-m max] [-t seconds] [-T tolerance]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/thread/thread.hpp>
+#include "globaldef.h"
+#include "GLog.h"
+#include "Parameter.h"
+
+using namespace boost::asio;
+using namespace boost::chrono;
+using std::string;
+
+GLog _gLog(stdout);
+
+typedef boost::shared_ptr<ip::tcp::socket> TcpSockPtr;
+
+/*!
+ * @brief 读取进程的线程数量
+ * @return
+ * 线程数量. -1: 进程不存在
+ */
+static int thread_count(int pid) {
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/status", pid);
+	std::ifstream ifs(path);
+	string line;
+	while (std::getline(ifs, line)) {
+		if (!line.compare(0, 8, "Threads:")) return atoi(line.c_str() + 8);
+	}
+	return -1;
+}
+
+/*!
+ * @brief 丢弃服务器发送的数据
+ * @return
+ * 仍然有效的连接数量
+ */
+static int drain(std::vector<TcpSockPtr>& socks) {
+	static char scratch[65536];
+	int alive(0);
+	for (auto it = socks.begin(); it != socks.end(); ++it) {
+		boost::system::error_code ec;
+		while ((*it)->available(ec) > 0 && !ec) (*it)->read_some(buffer(scratch), ec);
+		if (!ec) ++alive;
+	}
+	return alive;
+}
+
+static void usage() {
+	printf("Usage: gtoaes_soak [-c config] [-h host] [-p pid] [-n step] [-m max] [-t seconds] [-T tolerance]\n");
+	printf("  -c  configuration file of gtoaes, default: %s\n", CONFIG_PATH);
+	printf("  -h  server address, default: 127.0.0.1\n");
+	printf("  -p  process id of gtoaes, default: read from %s\n", DAEMON_PID);
+	printf("  -n  connections added per step, default: 100\n");
+	printf("  -m  maximum connections, default: 500\n");
+	printf("  -t  seconds per step, default: 2\n");
+	printf("  -T  tolerated extra threads, default: 0\n");
+}
+
+int main(int argc, char** argv) {
+	string pathConfig(CONFIG_PATH), host("127.0.0.1");
+	int pid(0), step(100), maxconn(500), tolerance(0);
+	double seconds(2.0);
+	for (int i = 1; i < argc; ++i) {
+		if (i + 1 == argc || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+			usage();
+			return 1;
+		}
+		const char* val = argv[++i];
+		switch (argv[i - 1][1]) {
+		case 'c': pathConfig = val;      break;
+		case 'h': host = val;            break;
+		case 'p': pid = atoi(val);       break;
+		case 'n': step = atoi(val);      break;
+		case 'm': maxconn = atoi(val);   break;
+		case 't': seconds = atof(val);   break;
+		case 'T': tolerance = atoi(val); break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (step <= 0 || maxconn < step || seconds <= 0.0 || tolerance < 0) {
+		usage();
+		return 1;
+	}
+	if (!pid) {
+		std::ifstream ifs(DAEMON_PID);
+		ifs >> pid;
+	}
+	int threads0 = pid > 0 ? thread_count(pid) : -1;
+	if (threads0 < 0) {
+		printf("FAIL: gtoaes is not running\n");
+		return 1;
+	}
+
+	Parameter param;
+	if (!param.Load(pathConfig)) printf("using default ports\n");
+	const int ports[] = {param.portClient, param.portCameraGWAC, param.portMountGFT, param.portCameraGFT};
+	const int nport = sizeof(ports) / sizeof(ports[0]);
+
+	io_service ios;
+	std::vector<TcpSockPtr> socks;
+	int threads, threadsMax(threads0), failed(0);
+	printf("%12s %8s\n", "connections", "threads");
+	printf("%12d %8d\n", 0, threads0);
+	while (int(socks.size()) < maxconn) {
+		for (int i = 0; i < step && int(socks.size()) < maxconn; ++i) {
+			boost::system::error_code ec;
+			TcpSockPtr sock(new ip::tcp::socket(ios));
+			sock->connect(ip::tcp::endpoint(ip::address::from_string(host, ec), ports[socks.size() % nport]), ec);
+			if (ec) {
+				printf("FAIL: connection %d: %s\n", int(socks.size()) + 1, ec.message().c_str());
+				return 1;
+			}
+			socks.push_back(sock);
+		}
+		steady_clock::time_point tmEnd = steady_clock::now() + milliseconds(int(seconds * 1000));
+		while (steady_clock::now() < tmEnd) {
+			drain(socks);
+			boost::this_thread::sleep_for(milliseconds(10));
+		}
+		int alive = drain(socks);
+		if ((threads = thread_count(pid)) < 0) {
+			printf("FAIL: gtoaes exited\n");
+			return 1;
+		}
+		if (threads > threadsMax) threadsMax = threads;
+		printf("%12d %8d\n", int(socks.size()), threads);
+		if (alive != int(socks.size())) {
+			printf("FAIL: %d connections are closed by server\n", int(socks.size()) - alive);
+			++failed;
+		}
+	}
+	if (threadsMax > threads0 + tolerance) {
+		printf("FAIL: threads grow from %d to %d\n", threads0, threadsMax);
+		++failed;
+	}
+	else printf("PASS: threads stay at %d with %d connections\n", threadsMax, int(socks.size()));
+	return failed ? 1 : 0;
+}
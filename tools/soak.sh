@@ -0,0 +1,32 @@
+#!/bin/sh
+# 浸泡测试: 在临时目录中启动gtoaes, 运行gtoaes_soak, 检查线程数量不随连接数量增加
+# Usage: soak.sh <gtoaes> <gtoaes_soak> [gtoaes_soak options]
+# 仅适用于调试版本: 读取当前目录的配置文件, 日志输出至标准输出
+DAEMON=$1
+TEST=$2
+shift 2
+PIDFILE=/var/run/gtoaes.pid
+DIR=$(mktemp -d)
+PID=
+trap 'stop_daemon; rm -rf "$DIR"' EXIT
+cd "$DIR" || exit 1
+
+stop_daemon() {
+	[ -n "$PID" ] || return
+	kill -INT $PID 2>/dev/null
+	while kill -0 $PID 2>/dev/null; do sleep 0.1; done
+	PID=
+}
+
+"$DAEMON" -d
+sed -i "s#<Journal path=\"[^\"]*\"#<Journal path=\"$DIR/plan.journal\"#" gtoaes.xml
+# 守护进程在启动后两次fork, 由PID文件取得进程号
+"$DAEMON" > daemon.log 2>&1
+sleep 1
+PID=$(head -n 1 $PIDFILE)
+
+"$TEST" -c gtoaes.xml -p "$PID" "$@"
+RC=$?
+stop_daemon
+[ $RC -eq 0 ] || cat daemon.log
+exit $RC